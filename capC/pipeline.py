@@ -55,6 +55,9 @@ class Parameters:
         self.combinecount = 1
         self.alignmode = "CONSERVATIVE"
         self.aligncustom = ""
+        self.stream_align = False
+        self.save_pairs = True
+        self.distance_bins = 0
 
         # flags to check if parameter is set
         self.flag_fastq1 = False
@@ -181,6 +184,24 @@ def ParseConfigFile(configfile):
                         raise RuntimeError("Error reading configuration file line:\n      %s\n"%line)
                     params.processors = int(word[1])
 
+                elif word[0] == "STREAMALIGN":
+                    if len(word) < 2 :
+                        raise RuntimeError("Error reading configuration file line:\n      %s\n"%line)
+                    if word[1].upper() == "TRUE":
+                        params.stream_align = True
+
+                elif word[0] == "PAIRSFILES":
+                    if len(word) < 2 :
+                        raise RuntimeError("Error reading configuration file line:\n      %s\n"%line)
+                    if word[1].upper() == "FALSE":
+                        params.save_pairs = False
+
+                elif word[0] == "DISTANCEBINS":
+                    if len(word) < 2 or ( not word[1].isdigit() ) or \
+                       not ( 1 <= int(word[1]) <= 100 ):
+                        raise RuntimeError("Error reading configuration file line:\n      %s\n"%line)
+                    params.distance_bins = int(word[1])
+
                 elif word[0] == "DRYRUN":
                     if len(word) < 2 :
                         raise RuntimeError("Error reading configuration file line:\n      %s\n"%line)
@@ -305,6 +326,27 @@ def getCombinedTargets(target):
     return combined_targets
 
 
+def copy_bowtie_log():
+    """ Some useful information is put into the bowtie stderr file
+        -- copy this into the stdout file """
+    with open("bowtie.stderr.log") as inf:
+        with open("bowtie.stdout.log", "w") as ouf:
+            for line in inf:
+                if not line.startswith("Warning:"):
+                    ouf.write(line)
+
+
+def remove_intermediate_fastq(params,mainlogfile,trimmedfile1,trimmedfile2,digestedfile):
+    """ Remove the trimmed and digested fastq files once aligned """
+    if not params.dryrun:
+        os.remove(trimmedfile1)   # Remove the trimmed fastq files
+        os.remove(trimmedfile2)
+        os.remove(digestedfile)   # Remove the in silico digested fastq
+        mainlogfile.write("# rm %s \n"%trimmedfile1)
+        mainlogfile.write("# rm %s \n"%trimmedfile2)
+        mainlogfile.write("# rm %s \n"%digestedfile)
+
+
 def normalize_pileup(infile, outfile, total_reads):
     """ Read in a rawpileup file and generate a normalizedpileup file """
     
@@ -517,82 +559,67 @@ def run_pipeline(args):
 
     #####################################################################################  
     # Align with bowtie as single end reads
-    try:
-        sys.stdout.write("\nAligning to genome using bowtie\n...")
-        sys.stdout.flush()
-        stdoutfile = open("bowtie.stdout.log",'w')
-        stderrfile = open("bowtie.stderr.log",'w')
-        alignedsam = "aligned.sam"
-        command = ("bowtie -p %s %s %s %s %s"%(params.processors,params.bowtie_args,fullpathindex,digestedfile,alignedsam)).split()
-        mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-        if not params.dryrun:
-            returncode = subprocess.call(command,
-                                         stdout=stdoutfile,stderr=stderrfile)
-            if ( not returncode==0 ):
-                raise RuntimeError("Error in alignment...Exiting...\n")
-        sys.stdout.write(" \t Done.\n")
-        stdoutfile.close()
-        stderrfile.close()
-        # some useful information is put into the stderrfile
-        #   -- copy this into stdout file
-        with open("bowtie.stderr.log") as inf:
-            with open("bowtie.stdout.log", "w") as ouf:
-                for line in inf:
-                    if not line.startswith("Warning:"):
-                        ouf.write(line)
-    except RuntimeError as e:
-        sys.stdout.write("Error : "+str(e))
-        sys.exit(1) # exit with error code
+    # (in stream mode the aligner is piped straight into capCmain below)
+    if not params.stream_align:
+        try:
+            sys.stdout.write("\nAligning to genome using bowtie\n...")
+            sys.stdout.flush()
+            stdoutfile = open("bowtie.stdout.log",'w')
+            stderrfile = open("bowtie.stderr.log",'w')
+            alignedsam = "aligned.sam"
+            command = ("bowtie -p %s %s %s %s %s"%(params.processors,params.bowtie_args,fullpathindex,digestedfile,alignedsam)).split()
+            mainlogfile.write(subprocess.list2cmdline(command)+"\n")
+            if not params.dryrun:
+                returncode = subprocess.call(command,
+                                             stdout=stdoutfile,stderr=stderrfile)
+                if ( not returncode==0 ):
+                    raise RuntimeError("Error in alignment...Exiting...\n")
+            sys.stdout.write(" \t Done.\n")
+            stdoutfile.close()
+            stderrfile.close()
+            copy_bowtie_log()
+        except RuntimeError as e:
+            sys.stdout.write("Error : "+str(e))
+            sys.exit(1) # exit with error code
 
 
     #####################################################################################  
     # Clean up some intermediate files at this point
-    if not params.dryrun:
-        os.remove(trimmedfile1)   # Remove the trimmed fastq files
-        os.remove(trimmedfile2)
-        os.remove(digestedfile)   # Remove the in silico digested fastq
-        mainlogfile.write("# rm %s \n"%trimmedfile1)
-        mainlogfile.write("# rm %s \n"%trimmedfile2)
-        mainlogfile.write("# rm %s \n"%digestedfile)
+    # (in stream mode the digested fastq is still needed, so wait until after capCmain)
+    if not params.stream_align:
+        remove_intermediate_fastq(params,mainlogfile,trimmedfile1,trimmedfile2,digestedfile)
 
     #####################################################################################  
     # Sort the output SAM file by read name
-    try:
-        sys.stdout.write("\nSorting SAM file by read name\n...")
-        sys.stdout.flush()
-        alignedbam = "aligned.bam"
-        command = ["samtools", "view", "-S", "-b", "-@", "%i"%params.processors, "-o", alignedbam, alignedsam]
-        mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-        if not params.dryrun:
-            returncode = subprocess.call(command)
-            if ( not returncode==0 ):
-                raise RuntimeError("Error while converting sam -> bam ...Exiting...\n")
-            # can now remove the aligned sam
-            os.remove(alignedsam)
-
-        sortedbam = "srt_aligned.bam"
-        command = ["samtools", "sort", "-n", "-@", "%i"%params.processors, "-o", sortedbam, "-T", "tempsort", alignedbam]
-        mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-        if not params.dryrun:
-            returncode = subprocess.call(command)
-            if ( not returncode==0 ):
-                raise RuntimeError("Error while sorting bam ...Exiting...\n")
-            # can now remove the aligned bam
-            os.remove(alignedbam)
+    if not params.stream_align:
+        try:
+            sys.stdout.write("\nSorting SAM file by read name\n...")
+            sys.stdout.flush()
+            alignedbam = "aligned.bam"
+            command = ["samtools", "view", "-S", "-b", "-@", "%i"%params.processors, "-o", alignedbam, alignedsam]
+            mainlogfile.write(subprocess.list2cmdline(command)+"\n")
+            if not params.dryrun:
+                returncode = subprocess.call(command)
+                if ( not returncode==0 ):
+                    raise RuntimeError("Error while converting sam -> bam ...Exiting...\n")
+                # can now remove the aligned sam
+                os.remove(alignedsam)
 
-        sortedsam = "srt_aligned.sam"
-        command = ["samtools", "view", "-h", "-@", "%i"%params.processors, "-o", sortedsam, sortedbam]
-        mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-        if not params.dryrun:
-            returncode = subprocess.call(command)
-            if ( not returncode==0 ):
-                raise RuntimeError("Error while converting bam -> sam ...Exiting...\n")
+            sortedbam = "srt_aligned.bam"
+            command = ["samtools", "sort", "-n", "-@", "%i"%params.processors, "-o", sortedbam, "-T", "tempsort", alignedbam]
+            mainlogfile.write(subprocess.list2cmdline(command)+"\n")
+            if not params.dryrun:
+                returncode = subprocess.call(command)
+                if ( not returncode==0 ):
+                    raise RuntimeError("Error while sorting bam ...Exiting...\n")
+                # can now remove the aligned bam
+                os.remove(alignedbam)
 
-        # we now have a sorted BAM and a sorted SAM file
-        sys.stdout.write(" \t Done.\n")
-    except RuntimeError as e:
-        sys.stdout.write("Error : "+str(e))
-        sys.exit(1) # exit with error code
+            # we now have a sorted BAM file, which capCmain reads directly
+            sys.stdout.write(" \t Done.\n")
+        except RuntimeError as e:
+            sys.stdout.write("Error : "+str(e))
+            sys.exit(1) # exit with error code
 
 
     #####################################################################################  
@@ -603,13 +630,48 @@ def run_pipeline(args):
         pairsfile = "captured"
         stdoutfile = open("capCmain.stdout.log",'w')
         stderrfile = open("capCmain.stderr.log",'w')
+        if params.stream_align:
+            # bowtie keeps reads in input order and capCmain reads its SAM output
+            # from stdin, so no alignment file is written or sorted
+            samsource = "-"
+            aligncommand = ("bowtie -p %s --reorder %s %s %s"%(params.processors,params.bowtie_args,fullpathindex,digestedfile)).split()
+        else:
+            samsource = sortedbam
         command = [rs.capCmap_extern["main"],"-r",fullpathrestfragfile,"-t",fullpathtargfile,
-                   "-s",sortedsam,"-o",pairsfile,"-e","%s"%params.exclusion]
+                   "-s",samsource,"-o",pairsfile,"-e","%s"%params.exclusion,
+                   "-p","%i"%params.processors]
         # always save interchromosomal interactions
         command.extend(["-i"])
-        mainlogfile.write(subprocess.list2cmdline(command)+"\n")
+        # pile up the valid pairs into bedgraphs in the same pass
+        command.extend(["--pileup"])
+        if params.combinemode:
+            command.extend(["--combine"])
+        if not params.save_pairs:
+            command.extend(["--no-pairs"])
+        if params.distance_bins > 0:
+            command.extend(["--distance-bins","%i"%params.distance_bins])
+        if params.stream_align:
+            mainlogfile.write(subprocess.list2cmdline(aligncommand)+" | "+subprocess.list2cmdline(command)+"\n")
+        else:
+            mainlogfile.write(subprocess.list2cmdline(command)+"\n")
         if not params.dryrun:
-            returncode = subprocess.call(command,stderr=stderrfile)
+            if params.stream_align:
+                alignerrfile = open("bowtie.stderr.log",'w')
+                aligner = subprocess.Popen(aligncommand,stdout=subprocess.PIPE,stderr=alignerrfile)
+                main = subprocess.Popen(command,stdin=aligner.stdout,stderr=stderrfile)
+                # close our copy of the pipe, so bowtie sees it break if capCmain stops
+                aligner.stdout.close()
+                returncode = main.wait()
+                alignercode = aligner.wait()
+                # if capCmain failed bowtie will have been stopped too, so report capCmain
+                if ( not returncode==0 ):
+                    raise RuntimeError("Error in main processing step...Exiting...\n")
+                if ( not alignercode==0 ):
+                    raise RuntimeError("Error in alignment...Exiting...\n")
+                alignerrfile.close()
+                copy_bowtie_log()
+            else:
+                returncode = subprocess.call(command,stderr=stderrfile)
             if ( not returncode==0 ):
                 raise RuntimeError("Error in main processing step...Exiting...\n")
         sys.stdout.write("... \t Done.\n")
@@ -619,63 +681,40 @@ def run_pipeline(args):
         sys.stdout.write("Error : "+str(e))
         sys.exit(1) # exit with error code
 
+    if params.stream_align:
+        remove_intermediate_fastq(params,mainlogfile,trimmedfile1,trimmedfile2,digestedfile)
+
 
     #####################################################################################  
-    # Pile-up pairs files into bedgraphs
+    # capCmain has piled up the valid pairs into a bedgraph for each target;
+    # normalize these if required
     try:
-        sys.stdout.write("\nPiling up valid pairs into a bedgraph file for each target\n")
-        stdoutfile = open("pileup.stdout.log",'w')
-        stderrfile = open("pileup.stderr.log",'w')
         reportfile = "%s_report.dat"%pairsfile
         if not params.dryrun:
             total_reads = report2totreads(reportfile,target)
-        for T in target:
-            infile = "%s_validpairs_%s.pairs"%(pairsfile,T)
-            outfile = "%s_rawpileup_%s.bdg"%(pairsfile,T)
-            loc = "%s:%i-%i"%(target[T][0],target[T][1],target[T][2])
-            sys.stdout.write("...target %s\n"%T)
-            command = [rs.capCmap_extern["pair2bg"],"-i",infile,"-o",outfile,"-n",T,"-t",loc]
-            mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-            if not params.dryrun:
-                returncode = subprocess.call(command,
-                                             stdout=stdoutfile,stderr=stderrfile)
-                if ( not returncode==0 ):
-                    raise RuntimeError("Error piling up pairs file %s .\n"%infile)
-            if params.normalize:
+        if not params.save_inter and not params.dryrun:
+            # interchromosomal pile-ups are only kept if asked for
+            for T in target:
+                os.remove("%s_rawpileup_interchom_%s.bdg"%(pairsfile,T))
+            if params.combinemode:
+                for T in getCombinedTargets(target).keys():
+                    os.remove("%s_rawpileup_interchom_%s.bdg"%(pairsfile,T))
+        if params.normalize:
+            sys.stdout.write("\nNormalizing the pile-up bedgraph file for each target\n")
+            for T in target:
+                sys.stdout.write("...target %s\n"%T)
                 infile = "%s_rawpileup_%s.bdg"%(pairsfile,T)
                 outfile = "%s_normalizedpileup_%s.bdg"%(pairsfile,T)
                 if not params.dryrun: 
                     normalize_pileup(infile, outfile, total_reads[T])
-
-        # now do the same for interchromosomal
-        if params.save_inter:
-            sys.stdout.write("\nPiling up interchromosomal pairs into a bedgraph file for each target\n")
-            reportfile = "%s_report.dat"%pairsfile
-            if not params.dryrun:
-                total_reads = report2totreads(reportfile,target)
-            for T in target:
-                infile = "%s_validinterchom_%s.pairs"%(pairsfile,T)
-                outfile = "%s_rawpileup_interchom_%s.bdg"%(pairsfile,T)
-                loc = "%s:%i-%i"%(target[T][0],target[T][1],target[T][2])
-                sys.stdout.write("...target %s\n"%T)
-                command = [rs.capCmap_extern["pair2bg"],"-i",infile,"-o",outfile,"-n",T,"-t",loc,"--interchrom"]
-                mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-                if not params.dryrun:
-                    returncode = subprocess.call(command,
-                                                 stdout=stdoutfile,stderr=stderrfile)
-                    if ( not returncode==0 ):
-                        raise RuntimeError("Error piling up pairs file %s .\n"%infile)
-                if params.normalize:
+                if params.save_inter:
                     infile = "%s_rawpileup_interchom_%s.bdg"%(pairsfile,T)
                     outfile = "%s_normalizedpileup_interchom_%s.bdg"%(pairsfile,T)
                     if not params.dryrun: 
                         normalize_pileup(infile, outfile, total_reads[T])
+            sys.stdout.write("... \t Done.\n")
 
-        stdoutfile.close()
-        stderrfile.close()
-        sys.stdout.write("... \t Done.\n")
-
-    except RuntimeError as e:
+    except (RuntimeError, OSError) as e:
         sys.stdout.write("Error : "+str(e))
         sys.exit(1) # exit with error code  
 
@@ -732,68 +771,29 @@ def run_pipeline(args):
        
 
     #####################################################################################  
-    # If any targets need to be combined, do that here
+    # If any targets need to be combined, capCmain has piled them up
+    # together; normalize these if required
     try:
         if params.combinemode:
             # some of the targets need to be combined
             combined_targets = getCombinedTargets(target)
 
-            stdoutfile = open("pileup.stdout.log",'a')
-            stderrfile = open("pileup.stderr.log",'a')
-            for T in combined_targets.keys():
-                # first do pile-up
-                sys.stdout.write("\nPiling up valid pairs into a bedgraph file for combined targets %s\n"%T)
-                infiles = [ "%s_validpairs_%s.pairs"%(pairsfile,i) for i in combined_targets[T] ]
-                locs = [ "%s:%i-%i"%(target[i][0],target[i][1],target[i][2]) for i in combined_targets[T] ]
-                outfile = "%s_rawpileup_%s.bdg"%(pairsfile,T)
-                command = [rs.capCmap_extern["pair2bg"],"-o",outfile,"-n",T]
-                for i in range(len(infiles)):
-                    command.extend(["-i",infiles[i]])
-                    command.extend(["-t",locs[i]])
-                mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-                if not params.dryrun:
-                    returncode = subprocess.call(command,stdout=stdoutfile,stderr=stderrfile)
-                    if ( not returncode==0 ):
-                        raise RuntimeError("Error piling up combined pairs file %s .\n"%infile)
-                if params.normalize:
-                    infile = "%s_rawpileup_%s.bdg"%(pairsfile,T)
-                    outfile = "%s_normalizedpileup_%s.bdg"%(pairsfile,T)
+            if params.normalize:
+                sys.stdout.write("\nNormalizing the pile-up bedgraph files for combined targets\n")
+                for T in combined_targets.keys():
                     totalreadsT = 0
                     for i in combined_targets[T]:
                         totalreadsT = totalreadsT + total_reads[i]
+                    infile = "%s_rawpileup_%s.bdg"%(pairsfile,T)
+                    outfile = "%s_normalizedpileup_%s.bdg"%(pairsfile,T)
                     if not params.dryrun: 
                         normalize_pileup(infile, outfile, totalreadsT)
-                    
-            # and do the same for interchrom
-            if params.save_inter:
-                sys.stdout.write("\nPiling up interchromosomal pairs into a bedgraph file for combined targets\n")
-                reportfile = "%s_report.dat"%pairsfile
-                total_reads = report2totreads(reportfile,target)
-                for T in combined_targets.keys():
-                    infiles = [ "%s_validinterchom_%s.pairs"%(pairsfile,i) for i in combined_targets[T] ]
-                    locs = [ "%s:%i-%i"%(target[i][0],target[i][1],target[i][2]) for i in combined_targets[T] ]
-                    outfile = "%s_rawpileup_interchom_%s.bdg"%(pairsfile,T)
-                    command = [rs.capCmap_extern["pair2bg"],"-o",outfile,"-n",T,"--interchrom"]
-                    for i in range(len(infiles)):
-                        command.extend(["-i",infiles[i]])
-                        command.extend(["-t",locs[i]])
-                    mainlogfile.write(subprocess.list2cmdline(command)+"\n")
-                    if not params.dryrun:
-                        returncode = subprocess.call(command,stdout=stdoutfile,stderr=stderrfile)
-                        if ( not returncode==0 ):
-                            raise RuntimeError("Error piling up interchromosomal combined pairs file %s .\n"%infile)
-                    if params.normalize:
+                    if params.save_inter:
                         infile = "%s_rawpileup_interchom_%s.bdg"%(pairsfile,T)
                         outfile = "%s_normalizedpileup_interchom_%s.bdg"%(pairsfile,T)
-                        totalreadsT = 0
-                        for i in combined_targets[T]:
-                            totalreadsT = totalreadsT + total_reads[i]
                         if not params.dryrun: 
                             normalize_pileup(infile, outfile, totalreadsT)
-
-            stdoutfile.close()
-            stderrfile.close()
-            sys.stdout.write("... \t Done.\n")
+                sys.stdout.write("... \t Done.\n")
 
     except RuntimeError as e:
         sys.stdout.write("\nError : "+str(e))
@@ -842,17 +842,6 @@ def run_pipeline(args):
 
 
 
-    #####################################################################################
-    # remove SAM (we already made a BAM)
-    try:
-        if not params.dryrun:
-            os.remove(sortedsam)
-    except RuntimeError as e:
-        sys.stdout.write("Error : "+str(e))
-        # does not exit
-
-
-
     sys.stdout.write("\nAll done.\n")
     sys.stdout.write("\n####################################################\n")
 
@@ -0,0 +1,367 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "bamfile.h"
+#include "samfragments.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <string_view>
+#include <utility>
+#include <thread>
+#include <stdexcept>
+
+#include <zlib.h>
+#include <sys/stat.h>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  // BAM is little-endian
+  inline unsigned int le16(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1]<<8);
+  }
+
+  inline unsigned int le32(const char *p) {
+    const unsigned char *u = reinterpret_cast<const unsigned char*>(p);
+    return u[0] | (u[1]<<8) | (u[2]<<16) | (static_cast<unsigned int>(u[3])<<24);
+  }
+
+  // number of BGZF blocks inflated together; each holds at most 64kb
+  const unsigned int blocks_per_batch = 64;
+
+  struct bgzf_block {
+    std::string compressed,
+      inflated;
+    unsigned int isize,
+      crc;
+    bool ok;
+  };
+
+  void inflate_blocks(std::vector<bgzf_block> &blocks, const unsigned int &t,
+		      const unsigned int &nthreads) {
+    // inflate every nthreads'th block, starting at t
+
+    for (std::size_t b=t; b<blocks.size(); b+=nthreads) {
+      bgzf_block &B = blocks[b];
+      z_stream zs;
+
+      B.ok = 0;
+      B.inflated.resize( B.isize );
+      if ( B.isize == 0 ) {
+	B.ok = 1;
+	continue;
+      }
+
+      zs.zalloc = Z_NULL;
+      zs.zfree = Z_NULL;
+      zs.opaque = Z_NULL;
+      zs.next_in = reinterpret_cast<Bytef*>( &B.compressed[0] );
+      zs.avail_in = B.compressed.size();
+      zs.next_out = reinterpret_cast<Bytef*>( &B.inflated[0] );
+      zs.avail_out = B.isize;
+      if ( inflateInit2(&zs,-15) != Z_OK ) {
+	continue;
+      }
+      int ret = inflate(&zs,Z_FINISH);
+      inflateEnd(&zs);
+      if ( ret != Z_STREAM_END || zs.total_out != B.isize ) {
+	continue;
+      }
+      B.ok = crc32( crc32(0L,Z_NULL,0),
+		    reinterpret_cast<const Bytef*>(B.inflated.data()),
+		    B.isize ) == B.crc;
+    }
+
+  }
+
+}
+
+
+bool bam_reader::is_bam(const std::string &filename) {
+  // a BAM file starts with a BGZF header (gzip with a BC extra field).
+  // Pipes are not checked, as reading the header would consume it.
+
+  struct stat sb;
+  if ( stat( filename.c_str(), &sb ) != 0 || !S_ISREG(sb.st_mode) ) {
+    return false;
+  }
+
+  std::ifstream inf( filename.c_str(), std::ios::binary );
+  char head[16];
+
+  if ( ! inf.read(head,16) ) {
+    return false;
+  }
+  return static_cast<unsigned char>(head[0])==31 &&
+    static_cast<unsigned char>(head[1])==139 &&
+    (head[3] & 4) && head[12]=='B' && head[13]=='C';
+
+}
+
+
+bam_reader::bam_reader(const std::string &fname, const unsigned int &nt) :
+  filename(fname), nthreads(nt) {
+  // open the file and read the header
+
+  bufpos = 0;
+  eof = 0;
+  have_lookahead = 0;
+  consumed = 0;
+  inflated = 0;
+  if ( nthreads < 1 ) {
+    nthreads = 1;
+  }
+
+  inf.open( filename.c_str(), std::ios::binary );
+  if ( ! inf.good() ) {
+    throw std::runtime_error("cannot open file "+filename+".");
+  }
+
+  read_header();
+
+}
+
+
+void bam_reader::inflate_batch() {
+  // read the next batch of BGZF blocks and inflate them onto the buffer
+
+  std::vector<bgzf_block> blocks;
+  std::vector<std::thread> threads;
+  char head[18];
+
+  while ( blocks.size() < blocks_per_batch && inf.read(head,18) ) {
+
+    if ( static_cast<unsigned char>(head[0])!=31 ||
+	 static_cast<unsigned char>(head[1])!=139 || !(head[3] & 4) ) {
+      throw std::runtime_error("file "+filename+" is not a valid BAM file.");
+    }
+
+    // find the BC subfield giving the block size
+    unsigned int xlen = le16(head+10),
+      bsize = 0;
+    std::string extra(xlen,'\0');
+    extra.replace(0,6,head+12,6);
+    if ( xlen > 6 && ! inf.read(&extra[6],xlen-6) ) {
+      throw std::runtime_error("file "+filename+" is truncated.");
+    }
+    for (unsigned int x=0; x+4<=xlen; x+=4+le16(&extra[x+2])) {
+      if ( extra[x]=='B' && extra[x+1]=='C' ) {
+	bsize = le16(&extra[x+4]) + 1;
+      }
+    }
+    if ( bsize < xlen+20 ) {
+      throw std::runtime_error("file "+filename+" has a bad BGZF block.");
+    }
+
+    blocks.push_back( bgzf_block() );
+    blocks.back().compressed.resize( bsize-xlen-20 );
+    char tail[8];
+    if ( ! inf.read(&blocks.back().compressed[0],bsize-xlen-20) ||
+	 ! inf.read(tail,8) ) {
+      throw std::runtime_error("file "+filename+" is truncated.");
+    }
+    consumed += bsize;
+    blocks.back().crc = le32(tail);
+    blocks.back().isize = le32(tail+4);
+
+  }
+
+  if ( blocks.size() == 0 ) {
+    eof = 1;
+    return;
+  }
+
+  // inflate in parallel
+  unsigned int nt = nthreads < blocks.size() ? nthreads : blocks.size();
+  for (unsigned int t=1; t<nt; t++) {
+    threads.push_back( std::thread(inflate_blocks, std::ref(blocks), t, nt) );
+  }
+  inflate_blocks(blocks,0,nt);
+  for (std::size_t t=0; t<threads.size(); t++) {
+    threads[t].join();
+  }
+
+  // drop what has already been used, and add the new data
+  buffer.erase(0,bufpos);
+  bufpos = 0;
+  for (std::size_t b=0; b<blocks.size(); b++) {
+    if ( ! blocks[b].ok ) {
+      throw std::runtime_error("error decompressing file "+filename+".");
+    }
+    buffer += blocks[b].inflated;
+    inflated += blocks[b].inflated.size();
+  }
+
+}
+
+
+unsigned long int bam_reader::position() const {
+  // about how far into the file the records decoded so far reach;
+  // consumed is ahead of this by the part of the batch still to be used
+
+  if ( inflated == 0 ) {
+    return consumed;
+  }
+  return (unsigned long int)( double(consumed) *
+			      double(inflated-(buffer.size()-bufpos)) /
+			      double(inflated) );
+
+}
+
+
+bool bam_reader::fill(const std::size_t &need) {
+  // make sure at least need bytes are available in the buffer
+
+  while ( buffer.size()-bufpos < need && !eof ) {
+    inflate_batch();
+  }
+  return buffer.size()-bufpos >= need;
+
+}
+
+
+void bam_reader::read_header() {
+  // check magic, skip the SAM text header, and get the reference names
+
+  unsigned int l_text,
+    n_ref,
+    l_name;
+
+  if ( ! fill(8) || buffer.compare(bufpos,4,"BAM\1") != 0 ) {
+    throw std::runtime_error("file "+filename+" is not a valid BAM file.");
+  }
+  l_text = le32(&buffer[bufpos+4]);
+  bufpos += 8;
+
+  if ( ! fill(l_text+4) ) {
+    throw std::runtime_error("file "+filename+" is truncated.");
+  }
+  bufpos += l_text;
+  n_ref = le32(&buffer[bufpos]);
+  bufpos += 4;
+
+  for (unsigned int r=0; r<n_ref; r++) {
+    if ( ! fill(4) ) {
+      throw std::runtime_error("file "+filename+" is truncated.");
+    }
+    l_name = le32(&buffer[bufpos]);
+    if ( ! fill(l_name+8) ) {
+      throw std::runtime_error("file "+filename+" is truncated.");
+    }
+    // name is NUL terminated
+    refs.add( buffer.substr(bufpos+4,l_name-1) );
+    bufpos += 8+l_name;
+  }
+
+}
+
+
+bool bam_reader::next_record(samfrag &frag) {
+  // decode the next alignment record; return false at the end of file
+
+  static const char seqcodes[] = "=ACMGRSVTWYHKDBN";
+  unsigned int block_size,
+    l_read_name,
+    n_cigar,
+    l_seq;
+  int refID;
+  const char *rec;
+
+  if ( ! fill(4) ) {
+    if ( buffer.size() != bufpos ) {
+      throw std::runtime_error("file "+filename+" is truncated.");
+    }
+    return false;
+  }
+  block_size = le32(&buffer[bufpos]);
+  if ( block_size < 32 || ! fill(4+block_size) ) {
+    throw std::runtime_error("file "+filename+" is truncated.");
+  }
+  rec = &buffer[bufpos+4];
+
+  refID = static_cast<int>( le32(rec) );
+  l_read_name = static_cast<unsigned char>(rec[8]);
+  n_cigar = le16(rec+12);
+  l_seq = le32(rec+16);
+
+  std::string_view name( rec+32, l_read_name-1 );
+  frag.setname.assign( name.substr(0,name.find("DIGEST")) );
+  frag.start = static_cast<int>( le32(rec+4) );   // already 0-based
+  frag.length = l_seq;
+  frag.sequence.clear();
+
+  if ( refID < 0 ) {
+    frag.refid = -1;
+    // if it didn't align, store the sequence for checking duplicates
+    const char *seq = rec + 32 + l_read_name + 4*n_cigar;
+    frag.sequence.resize(l_seq);
+    for (unsigned int i=0; i<l_seq; i++) {
+      unsigned char b = seq[i/2];
+      frag.sequence[i] = seqcodes[ i%2==0 ? b>>4 : b&15 ];
+    }
+  } else {
+    if ( refID >= static_cast<int>(refs.names.size()) ) {
+      throw std::runtime_error("file "+filename+" has an alignment to an "
+			       "unknown reference.");
+    }
+    frag.refid = refID;
+  }
+
+  bufpos += 4+block_size;
+  return true;
+
+}
+
+
+bool bam_reader::get_read_set(std::vector<samfrag> &current_sams) {
+  // read the next group of records which share a set name. Fragments are
+  // swapped in and out of the look-ahead, so their strings are reused.
+
+  std::size_t n = 0;
+
+  if ( ! have_lookahead ) {
+    have_lookahead = next_record(lookahead);
+  }
+  if ( ! have_lookahead ) {
+    current_sams.clear();
+    return false;
+  }
+
+  do {
+    if ( n == current_sams.size() ) {
+      current_sams.push_back( samfrag() );
+    }
+    std::swap( current_sams[n], lookahead );
+    n++;
+    have_lookahead = next_record(lookahead);
+  } while ( have_lookahead &&
+	    lookahead.setname == current_sams[n-1].setname );
+
+  current_sams.resize(n);
+  return true;
+
+}
@@ -0,0 +1,72 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef BAMFILE_H
+#define BAMFILE_H
+
+#include "samfragments.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+
+namespace CAPCMAIN_NS {
+
+  struct bam_reader {
+    // Reads alignments from a BAM file into samfrags. The file is a series
+    // of BGZF blocks (each a small gzip member); these are read in batches
+    // and inflated in parallel, then the binary records are decoded from
+    // the uncompressed stream.
+
+    std::ifstream inf;
+    std::string filename;
+    unsigned int nthreads;
+
+    sam_references refs;                 // chromosome names from header
+
+    unsigned long int consumed,          // bytes of the file read so far
+      inflated;                          // and once they were inflated
+
+    std::string buffer;                  // uncompressed data
+    std::size_t bufpos;
+    bool eof;
+
+    samfrag lookahead;                   // first record of the next set
+    bool have_lookahead;
+
+    bam_reader(const std::string &, const unsigned int &);
+
+    static bool is_bam(const std::string &);
+
+    unsigned long int position() const;
+    bool get_read_set(std::vector<samfrag> &);
+    bool next_record(samfrag &);
+
+    bool fill(const std::size_t &);
+    void inflate_batch();
+    void read_header();
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,200 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Batch mode for capCmain : several samples, listed in a manifest, are
+// processed against one set of restriction fragments and targets, which
+// are only loaded once.
+//
+// Each sample is processed in a child process forked from the one which
+// loaded the genome. The genome is not changed once it is loaded, so the
+// children share its memory, while the counters, duplicate table and SAM
+// references (which are kept in the genome) are each sample's own. A
+// sample which fails does not stop the others.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "batch.h"
+#include "main_process.h"
+#include "genome.h"
+#include "messages.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace CAPCMAIN_NS;
+
+
+std::vector<sample> CAPCMAIN_NS::read_manifest(const std::string &filename) {
+  // Read a manifest : each line gives a SAM (or BAM) file and the name for
+  // its outputs, separated by white space. Blank lines and lines starting
+  // with # are skipped.
+
+  std::ifstream inf;
+  std::string line,
+    extra;
+  std::vector<sample> samples;
+  std::map<std::string,int> names;
+  sample S;
+  int lineno = 0;
+
+  inf.open( filename.c_str() );
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open manifest "+filename+".");
+  }
+
+  while ( getline(inf,line) ) {
+    lineno++;
+    std::istringstream sline(line);
+    if ( !(sline>>S.samfile) || S.samfile[0] == '#' ) {
+      continue;
+    }
+    if ( !(sline>>S.outfile) || sline>>extra ) {
+      std::stringstream msg;
+      msg<<"line "<<lineno<<" of manifest "<<filename<<" should give a "
+	 <<"sam_file and a name";
+      throw std::runtime_error(msg.str());
+    }
+    if ( S.samfile == "-" ) {
+      throw std::runtime_error("stdin cannot be used as input in a "
+			       "manifest");
+    }
+    if ( names[S.outfile]++ > 0 ) {
+      throw std::runtime_error("name "+S.outfile+" is given more than once "
+			       "in manifest "+filename);
+    }
+    samples.push_back(S);
+  }
+
+  if ( samples.size() == 0 ) {
+    throw std::runtime_error("manifest "+filename+" does not list any "
+			     "samples");
+  }
+
+  return samples;
+
+}
+
+
+int CAPCMAIN_NS::run_batch(genome &gnm, const filenames &fname,
+			   const parameters &params) {
+  // Process the samples in the manifest, params.jobs at a time. Gives
+  // EXIT_FAILURE if any sample failed.
+
+  std::vector<sample> samples;
+  std::map<pid_t,std::size_t> running;     // child process to sample
+  std::vector<std::string> failed;
+  std::size_t next = 0;
+  pid_t pid;
+  int status;
+
+  try {
+    samples = read_manifest(fname.manifest);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR in main processing stage : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Processing "<<samples.size()<<" samples from manifest "
+	   <<fname.manifest<<", "<<params.jobs<<" at a time";
+  COMMON_NS::message( mymessage.str() );
+
+  while ( next < samples.size() || running.size() > 0 ) {
+
+    // start samples until enough are running
+    while ( next < samples.size() && running.size() < params.jobs ) {
+      COMMON_NS::message( "...Starting sample "+samples[next].samfile+
+			  " -> "+samples[next].outfile );
+      std::cout.flush();
+      std::cerr.flush();
+
+      pid = fork();
+      if ( pid < 0 ) {
+	std::cerr<<"ERROR in main processing stage : cannot start a process "
+		 <<"for sample "<<samples[next].outfile<<std::endl;
+	failed.push_back( samples[next].outfile );
+      } else if ( pid == 0 ) {
+	status = process_sample(gnm,samples[next].samfile,
+				samples[next].outfile,params);
+	std::cout.flush();
+	std::cerr.flush();
+	_exit(status);
+      } else {
+	running[pid] = next;
+      }
+      next++;
+    }
+
+    if ( running.size() == 0 ) {
+      continue;
+    }
+
+    // wait for one to finish
+    pid = waitpid(-1,&status,0);
+    if ( pid < 0 ) {
+      std::cerr<<"ERROR in main processing stage : lost track of sample "
+	       <<"processes"<<std::endl;
+      return EXIT_FAILURE;
+    }
+    std::map<pid_t,std::size_t>::iterator it = running.find(pid);
+    if ( it == running.end() ) {
+      continue;
+    }
+    const sample &S = samples[it->second];
+    if ( WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ) {
+      COMMON_NS::message( "...Finished sample "+S.outfile );
+    } else {
+      failed.push_back( S.outfile );
+    }
+    running.erase(it);
+
+  }
+
+  if ( failed.size() > 0 ) {
+    std::cerr<<"ERROR in main processing stage : "<<failed.size()<<" of "
+	     <<samples.size()<<" samples failed :";
+    for (std::size_t i=0; i<failed.size(); i++) {
+      std::cerr<<" "<<failed[i];
+    }
+    std::cerr<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  mymessage.str("");
+  mymessage<<"...Processed all "<<samples.size()<<" samples";
+  COMMON_NS::message( mymessage.str() );
+  return EXIT_SUCCESS;
+
+}
@@ -23,7 +23,9 @@
 #include "samfragments.h"
 
 #include <string>
+#include <string_view>
 #include <sstream>
+#include <limits>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
@@ -39,12 +41,55 @@ std::string CAPCMAIN_NS::name2setname(const std::string& name) {
   return name.substr(0,found);
 }
 
+bed_coord CAPCMAIN_NS::string2coord(const std::string& s) {
+  // Convert a coordinate, which must fit in a bed_coord
+  if ( s.size() > 10 ||
+       atol( s.c_str() ) > std::numeric_limits<bed_coord>::max() ) {
+    throw std::runtime_error("coordinate "+s+" is too large");
+  }
+  return atol( s.c_str() );
+}
+
+std::ostream& CAPCMAIN_NS::operator<< (std::ostream& os,
+				       const pooled_string& s) {
+  return os<<s.str();
+}
+
+std::istream& CAPCMAIN_NS::operator>> (std::istream& is, pooled_string& s) {
+  std::string word;
+  if ( is>>word ) {
+    s = pooled_string(word);
+  }
+  return is;
+}
+
 
 
 // Member functions
 
+string_pool::string_pool() {
+  // ID 0 is the empty string
+  strings.push_back("");
+  ids[ strings.back() ] = 0;
+}
+
+std::uint32_t string_pool::intern(const std::string_view &s) {
+  // Get the ID of a string, adding it if it is new
+  std::unordered_map<std::string_view,std::uint32_t>::const_iterator it
+    = ids.find(s);
+  if ( it != ids.end() ) {
+    return it->second;
+  }
+  strings.push_back( std::string(s) );
+  return ids[ strings.back() ] = strings.size()-1;
+}
+
+string_pool& string_pool::shared() {
+  static string_pool pool;
+  return pool;
+}
+
 void bed_feature::setstrand(const std::string &s) {
-  strand = s;
   if (s=="+") { istrand = 1; }
   else if (s=="-") { istrand = -1; }
   else { istrand = 0; }
@@ -65,7 +110,7 @@ bed_feature bed_feature::line2bed_feature(const std::string &line) {
     throw std::runtime_error("unreadable entry in bed file");
   }
 
-  bed_feature newfeature( c, atoi( ss.c_str() ), atoi( se.c_str() ) );
+  bed_feature newfeature( c, string2coord(ss), string2coord(se) );
     
   if ( sline.peek() == EOF ) { return newfeature; }
     
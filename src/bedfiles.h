@@ -23,6 +23,11 @@
 #define BEDFILES_H
 
 #include<string>
+#include<string_view>
+#include<deque>
+#include<unordered_map>
+#include<cstdint>
+#include<iosfwd>
 
 namespace CAPCMAIN_NS {
 
@@ -31,28 +36,77 @@ namespace CAPCMAIN_NS {
   struct genome;
   struct samfrag;
   struct rest_fragment;
+
+  // Types
+
+  typedef std::int32_t bed_coord;    // enough for any chromosome < 2^31 bp
   
   // Function declarations
 
   std::string name2setname(const std::string&);
+  bed_coord string2coord(const std::string&);
 
   // Structures
+
+  struct string_pool {
+    // Chromosome and feature names, each stored once. A name's position in
+    // the list is its ID, and 0 is the empty string. Names are only added
+    // while files are loaded, before any threads start, so there is no lock.
+
+    std::deque<std::string> strings;     // deque, so ids can point into it
+    std::unordered_map<std::string_view,std::uint32_t> ids;
+
+    string_pool();
+    std::uint32_t intern(const std::string_view &);
+
+    static string_pool& shared();        // the pool used by all features
+
+  };
+
+
+  struct pooled_string {
+    // A name held as its ID in the shared pool, so that features do not
+    // each keep a copy. Equal names have equal IDs; ordering is that of the
+    // strings.
+
+    std::uint32_t id;
+
+    pooled_string() : id(0) {};
+    pooled_string(const std::string &s) :
+      id(string_pool::shared().intern(s)) {};
+    pooled_string(const char *s) : id(string_pool::shared().intern(s)) {};
+
+    const std::string& str() const {
+      return string_pool::shared().strings[id];
+    }
+    operator const std::string&() const { return str(); }
+    bool empty() const { return id == 0; }
+
+    bool operator== (const pooled_string &o) const { return id == o.id; }
+    bool operator!= (const pooled_string &o) const { return id != o.id; }
+    bool operator< (const pooled_string &o) const {
+      return id != o.id && str() < o.str();
+    }
+
+  };
+
+  std::ostream& operator<< (std::ostream&, const pooled_string&);
+  std::istream& operator>> (std::istream&, pooled_string&);
+
   
   struct bed_feature {
 
-    std::string chrom,
-      name,
-      strand;
-    long int start,
+    pooled_string chrom,
+      name;
+    bed_coord start,
       end;
-    int istrand;
-    double score;
-    
-    std::string restofline; // sometimes we want everything after chr:ss-ee
+    float score;
+    signed char istrand;    // 1 for +, -1 for -, 0 if not given
 
-    bed_feature() {};
-    bed_feature(const std::string &chrom, const long int &start,
-		const long int &end) : chrom(chrom), start(start), end(end) {};
+    bed_feature() : start(0), end(0), score(0), istrand(0) {};
+    bed_feature(const pooled_string &chrom, const bed_coord &start,
+		const bed_coord &end) : chrom(chrom), start(start), end(end),
+					score(0), istrand(0) {};
 
     static bed_feature line2bed_feature(const std::string &);
     void setstrand(const std::string&);
@@ -63,21 +117,33 @@ namespace CAPCMAIN_NS {
 
   struct rest_fragment : bed_feature {
 
-    mutable bool is_target;
-    mutable std::string targetname;
+    mutable bool is_target,
+      is_excluded;        // within the exclusion zone of a target
+    mutable int target_id;
+    mutable unsigned int fragment_id;  // number in genome order
     
     rest_fragment() {
       // default constructor
       is_target = 0;
+      is_excluded = 0;
+      target_id = -1;
+      fragment_id = 0;
     }
 
     rest_fragment(const bed_feature&B) : bed_feature(B.chrom,B.start,B.end) { 
       // construct from base struct
       is_target = 0;
+      is_excluded = 0;
+      target_id = -1;
+      fragment_id = 0;
     }
 
-    rest_fragment(const std::string &chrom, const long int &start,
-		  const long int &end) : bed_feature(chrom,start,end) {
+    rest_fragment(const pooled_string &chrom, const bed_coord &start,
+		  const bed_coord &end) : bed_feature(chrom,start,end) {
+      is_target = 0;
+      is_excluded = 0;
+      target_id = -1;
+      fragment_id = 0;
     }
 
     bool operator< (const rest_fragment &) const;
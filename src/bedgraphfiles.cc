@@ -49,6 +49,7 @@ bedgraph_entry bedgraph_entry::line2bedgraph_entry(const std::string &line) {
     throw std::runtime_error("unreadable entry in bedgraph file");
   }
 
-  return bedgraph_entry( c, atoi( ss.c_str() ), atoi( se.c_str() ), atof( sc.c_str() ) );
+  return bedgraph_entry( c, CAPCMAIN_NS::string2coord(ss),
+			 CAPCMAIN_NS::string2coord(se), atof( sc.c_str() ) );
 
 }
@@ -22,23 +22,27 @@
 #ifndef BEDGRAPHFILES_H
 #define BEDGRAPHFILES_H
 
+#include "bedfiles.h"
+
 #include<string>
 
 namespace POSTPROCESS_NS {
 
   struct bedgraph_entry {
 
-    std::string chrom;
-    long int start,
+    CAPCMAIN_NS::pooled_string chrom;
+    CAPCMAIN_NS::bed_coord start,
       end;
     double score;
 
     bedgraph_entry() {};
-    bedgraph_entry(const std::string &chrom, const long int &start,
-		   const long int &end, const long int &score
+    bedgraph_entry(const CAPCMAIN_NS::pooled_string &chrom,
+		   const CAPCMAIN_NS::bed_coord &start,
+		   const CAPCMAIN_NS::bed_coord &end, const long int &score
 		   ) : chrom(chrom), start(start), end(end), score(score) {};
-    bedgraph_entry(const std::string &chrom, const long int &start,
-		   const long int &end		   
+    bedgraph_entry(const CAPCMAIN_NS::pooled_string &chrom,
+		   const CAPCMAIN_NS::bed_coord &start,
+		   const CAPCMAIN_NS::bed_coord &end		   
 		   ) : chrom(chrom), start(start), end(end), score(0.0) {};
 
     bool operator< (const bedgraph_entry &) const;
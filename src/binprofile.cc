@@ -177,7 +177,7 @@ void binprofile::add(const bedgraph_entry &A,
   C = profile.find(chrom);
   
   for (int start=lowbin;start<=highbin;start++) {
-    C->second[ bedgraph_entry(chrom,start*step,start*step+step) ]+=A.score;
+    C->second[ bedgraph_entry(A.chrom,start*step,start*step+step) ]+=A.score;
   }
   
 }
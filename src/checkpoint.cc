@@ -0,0 +1,300 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "checkpoint.h"
+#include "genome.h"
+#include "main_process.h"
+#include "pileup.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  const char file_magic[8] = {'C','A','P','C','C','K','P','4'};
+
+  // numbers are written as 8 byte little-endian, strings with their length
+
+  void put_u64(std::ofstream &ouf, const std::uint64_t &x) {
+    char b[8];
+    for (int i=0; i<8; i++) {
+      b[i] = char( (x>>(8*i)) & 0xff );
+    }
+    ouf.write(b,8);
+  }
+
+  void put_string(std::ofstream &ouf, const std::string &s) {
+    put_u64(ouf,s.size());
+    ouf.write(s.data(),s.size());
+  }
+
+  void put_vector(std::ofstream &ouf,
+		  const std::vector<unsigned long int> &v) {
+    put_u64(ouf,v.size());
+    for (std::size_t i=0; i<v.size(); i++) {
+      put_u64(ouf,v[i]);
+    }
+  }
+
+  std::uint64_t get_u64(std::ifstream &inf) {
+    unsigned char b[8];
+    std::uint64_t x = 0;
+    if ( !inf.read((char*)b,8) ) {
+      throw std::runtime_error("checkpoint file is truncated");
+    }
+    for (int i=0; i<8; i++) {
+      x |= std::uint64_t(b[i]) << (8*i);
+    }
+    return x;
+  }
+
+  std::string get_string(std::ifstream &inf) {
+    std::string s( get_u64(inf), '\0' );
+    if ( !inf.read(&s[0],s.size()) ) {
+      throw std::runtime_error("checkpoint file is truncated");
+    }
+    return s;
+  }
+
+  void get_vector(std::ifstream &inf, std::vector<unsigned long int> &v) {
+    v.resize( get_u64(inf) );
+    for (std::size_t i=0; i<v.size(); i++) {
+      v[i] = get_u64(inf);
+    }
+  }
+
+  void put_counts(std::ofstream &ouf,
+		  const std::vector<pileup_counts::fragment_counts> &counts) {
+    for (std::size_t t=0; t<counts.size(); t++) {
+      put_u64(ouf,counts[t].size());
+      for (pileup_counts::fragment_counts::const_iterator it=counts[t].begin();
+	   it!=counts[t].end(); ++it) {
+	put_u64(ouf,it->first);
+	put_u64(ouf,it->second);
+      }
+    }
+  }
+
+  void get_counts(std::ifstream &inf,
+		  std::vector<pileup_counts::fragment_counts> &counts) {
+    for (std::size_t t=0; t<counts.size(); t++) {
+      std::uint64_t n = get_u64(inf);
+      counts[t].clear();
+      counts[t].reserve(n);
+      for (std::uint64_t i=0; i<n; i++) {
+	std::uint64_t id = get_u64(inf);
+	counts[t][id] = get_u64(inf);
+      }
+    }
+  }
+
+}
+
+
+std::string checkpoint::file_name(const std::string& fname_out) {
+  return fname_out + "_checkpoint.dat";
+}
+
+
+std::string checkpoint::run_settings(const genome& gnm,
+				     const std::string& samfile,
+				     const parameters& params) {
+  // everything which a resumed run must share with the original one
+  return samfile + " " + analysis_settings(gnm,params);
+}
+
+
+std::string checkpoint::analysis_settings(const genome& gnm,
+					  const parameters& params) {
+  // everything which a run adding a lane must share with the earlier ones
+
+  std::stringstream s;
+
+  s<<gnm.Nfragments<<" "<<gnm.targets.size()
+   <<" -e "<<params.exclusion<<" -i "<<params.save_inter
+   <<" --max-dedup-mem "<<( params.max_dedup_mem > 0 )
+   <<" --pileup "<<params.pileup<<" --combine "<<params.combine
+   <<" --no-pairs "<<!params.pairs_files
+   <<" --shard "<<params.shard<<"/"<<params.nshards
+   <<" --distance-bins "<<params.distance_bins
+   <<" --capture-matrix "<<gnm.capture_matrix;
+  return s.str();
+
+}
+
+
+void checkpoint::save(const std::string& fname, const genome& gnm,
+		      const pileup_counts& pileup) const {
+  // write the checkpoint to a temporary file, then move it into place
+
+  const genome::counters &count = gnm.count;
+  std::string tmpname = fname + ".tmp";
+  std::ofstream ouf( tmpname.c_str(), std::ios::binary | std::ios::trunc );
+
+  if ( !ouf.good() ) {
+    throw std::runtime_error("cannot open checkpoint file "+tmpname);
+  }
+
+  ouf.write(file_magic,8);
+  put_string(ouf,settings);
+  put_u64(ouf,sets_done);
+  put_u64(ouf,input_offset);
+  put_vector(ouf,pairs_sizes);
+  put_u64(ouf,references.size());
+  for (std::size_t r=0; r<references.size(); r++) {
+    put_string(ouf,references[r]);
+  }
+
+  // counters
+  put_u64(ouf,count.total_read_frags);
+  put_u64(ouf,count.total_read_sets);
+  put_u64(ouf,count.duplicates_removed);
+  put_u64(ouf,count.none_mapped);
+  put_u64(ouf,count.no_targets);
+  put_u64(ouf,count.multiple_targets);
+  put_u64(ouf,count.no_reporters);
+  put_u64(ouf,count.exclusion);
+  put_u64(ouf,count.multiple_reporters);
+  put_u64(ouf,count.total_interchrom);
+  put_u64(ouf,count.total_validPairs);
+  put_vector(ouf,count.validPairs);
+  put_vector(ouf,count.onlyInter);
+  put_vector(ouf,count.within1Mb);
+  put_vector(ouf,count.within5Mb);
+  put_vector(ouf,count.distances);
+  put_u64(ouf,count.capture_pairs.size());
+  for (std::map<std::pair<int,int>,long unsigned int>::const_iterator
+	 it=count.capture_pairs.begin(); it!=count.capture_pairs.end(); ++it) {
+    put_u64(ouf,it->first.first);
+    put_u64(ouf,it->first.second);
+    put_u64(ouf,it->second);
+  }
+
+  // duplicate keys (empty with --max-dedup-mem, where the first pass is
+  // repeated instead)
+  put_u64(ouf,gnm.list_for_duplicates.size());
+  for ( std::map<std::string,int>::const_iterator
+	  it=gnm.list_for_duplicates.begin();
+	it!=gnm.list_for_duplicates.end(); ++it ) {
+    put_string(ouf,it->first);
+    put_u64(ouf,it->second);
+  }
+
+  // pile-up
+  put_counts(ouf,pileup.intra);
+  put_counts(ouf,pileup.inter);
+
+  ouf.write(file_magic,8);
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing checkpoint file "+tmpname);
+  }
+
+  if ( std::rename(tmpname.c_str(),fname.c_str()) != 0 ) {
+    throw std::runtime_error("cannot rename "+tmpname+" to "+fname);
+  }
+
+}
+
+
+void checkpoint::load(const std::string& fname, genome& gnm,
+		      pileup_counts& pileup) {
+  // Read a checkpoint back. The settings it was saved with must match
+  // those already in settings. The counters, duplicate keys and pile-up
+  // are set from the file; they must already be set up.
+
+  genome::counters &count = gnm.count;
+  std::ifstream inf( fname.c_str(), std::ios::binary );
+  char magic[8];
+  std::string saved;
+
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open checkpoint file "+fname+"; "
+			     "nothing to carry on from.");
+  }
+  if ( !inf.read(magic,8) ||
+       std::string(magic,8) != std::string(file_magic,8) ) {
+    throw std::runtime_error(fname+" is not a checkpoint file");
+  }
+
+  saved = get_string(inf);
+  if ( saved != settings ) {
+    throw std::runtime_error("checkpoint file "+fname+" is from a run with "
+			     "different input or options ("+saved+"); "
+			     "cannot carry on from it.");
+  }
+  sets_done = get_u64(inf);
+  input_offset = get_u64(inf);
+  get_vector(inf,pairs_sizes);
+  references.resize( get_u64(inf) );
+  for (std::size_t r=0; r<references.size(); r++) {
+    references[r] = get_string(inf);
+  }
+
+  count.total_read_frags = get_u64(inf);
+  count.total_read_sets = get_u64(inf);
+  count.duplicates_removed = get_u64(inf);
+  count.none_mapped = get_u64(inf);
+  count.no_targets = get_u64(inf);
+  count.multiple_targets = get_u64(inf);
+  count.no_reporters = get_u64(inf);
+  count.exclusion = get_u64(inf);
+  count.multiple_reporters = get_u64(inf);
+  count.total_interchrom = get_u64(inf);
+  count.total_validPairs = get_u64(inf);
+  get_vector(inf,count.validPairs);
+  get_vector(inf,count.onlyInter);
+  get_vector(inf,count.within1Mb);
+  get_vector(inf,count.within5Mb);
+  get_vector(inf,count.distances);
+  count.capture_pairs.clear();
+  for (std::uint64_t n=get_u64(inf); n>0; n--) {
+    int t1 = get_u64(inf),
+      t2 = get_u64(inf);
+    count.capture_pairs[ std::make_pair(t1,t2) ] = get_u64(inf);
+  }
+
+  gnm.list_for_duplicates.clear();
+  for (std::uint64_t n=get_u64(inf); n>0; n--) {
+    std::string key = get_string(inf);
+    gnm.list_for_duplicates.insert( gnm.list_for_duplicates.end(),
+				    std::make_pair(key,int(get_u64(inf))) );
+  }
+
+  get_counts(inf,pileup.intra);
+  get_counts(inf,pileup.inter);
+
+  if ( !inf.read(magic,8) ||
+       std::string(magic,8) != std::string(file_magic,8) ) {
+    throw std::runtime_error("checkpoint file "+fname+" is damaged");
+  }
+
+}
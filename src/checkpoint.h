@@ -0,0 +1,70 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include <string>
+#include <vector>
+
+namespace CAPCMAIN_NS {
+
+  // Forward Declarations
+  struct genome;
+  struct parameters;
+  struct pileup_counts;
+
+  struct checkpoint {
+    // The state of a capCmain run at a read set boundary, saved every so
+    // many read sets (--checkpoint-every) so that a run which is stopped
+    // can be carried on with --resume, giving the same output as a run
+    // which was not stopped. As well as the fields below, the file holds
+    // the counters, the table of duplicate keys and the pile-up counts.
+    //
+    // The file is written under a temporary name and then renamed, so
+    // there is always one complete checkpoint.
+    //
+    // The same file, saved at the end of a run (--save-state), is the
+    // state which a later lane of the sample is added to (--add-to).
+
+    std::string settings;                     // input and options used
+    unsigned long int sets_done,              // read sets parsed
+      input_offset;                           // SAM file byte offset of the
+                                              // next set
+    std::vector<unsigned long int> pairs_sizes;   // see pairs_output::sync
+    std::vector<std::string> references;      // SAM header reference names,
+                                              // which the duplicate keys use
+
+    checkpoint() : sets_done(0), input_offset(0) {}
+
+    static std::string file_name(const std::string&);
+    static std::string run_settings(const genome&, const std::string&,
+				    const parameters&);
+    static std::string analysis_settings(const genome&, const parameters&);
+
+    void save(const std::string&, const genome&, const pileup_counts&) const;
+    void load(const std::string&, genome&, pileup_counts&);
+  };
+
+}
+
+#endif
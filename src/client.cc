@@ -0,0 +1,132 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program which sends a capCmain or capClocation2fragment job to
+// capCdaemon, and exits with the job's exit status. The job's options are
+// those of the tool itself; its output comes to this program's stdout and
+// stderr, and files are written relative to this program's directory.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "daemon.h"
+#include "messages.h"
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <stdexcept>
+#include <cstdlib>
+#include <climits>
+
+#include <unistd.h>
+
+using namespace DAEMON_NS;
+
+
+int main(int argc, char *argv[]) {
+
+  client_parameters params;
+  job J;
+  int fd,
+    status;
+  char cwd[PATH_MAX];
+
+  // parse command line
+  try {
+    parse_client_command_line(argc,argv,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR in client : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // send the job, and wait for it
+  try {
+    if ( getcwd(cwd,sizeof(cwd)) == NULL ) {
+      throw std::runtime_error("cannot get the working directory");
+    }
+    J.cwd = cwd;
+    J.args = params.args;
+    for (int i=0; i<3; i++) {
+      J.fds[i] = i;
+    }
+    fd = connect_socket(params.socketfile);
+    send_job(fd,J);
+    status = receive_status(fd);
+    close(fd);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR in client : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR in client : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  if ( status < 0 ) {
+    std::cerr<<"ERROR in client : the job ended without an exit status "
+	     <<"(was the daemon stopped?)"<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Done!
+  return status;
+
+}
+
+
+void DAEMON_NS::parse_client_command_line(const int &argc, char **argv,
+					  client_parameters &params) {
+  // parse the command line; everything after the tool is its own
+
+  const std::string usage_message ="\nUsage :\n"
+    "   capCclient -S socket capCmain [options]\n"
+    "   capCclient -S socket capClocation2fragment [options]\n"
+    "\n"
+    "   Required arguments :\n"
+    "       -S  socket        is the socket capCdaemon is listening on\n"
+    "\n"
+    "   The options are those of capCmain or capClocation2fragment. The\n"
+    "   fragments file (-r) can be left out; if given, it must be the one\n"
+    "   the daemon has loaded.\n"
+    "\n";
+
+  int argi=1;
+
+  if ( argc > 1 && std::string(argv[1]) == "--version" ) {
+    COMMON_NS::print_version();
+    std::exit(EXIT_SUCCESS);
+  }
+
+  if ( argc < 4 || std::string(argv[1]) != "-S" ) {
+    throw std::runtime_error(usage_message);
+  }
+  params.socketfile = std::string(argv[2]);
+
+  for (argi=3; argi<argc; argi++) {
+    params.args.push_back( std::string(argv[argi]) );
+  }
+
+}
@@ -0,0 +1,395 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "cpairs.h"
+
+#include <map>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cctype>
+#include <charconv>
+#include <zlib.h>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  const char file_magic[8] = {'C','A','P','C','B','P','R','1'};
+
+  void put_u32(std::string &buf, const std::uint32_t &x) {
+    for (int i=0; i<4; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  void put_u64(std::string &buf, const std::uint64_t &x) {
+    for (int i=0; i<8; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  std::uint64_t get_uint(const char *p, const int &nbytes) {
+    std::uint64_t x = 0;
+    for (int i=0; i<nbytes; i++) {
+      x |= std::uint64_t( (unsigned char)p[i] ) << (8*i);
+    }
+    return x;
+  }
+
+  void read_bytes(std::ifstream &inf, char *p, const std::size_t &n,
+		  const std::string &fname) {
+    inf.read(p,n);
+    if ( inf.gcount() != std::streamsize(n) ) {
+      throw std::runtime_error("cpairs file "+fname+" is truncated");
+    }
+  }
+
+  bool parse_number(const char *p, const char *e, long int &x) {
+    // a whole field of digits
+    if ( p == e || *p == '-' ) {
+      return false;
+    }
+    std::from_chars_result r = std::from_chars(p,e,x);
+    return r.ec == std::errc() && r.ptr == e;
+  }
+
+  const char* next_field(const char *p, const char *e, const char* &fe) {
+    // find the next whitespace separated field; fe is set to its end
+    while ( p < e && std::isspace((unsigned char)*p) ) {
+      p++;
+    }
+    fe = p;
+    while ( fe < e && !std::isspace((unsigned char)*fe) ) {
+      fe++;
+    }
+    return p;
+  }
+
+}
+
+
+void fragment_table::load(const std::string &filename) {
+  // Load a bed file of restriction fragments, numbering them in the same
+  // way as the genome does. As in the genome, of fragments with the same
+  // start only the first is kept.
+
+  std::ifstream inf;
+  std::string line;
+  std::map<std::string, std::vector< std::pair<long int,long int> > > frags;
+  const char *p, *e, *fe;
+  long int start,
+    end;
+
+  inf.open( filename.c_str() );
+  if ( ! inf.good() ) {
+    throw std::runtime_error("cannot open file "+filename);
+  }
+
+  while ( getline(inf,line) ) {
+    e = line.data() + line.size();
+    p = next_field(line.data(),e,fe);
+    std::string chrom(p,fe);
+    p = next_field(fe,e,fe);
+    if ( !parse_number(p,fe,start) ) {
+      throw std::runtime_error("unreadable entry in bed file");
+    }
+    p = next_field(fe,e,fe);
+    if ( !parse_number(p,fe,end) ) {
+      throw std::runtime_error("unreadable entry in bed file");
+    }
+    frags[chrom].push_back( std::make_pair(start,end) );
+  }
+  inf.close();
+
+  chroms.clear();
+  first_id.clear();
+  chrom_of.clear();
+  starts.clear();
+  ends.clear();
+  checksum = checksum_start;
+
+  for (std::map<std::string, std::vector< std::pair<long int,long int> >
+	 >::iterator C=frags.begin(); C!=frags.end(); ++C) {
+    std::vector< std::pair<long int,long int> > &f = C->second;
+    std::stable_sort(f.begin(), f.end(),
+		     [](const std::pair<long int,long int> &a,
+			const std::pair<long int,long int> &b) {
+		       return a.first < b.first; });
+
+    first_id.push_back( starts.size() );
+    for (std::size_t i=0; i<f.size(); i++) {
+      if ( i > 0 && f[i].first == f[i-1].first ) {
+	continue;
+      }
+      chrom_of.push_back( chroms.size() );
+      starts.push_back( f[i].first );
+      ends.push_back( f[i].second );
+      checksum_fragment(checksum, C->first, f[i].first, f[i].second);
+    }
+    chroms.push_back( C->first );
+  }
+  first_id.push_back( starts.size() );
+
+}
+
+
+void fragment_table::check(const cpairs_header &header,
+			   const std::string &fname) const {
+  // the fragments must be the ones the file was written with
+
+  bool same = header.checksum == checksum &&
+    header.chroms == chroms;
+
+  for (std::size_t c=0; same && c<chroms.size(); c++) {
+    same = header.nfragments[c] == first_id[c+1] - first_id[c];
+  }
+  if ( !same ) {
+    throw std::runtime_error("cpairs file "+fname+" was written with a "
+			     "different restriction fragments file");
+  }
+
+}
+
+
+cpairs_writer::cpairs_writer(const std::string &fname,
+			     const cpairs_header &header,
+			     const bool &comp) :
+  filename(fname), compress(comp), nrecords(0), previous(0) {
+  // open the file and write its header
+
+  std::string head(file_magic,8);
+
+  ouf.open( fname.c_str(), std::ios::binary );
+  if ( !ouf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+
+  put_u64(head,header.checksum);
+  put_u32(head,header.chroms.size());
+  for (std::size_t c=0; c<header.chroms.size(); c++) {
+    put_u32(head,header.chroms[c].size());
+    head += header.chroms[c];
+    put_u32(head,header.nfragments[c]);
+  }
+  ouf.write(head.data(),head.size());
+
+}
+
+
+cpairs_writer::~cpairs_writer() {
+  if ( ouf.is_open() ) {
+    ouf.close();
+  }
+}
+
+
+void cpairs_writer::add(const std::uint32_t &id) {
+  // add one record; write the block when it is full
+
+  std::int64_t d = std::int64_t(id) - previous;
+  std::uint64_t z = ( std::uint64_t(d) << 1 ) ^ std::uint64_t(d >> 63);
+
+  while ( z >= 0x80 ) {
+    block.push_back( char( (z & 0x7f) | 0x80 ) );
+    z >>= 7;
+  }
+  block.push_back( char(z) );
+
+  previous = id;
+  nrecords++;
+  if ( nrecords == block_records ) {
+    write_block();
+  }
+
+}
+
+
+void cpairs_writer::write_block() {
+  // write the current block, compressed if that makes it smaller
+
+  std::string head,
+    packed;
+  uLongf packed_len;
+  const std::string *out = &block;
+
+  if ( nrecords == 0 ) {
+    return;
+  }
+
+  if ( compress ) {
+    packed_len = compressBound( block.size() );
+    packed.resize( packed_len );
+    if ( compress2( (Bytef*)&packed[0], &packed_len,
+		    (const Bytef*)block.data(), block.size(),
+		    Z_DEFAULT_COMPRESSION ) == Z_OK &&
+	 packed_len < block.size() ) {
+      packed.resize( packed_len );
+      out = &packed;
+    }
+  }
+
+  put_u32(head,nrecords);
+  put_u32(head,block.size());
+  put_u32(head,out->size());
+  ouf.write(head.data(),head.size());
+  ouf.write(out->data(),out->size());
+  if ( !ouf.good() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+  block.clear();
+  nrecords = 0;
+  previous = 0;
+
+}
+
+
+void cpairs_writer::close() {
+  // write the last block, and the empty block which marks the end
+
+  std::string head;
+
+  write_block();
+  put_u32(head,0);
+  put_u32(head,0);
+  put_u32(head,0);
+  ouf.write(head.data(),head.size());
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+}
+
+
+cpairs_reader::cpairs_reader(const std::string &fname) :
+  filename(fname), at_end(0) {
+  // open a file and read its header
+
+  char buf[12];
+  std::uint32_t nchrom,
+    len;
+  std::string name;
+
+  inf.open( fname.c_str(), std::ios::binary );
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+  read_bytes(inf,buf,8,fname);
+  if ( std::memcmp(buf,file_magic,8) != 0 ) {
+    throw std::runtime_error(fname+" is not a cpairs file");
+  }
+
+  read_bytes(inf,buf,12,fname);
+  header.checksum = get_uint(buf,8);
+  nchrom = get_uint(buf+8,4);
+  for (std::uint32_t c=0; c<nchrom; c++) {
+    read_bytes(inf,buf,4,fname);
+    len = get_uint(buf,4);
+    name.resize(len);
+    read_bytes(inf,&name[0],len,fname);
+    header.chroms.push_back(name);
+    read_bytes(inf,buf,4,fname);
+    header.nfragments.push_back( get_uint(buf,4) );
+  }
+
+}
+
+
+bool cpairs_reader::read_block(std::vector<std::uint32_t> &ids) {
+  // read the fragment IDs from the next block; false at the end
+
+  char buf[12];
+  std::uint32_t nrecords,
+    length,
+    stored;
+  std::string data,
+    unpacked;
+  const std::string *in = &data;
+  uLongf unpacked_len;
+  std::uint64_t z;
+  std::int64_t id = 0;
+  std::size_t pos = 0;
+  int shift;
+
+  ids.clear();
+  if ( at_end ) {
+    return false;
+  }
+
+  read_bytes(inf,buf,12,filename);
+  nrecords = get_uint(buf,4);
+  length = get_uint(buf+4,4);
+  stored = get_uint(buf+8,4);
+  if ( nrecords == 0 ) {
+    at_end = 1;
+    return false;
+  }
+
+  data.resize(stored);
+  read_bytes(inf,&data[0],stored,filename);
+  if ( stored < length ) {
+    unpacked.resize(length);
+    unpacked_len = length;
+    if ( uncompress( (Bytef*)&unpacked[0], &unpacked_len,
+		     (const Bytef*)data.data(), stored ) != Z_OK ||
+	 unpacked_len != length ) {
+      throw std::runtime_error("corrupt block in cpairs file "+filename);
+    }
+    in = &unpacked;
+  }
+
+  ids.reserve(nrecords);
+  for (std::uint32_t r=0; r<nrecords; r++) {
+    z = 0;
+    shift = 0;
+    do {
+      if ( pos >= in->size() || shift > 63 ) {
+	throw std::runtime_error("corrupt block in cpairs file "+filename);
+      }
+      z |= std::uint64_t( (unsigned char)(*in)[pos] & 0x7f ) << shift;
+      shift += 7;
+    } while ( (unsigned char)(*in)[pos++] & 0x80 );
+    id += std::int64_t( z >> 1 ) ^ -std::int64_t( z & 1 );
+    if ( id < 0 || id > 0xffffffffLL ) {
+      throw std::runtime_error("corrupt block in cpairs file "+filename);
+    }
+    ids.push_back(id);
+  }
+
+  return true;
+
+}
+
+
+bool CAPCMAIN_NS::is_cpairs(const std::string &fname) {
+  // does the file start with the cpairs magic number?
+
+  std::ifstream inf( fname.c_str(), std::ios::binary );
+  char buf[8];
+
+  inf.read(buf,8);
+  return inf.gcount() == 8 && std::memcmp(buf,file_magic,8) == 0;
+
+}
@@ -0,0 +1,141 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef CPAIRS_H
+#define CPAIRS_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <charconv>
+
+namespace CAPCMAIN_NS {
+
+  // A .cpairs file holds the same pairs as a .pairs file, but stores each
+  // reporter as the ID of its restriction fragment. Fragments are numbered
+  // from 0 in order of chromosome name, then start, as they are held by
+  // the genome. Layout :
+  //
+  //   "CAPCBPR1"
+  //   header : checksum of the fragments (u64), number of chromosomes
+  //            (u32), then for each its name length (u32), name, and
+  //            number of fragments (u32)
+  //   blocks : number of records (u32), encoded length (u32), stored
+  //            length (u32), then the stored bytes; these are zlib
+  //            compressed if the stored length is less than the encoded
+  //            length. Records are the differences between successive
+  //            fragment IDs, zigzag and varint encoded, starting from 0
+  //            in each block.
+  //   end    : a block with no records
+  //
+  // All integers in the header and block headers are little-endian. The
+  // fragment coordinates are not stored, so the restriction fragments file
+  // is needed to read the file back; the checksum makes sure it is the
+  // same one.
+
+  inline void checksum_bytes(std::uint64_t &sum, const char *p,
+			     const char *e) {
+    // 64 bit FNV-1a
+    for ( ; p<e; p++) {
+      sum = ( sum ^ (unsigned char)*p ) * 1099511628211ULL;
+    }
+  }
+
+  inline void checksum_fragment(std::uint64_t &sum, const std::string &chrom,
+				const long int &start, const long int &end) {
+    // add a fragment to a checksum, as its bed line
+    char num[24];
+    checksum_bytes(sum, chrom.data(), chrom.data()+chrom.size());
+    checksum_bytes(sum, "\t", "\t"+1);
+    checksum_bytes(sum, num, std::to_chars(num, num+sizeof(num), start).ptr);
+    checksum_bytes(sum, "\t", "\t"+1);
+    checksum_bytes(sum, num, std::to_chars(num, num+sizeof(num), end).ptr);
+    checksum_bytes(sum, "\n", "\n"+1);
+  }
+
+  const std::uint64_t checksum_start = 14695981039346656037ULL;
+
+
+  struct cpairs_header {
+    std::uint64_t checksum;
+    std::vector<std::string> chroms;         // in order of name
+    std::vector<std::uint32_t> nfragments;   // for each chromosome
+  };
+
+
+  struct fragment_table {
+    // the restriction fragments, by fragment ID; loaded straight from the
+    // bed file, without building a genome
+
+    std::vector<std::string> chroms;          // in order of name
+    std::vector<std::uint32_t> first_id;      // for each chromosome, and
+                                              // one past the end
+    std::vector<std::uint32_t> chrom_of;      // by fragment ID
+    std::vector<long int> starts,             // by fragment ID
+      ends;
+    std::uint64_t checksum;
+
+    void load(const std::string &);
+    void check(const cpairs_header &, const std::string &) const;
+  };
+
+
+  struct cpairs_writer {
+
+    static const std::uint32_t block_records = 1<<14;
+
+    std::ofstream ouf;
+    std::string filename;
+    bool compress;
+    std::string block;            // encoded records of the current block
+    std::uint32_t nrecords;
+    std::int64_t previous;
+
+    cpairs_writer(const std::string &, const cpairs_header &, const bool &);
+    ~cpairs_writer();
+
+    void add(const std::uint32_t &);
+    void write_block();
+    void close();
+
+  };
+
+
+  struct cpairs_reader {
+
+    std::ifstream inf;
+    std::string filename;
+    cpairs_header header;
+    bool at_end;
+
+    cpairs_reader(const std::string &);
+
+    bool read_block(std::vector<std::uint32_t> &);
+
+  };
+
+  bool is_cpairs(const std::string &);
+
+}
+
+#endif
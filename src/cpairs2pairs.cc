@@ -0,0 +1,194 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program which reads a .cpairs file written by capCmain --cpairs and
+// writes it out as a text .pairs file, exactly as capCmain would have
+// written it without --cpairs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "cpairs2pairs.h"
+#include "cpairs.h"
+#include "messages.h"
+
+#include<string>
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<stdexcept>
+#include<cstdlib>
+#include<vector>
+#include<cstdint>
+
+using namespace CPAIRS2PAIRS_NS;
+
+int main(int argc, char *argv[]) {
+
+  parameters params;
+
+  // parse command line
+  try {
+    parse_cpairs2pairs_command_line(argc,argv,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR converting cpairs file : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // convert
+  try {
+    convert_cpairs(params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR converting cpairs file : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR converting cpairs file : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Done!
+  return EXIT_SUCCESS;
+
+}
+
+
+
+void CPAIRS2PAIRS_NS::parse_cpairs2pairs_command_line(const int &argc,
+						      char **argv,
+						      parameters &params) {
+  // parse the command line
+
+  const std::string usage_message ="\nUsage :\n"
+    "   capCcpairs2pairs -r frag_file -i cpairsfile -o pairsfile\n"
+    "\n"
+    "   Required arguments :\n"
+    "       -r  frag_file     is the bed file of restriction fragments which was\n"
+    "                         given to capCmain\n"
+    "       -i  cpairsfile    is a .cpairs file written by capCmain --cpairs\n"
+    "       -o  pairsfile     is the name of the .pairs file to write\n"
+    "\n";
+
+  unsigned short int rflag = 0,  // flags for arguments
+    iflag = 0,
+    oflag = 0;
+
+  int argi=1;
+
+  while (argi < argc) {
+
+    if ( std::string(argv[argi]) == "-r" ) {
+      // restriction fragments file
+      if (!(argi+1 < argc) || rflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.fragfile = std::string(argv[argi+1]);
+      rflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-i" ) {
+      // input file
+      if (!(argi+1 < argc) || iflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.infile = std::string(argv[argi+1]);
+      iflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-o" ) {
+      // output file
+      if (!(argi+1 < argc) || oflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.outfile = std::string(argv[argi+1]);
+      oflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--version" ) {
+      // version -- overrides all other option
+      COMMON_NS::print_version();
+      std::exit(EXIT_SUCCESS);
+
+    } else {
+      throw std::runtime_error("Unknown option "+std::string(argv[argi])+"\n"+usage_message);
+    }
+
+  }
+
+  // Check required parameters are there
+  if ( rflag!=1 || iflag!=1 || oflag!=1 ) {
+      throw std::runtime_error(usage_message);
+  }
+
+}
+
+
+void CPAIRS2PAIRS_NS::convert_cpairs(const parameters &params) {
+  // write each record of the cpairs file as a line of the pairs file
+
+  using namespace CAPCMAIN_NS;
+
+  fragment_table frags;
+  std::ifstream inf;
+  std::ofstream ouf;
+  std::vector<std::uint32_t> ids;
+  std::string buf;
+  unsigned long int npairs = 0;
+
+  cpairs_reader cpairs(params.infile);
+
+  // test output file
+  inf.open( params.outfile.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+params.outfile+" already exists.");
+  }
+  inf.close();
+
+  frags.load(params.fragfile);
+  frags.check(cpairs.header,params.infile);
+
+  ouf.open( params.outfile.c_str() );
+  while ( cpairs.read_block(ids) ) {
+    buf.clear();
+    for (std::size_t i=0; i<ids.size(); i++) {
+      if ( ids[i] >= frags.starts.size() ) {
+	throw std::runtime_error("corrupt block in cpairs file "+params.infile);
+      }
+      buf += frags.chroms[ frags.chrom_of[ids[i]] ];
+      buf += "\t" + std::to_string( frags.starts[ids[i]] )
+	+ "\t" + std::to_string( frags.ends[ids[i]] ) + "\n";
+    }
+    ouf<<buf;
+    npairs += ids.size();
+  }
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+params.outfile);
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Converted "<<npairs<<" pairs from "<<params.infile;
+  COMMON_NS::message( mymessage.str() );
+
+}
@@ -0,0 +1,409 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program which keeps a genome of restriction fragments loaded, and runs
+// capCmain and capClocation2fragment jobs sent by capCclient against it,
+// so that the fragments are not read again for every run.
+//
+// As in batch mode, each job runs in a child process forked from the
+// daemon, so the jobs share the loaded fragments, while the targets,
+// counters and duplicate table are each job's own. Up to -j jobs run at
+// a time; further clients wait for one to finish.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "daemon.h"
+#include "main_process.h"
+#include "location2fragment.h"
+#include "genome.h"
+#include "messages.h"
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <climits>
+#include <cerrno>
+#include <csignal>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <unistd.h>
+
+using namespace DAEMON_NS;
+
+
+namespace {
+
+  volatile std::sig_atomic_t stop_requested = 0;
+
+  void on_stop(int) {
+    stop_requested = 1;
+  }
+
+  void on_child(int) {
+    // nothing to do; the signal interrupts poll so that finished jobs are
+    // collected
+  }
+
+  std::string real_path(const std::string &fname) {
+    char buf[PATH_MAX];
+    if ( realpath(fname.c_str(),buf) == NULL ) {
+      return "";
+    }
+    return std::string(buf);
+  }
+
+}
+
+
+int main(int argc, char *argv[]) {
+
+  parameters params;
+  CAPCMAIN_NS::genome gnm;
+  int lfd;
+
+  // parse command line
+  try {
+    parse_daemon_command_line(argc,argv,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR in daemon : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // take the socket first, so that a second daemon stops straight away;
+  // clients wait until the fragments are loaded
+  try {
+    lfd = listen_socket(params.socketfile);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR in daemon : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // load restriction enzyme fragments, once
+  try {
+    gnm.load_rest_frags(params.fragfile);
+    params.fragfile = real_path(params.fragfile);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR in daemon : "<<e.what()<<std::endl;
+    unlink(params.socketfile.c_str());
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR in daemon : An unknown error has occured."<<std::endl;
+    unlink(params.socketfile.c_str());
+    return EXIT_FAILURE;
+  }
+
+  return serve(gnm,params,lfd);
+
+}
+
+
+int DAEMON_NS::serve(CAPCMAIN_NS::genome &gnm, const parameters &params,
+		     const int &lfd) {
+  // Accept jobs on lfd until SIGINT or SIGTERM, then wait for those running
+
+  std::map<pid_t,unsigned long int> running;     // child process to job
+  unsigned long int njobs = 0;
+  int conn,
+    status;
+  pid_t pid;
+
+  // no SA_RESTART, so that these interrupt poll and waitpid
+  struct sigaction sa;
+  std::memset(&sa,0,sizeof(sa));
+  sigemptyset(&sa.sa_mask);
+  sa.sa_handler = on_stop;
+  sigaction(SIGINT,&sa,NULL);
+  sigaction(SIGTERM,&sa,NULL);
+  sa.sa_handler = on_child;
+  sigaction(SIGCHLD,&sa,NULL);
+  // a client which goes away should not take the daemon with it
+  signal(SIGPIPE,SIG_IGN);
+
+  std::stringstream mymessage;
+  mymessage<<"...Listening on "<<params.socketfile<<", running "
+	   <<params.jobs<<" jobs at a time";
+  COMMON_NS::message( mymessage.str() );
+
+  while ( !stop_requested ) {
+
+    // collect finished jobs; wait for one if there are enough running
+    while ( running.size() > 0 ) {
+      pid = waitpid(-1,&status,
+		    running.size() < params.jobs ? WNOHANG : 0);
+      if ( pid <= 0 ) {
+	break;
+      }
+      std::map<pid_t,unsigned long int>::iterator it = running.find(pid);
+      if ( it != running.end() ) {
+	mymessage.str("");
+	mymessage<<"...Job "<<it->second
+		 <<( WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ?
+		     " finished" : " failed" );
+	COMMON_NS::message( mymessage.str() );
+	running.erase(it);
+      }
+    }
+    if ( stop_requested || running.size() >= params.jobs ) {
+      continue;
+    }
+
+    // wake now and then, in case a signal came just before we got here
+    pollfd pfd;
+    pfd.fd = lfd;
+    pfd.events = POLLIN;
+    if ( poll(&pfd,1,1000) <= 0 ) {
+      continue;
+    }
+    conn = accept(lfd,NULL,NULL);
+    if ( conn < 0 ) {
+      if ( errno == EINTR || errno == ECONNABORTED ) {
+	continue;
+      }
+      std::cerr<<"ERROR in daemon : cannot accept jobs : "
+	       <<std::strerror(errno)<<std::endl;
+      break;
+    }
+
+    njobs++;
+    std::cout.flush();
+    std::cerr.flush();
+
+    pid = fork();
+    if ( pid < 0 ) {
+      std::cerr<<"ERROR in daemon : cannot start a process for job "
+	       <<njobs<<std::endl;
+    } else if ( pid == 0 ) {
+      close(lfd);
+      signal(SIGINT,SIG_DFL);
+      signal(SIGTERM,SIG_DFL);
+      signal(SIGCHLD,SIG_DFL);
+      job J;
+      try {
+	if ( !receive_job(conn,J) ) {
+	  // only a check that the daemon is there
+	  _exit(EXIT_SUCCESS);
+	}
+      } catch (const std::runtime_error& e) {
+	std::cerr<<"ERROR in daemon : job "<<njobs<<" : "<<e.what()
+		 <<std::endl;
+	_exit(EXIT_FAILURE);
+      }
+      status = run_job(gnm,params.fragfile,J);
+      try {
+	send_status(conn,status);
+      } catch (const std::runtime_error& e) {
+	// the client has gone; its outputs are written all the same
+      }
+      _exit(status);
+    } else {
+      running[pid] = njobs;
+      mymessage.str("");
+      mymessage<<"...Started job "<<njobs;
+      COMMON_NS::message( mymessage.str() );
+    }
+    close(conn);
+
+  }
+
+  close(lfd);
+  unlink(params.socketfile.c_str());
+
+  if ( running.size() > 0 ) {
+    mymessage.str("");
+    mymessage<<"...Stopping; waiting for "<<running.size()<<" jobs";
+    COMMON_NS::message( mymessage.str() );
+  }
+  while ( running.size() > 0 ) {
+    pid = waitpid(-1,&status,0);
+    if ( pid < 0 && errno == EINTR ) {
+      continue;
+    }
+    if ( pid < 0 ) {
+      break;
+    }
+    running.erase(pid);
+  }
+
+  COMMON_NS::message("...Stopped");
+  return EXIT_SUCCESS;
+
+}
+
+
+int DAEMON_NS::run_job(CAPCMAIN_NS::genome &gnm, const std::string &fragfile,
+		       job &J) {
+  // Run one job, in the child process, with the client's stdin, stdout and
+  // stderr in place of our own, and in its working directory. The job's
+  // fragments file must be the one loaded; if it gives none, it is added.
+
+  for (int i=0; i<3; i++) {
+    dup2(J.fds[i],i);
+    close(J.fds[i]);
+  }
+
+  if ( chdir(J.cwd.c_str()) != 0 ) {
+    std::cerr<<"ERROR in daemon : cannot change to directory "<<J.cwd
+	     <<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  const std::string tool = J.args[0];
+  if ( tool != "capCmain" && tool != "capClocation2fragment" ) {
+    std::cerr<<"ERROR in daemon : capCdaemon runs capCmain and "
+	     <<"capClocation2fragment, not "<<tool<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  bool rflag = false;
+  for (std::size_t i=1; i+1<J.args.size(); i++) {
+    if ( J.args[i] == "-r" ) {
+      if ( real_path(J.args[i+1]) != fragfile ) {
+	std::cerr<<"ERROR in daemon : capCdaemon holds the fragments from "
+		 <<fragfile<<", not "<<J.args[i+1]<<std::endl;
+	return EXIT_FAILURE;
+      }
+      rflag = true;
+    }
+  }
+  if ( !rflag ) {
+    J.args.insert(J.args.begin()+1,"-r");
+    J.args.insert(J.args.begin()+2,fragfile);
+  }
+
+  std::vector<char*> argv;
+  for (std::size_t i=0; i<J.args.size(); i++) {
+    argv.push_back( &J.args[i][0] );
+  }
+  argv.push_back(NULL);
+
+  int status;
+  if ( tool == "capCmain" ) {
+    status = CAPCMAIN_NS::run_capcmain(argv.size()-1,&argv[0],&gnm);
+  } else {
+    status = LOC2FRAG_NS::run_loc2frag(argv.size()-1,&argv[0],&gnm);
+  }
+  std::cout.flush();
+  std::cerr.flush();
+  return status;
+
+}
+
+
+void DAEMON_NS::parse_daemon_command_line(const int &argc, char **argv,
+					  parameters &params) {
+  // parse the command line
+
+  const std::string usage_message ="\nUsage :\n"
+    "   capCdaemon -r frag_file -S socket [-j N]\n"
+    "\n"
+    "   Required arguments :\n"
+    "       -r  frag_file     is the bed file of restriction enzyme fragments\n"
+    "                         to keep loaded\n"
+    "       -S  socket        is the Unix domain socket to listen on for jobs\n"
+    "                         from capCclient\n"
+    "  Options  :\n"
+    "       -j  N             run up to N jobs at a time (default 1)\n"
+    "\n"
+    "   The daemon runs until it is sent SIGINT or SIGTERM, then waits for\n"
+    "   the jobs which are running.\n"
+    "\n";
+
+  unsigned short int rflag = 0,  // flags for arguments
+    sflag = 0,
+    jflag = 0;
+  std::string jobs;
+
+  int argi=1;
+
+  params.jobs = 1;
+
+  while (argi < argc) {
+
+    if ( std::string(argv[argi]) == "-r" ) {
+      // restriction fragments file
+      if (!(argi+1 < argc) || rflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.fragfile = std::string(argv[argi+1]);
+      rflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-S" ) {
+      // socket
+      if (!(argi+1 < argc) || sflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.socketfile = std::string(argv[argi+1]);
+      sflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-j" ) {
+      // number of jobs at a time
+      if (!(argi+1 < argc) || jflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      jobs = std::string(argv[argi+1]);
+      jflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--version" ) {
+      // version -- overrides all other option
+      COMMON_NS::print_version();
+      std::exit(EXIT_SUCCESS);
+
+    } else {
+      throw std::runtime_error("Unknown option "+std::string(argv[argi])+"\n"+usage_message);
+    }
+
+  }
+
+  // Check required parameters are there
+  if ( rflag!=1 || sflag!=1 ) {
+      throw std::runtime_error(usage_message);
+  }
+
+  if ( jflag == 1 ) {
+    if ( jobs.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option -j "
+				 "requires positive integer");
+    }
+    std::istringstream(jobs) >> params.jobs;
+    if ( params.jobs < 1 ) {
+	throw std::runtime_error("Error parsing command line : option -j "
+				 "requires integer >0");
+    }
+  }
+
+}
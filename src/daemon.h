@@ -0,0 +1,73 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <string>
+#include <vector>
+
+// Forward declarations
+namespace CAPCMAIN_NS {
+  struct genome;
+}
+
+namespace DAEMON_NS {
+
+  struct parameters {
+    // capCdaemon
+    std::string fragfile,
+      socketfile;
+    unsigned int jobs;                  // jobs run at a time
+  };
+
+  struct client_parameters {
+    // capCclient
+    std::string socketfile;
+    std::vector<std::string> args;      // the tool and its options
+  };
+
+  struct job {
+    // a job as sent by capCclient : the tool and its options, the directory
+    // they are relative to, and the client's stdin, stdout and stderr
+    std::vector<std::string> args;
+    std::string cwd;
+    int fds[3];
+  };
+
+  void parse_daemon_command_line(const int &, char **, parameters &);
+  void parse_client_command_line(const int &, char **, client_parameters &);
+
+  int serve(CAPCMAIN_NS::genome &, const parameters &, const int &);
+  int run_job(CAPCMAIN_NS::genome &, const std::string &, job &);
+
+  // the socket (jobsocket.cc)
+  int listen_socket(const std::string &);
+  int connect_socket(const std::string &);
+  void send_job(const int &, const job &);
+  bool receive_job(const int &, job &);
+  void send_status(const int &, const int &);
+  int receive_status(const int &);
+
+}
+
+#endif
@@ -0,0 +1,414 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+#include "dedup.h"
+#include "messages.h"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <stdexcept>
+#include <cstdio>
+#include <functional>
+#include <memory>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  // helper functions for the binary run files
+
+  std::string runfilename(const std::string &prefix, const std::string &kind,
+			  const std::size_t &n) {
+    std::stringstream name;
+    name<<prefix<<"_dedup"<<kind<<"_"<<n<<".tmp";
+    return name.str();
+  }
+
+  void open_run(std::ofstream &ouf, const std::string &filename) {
+    std::ifstream inf( filename.c_str() );
+    if ( inf.good() ) {
+      throw std::runtime_error("file "+filename+" already exists (will not "
+			       "overwrite).");
+    }
+    inf.close();
+    ouf.open( filename.c_str(), std::ios::binary );
+    if ( ! ouf.good() ) {
+      throw std::runtime_error("cannot open scratch file "+filename);
+    }
+  }
+
+  void write_key(std::ofstream &ouf, const external_dedup::keyrecord &rec) {
+    unsigned int len = rec.key.size();
+    ouf.write( reinterpret_cast<const char*>(&rec.setnumber),
+	       sizeof(rec.setnumber) );
+    ouf.write( reinterpret_cast<const char*>(&len), sizeof(len) );
+    ouf.write( rec.key.data(), len );
+  }
+
+  bool read_key(std::ifstream &inf, external_dedup::keyrecord &rec) {
+    unsigned int len;
+    if ( ! inf.read( reinterpret_cast<char*>(&rec.setnumber),
+		     sizeof(rec.setnumber) ) ) {
+      return false;
+    }
+    inf.read( reinterpret_cast<char*>(&len), sizeof(len) );
+    rec.key.resize(len);
+    inf.read( &rec.key[0], len );
+    if ( ! inf ) {
+      throw std::runtime_error("scratch file for duplicate removal is "
+			       "truncated");
+    }
+    return true;
+  }
+
+  bool read_setnumber(std::ifstream &inf, unsigned long int &n) {
+    return bool( inf.read( reinterpret_cast<char*>(&n), sizeof(n) ) );
+  }
+
+  struct key_heap_entry {
+    external_dedup::keyrecord rec;
+    unsigned int run;
+    bool operator> (const key_heap_entry &other) const {
+      return other.rec < rec;
+    }
+  };
+
+}
+
+
+bool external_dedup::keyrecord::operator< (const keyrecord &other) const {
+  // sort by key, and then by order of appearance in the input
+  int c = key.compare(other.key);
+  if ( c != 0 ) {
+    return c < 0;
+  }
+  return setnumber < other.setnumber;
+}
+
+
+external_dedup::external_dedup(const std::string &prefix,
+			       const unsigned long int &mem) :
+  max_mem(mem), scratch_prefix(prefix) {
+  // constructor
+  n_keys = 0;
+  n_duplicates = 0;
+  n_spills = 0;
+  keybuffer_mem = 0;
+  dup_next = 0;
+  finished = 0;
+}
+
+
+external_dedup::~external_dedup() {
+  cleanup();
+}
+
+
+void external_dedup::add(const std::string &key,
+			 const unsigned long int &setnumber) {
+  // add the key for a read set; spill to scratch if over budget
+
+  if ( finished ) {
+    throw std::runtime_error("attempted to add a key after duplicate "
+			     "removal was finished");
+  }
+
+  keybuffer.push_back( keyrecord() );
+  keybuffer.back().key = key;
+  keybuffer.back().setnumber = setnumber;
+  keybuffer_mem += sizeof(keyrecord) + key.capacity();
+  n_keys++;
+
+  if ( keybuffer_mem > max_mem ) {
+    spill_keys();
+  }
+
+}
+
+
+void external_dedup::spill_keys() {
+  // sort the buffered keys and write them out as a run
+
+  std::ofstream ouf;
+  std::string filename = runfilename(scratch_prefix,"keys",key_runs.size());
+
+  std::sort( keybuffer.begin(), keybuffer.end() );
+
+  open_run(ouf,filename);
+  key_runs.push_back(filename);
+  n_spills++;
+  for (std::size_t i=0; i<keybuffer.size(); i++) {
+    write_key(ouf,keybuffer[i]);
+  }
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing scratch file "+filename);
+  }
+
+  std::vector<keyrecord>().swap(keybuffer);
+  keybuffer_mem = 0;
+
+}
+
+
+void external_dedup::spill_dups() {
+  // sort the buffered duplicate set numbers and write them out as a run
+
+  std::ofstream ouf;
+  std::string filename = runfilename(scratch_prefix,"dups",dup_runs.size());
+
+  std::sort( dupbuffer.begin(), dupbuffer.end() );
+
+  open_run(ouf,filename);
+  dup_runs.push_back(filename);
+  n_spills++;
+  n_duplicates += dupbuffer.size();
+  ouf.write( reinterpret_cast<const char*>(&dupbuffer[0]),
+	     dupbuffer.size()*sizeof(unsigned long int) );
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing scratch file "+filename);
+  }
+
+  dupbuffer.clear();
+
+}
+
+
+void external_dedup::merge_key_runs() {
+  // k-way merge of the sorted key runs; within a group of identical keys
+  // the first entry is the first occurrence, and the rest are duplicates.
+  // If this fails the runs are closed, and all scratch files removed.
+
+  std::vector< std::unique_ptr<std::ifstream> > runs;
+  std::priority_queue<key_heap_entry, std::vector<key_heap_entry>,
+		      std::greater<key_heap_entry> > heap;
+  key_heap_entry entry;
+  std::string lastkey;
+  bool havelast = 0;
+
+  try {
+
+    for (unsigned int r=0; r<key_runs.size(); r++) {
+      runs.emplace_back( new std::ifstream( key_runs[r].c_str(),
+					    std::ios::binary ) );
+      if ( ! runs.back()->good() ) {
+	throw std::runtime_error("cannot open scratch file "+key_runs[r]);
+      }
+      entry.run = r;
+      if ( read_key(*runs[r],entry.rec) ) {
+	heap.push(entry);
+      }
+    }
+
+    while ( ! heap.empty() ) {
+      entry = heap.top();
+      heap.pop();
+
+      if ( havelast && entry.rec.key == lastkey ) {
+	dupbuffer.push_back( entry.rec.setnumber );
+	if ( dupbuffer.size()*sizeof(unsigned long int) > max_mem ) {
+	  spill_dups();
+	}
+      } else {
+	lastkey.swap(entry.rec.key);
+	havelast = 1;
+      }
+
+      if ( read_key(*runs[entry.run],entry.rec) ) {
+	heap.push(entry);
+      }
+    }
+
+  } catch (...) {
+    runs.clear();
+    cleanup();
+    throw;
+  }
+
+  runs.clear();
+  for (unsigned int r=0; r<key_runs.size(); r++) {
+    std::remove( key_runs[r].c_str() );
+  }
+  key_runs.clear();
+
+}
+
+
+void external_dedup::finish() {
+  // all keys added -- decide which sets are duplicates
+
+  if ( key_runs.size() == 0 ) {
+    // everything fitted in memory
+    std::sort( keybuffer.begin(), keybuffer.end() );
+    for (std::size_t i=1; i<keybuffer.size(); i++) {
+      if ( keybuffer[i].key == keybuffer[i-1].key ) {
+	dupbuffer.push_back( keybuffer[i].setnumber );
+      }
+    }
+    std::vector<keyrecord>().swap(keybuffer);
+    keybuffer_mem = 0;
+  } else {
+    if ( keybuffer.size() > 0 ) {
+      spill_keys();
+    }
+    merge_key_runs();
+  }
+
+  // get ready to stream the duplicates back in order of set number
+  if ( dup_runs.size() == 0 ) {
+    std::sort( dupbuffer.begin(), dupbuffer.end() );
+    n_duplicates += dupbuffer.size();
+  } else {
+    if ( dupbuffer.size() > 0 ) {
+      spill_dups();
+    }
+    for (unsigned int r=0; r<dup_runs.size(); r++) {
+      unsigned long int n;
+      dup_streams.push_back( new std::ifstream( dup_runs[r].c_str(),
+						std::ios::binary ) );
+      if ( ! dup_streams.back()->good() ) {
+	throw std::runtime_error("cannot open scratch file "+dup_runs[r]);
+      }
+      if ( read_setnumber(*dup_streams[r],n) ) {
+	dup_heap.push( heap_entry(n,r) );
+      }
+    }
+  }
+
+  finished = 1;
+
+  std::stringstream mymessage;
+  mymessage<<"...Found "<<n_duplicates<<" duplicates among "<<n_keys
+	   <<" read sets";
+  if ( n_spills > 0 ) {
+    mymessage<<" ("<<n_spills<<" runs spilled to scratch)";
+  }
+  COMMON_NS::message( mymessage.str() );
+
+}
+
+
+bool external_dedup::is_duplicate(const unsigned long int &setnumber) {
+  // is this set number a repeat of an earlier read set?
+  // set numbers must be queried in increasing order
+
+  if ( ! finished ) {
+    throw std::runtime_error("duplicate removal has not been finished");
+  }
+
+  if ( dup_runs.size() == 0 ) {
+    while ( dup_next < dupbuffer.size() && dupbuffer[dup_next] < setnumber ) {
+      dup_next++;
+    }
+    if ( dup_next < dupbuffer.size() && dupbuffer[dup_next] == setnumber ) {
+      dup_next++;
+      return true;
+    }
+    return false;
+  }
+
+  while ( ! dup_heap.empty() && dup_heap.top().first <= setnumber ) {
+    heap_entry top = dup_heap.top();
+    unsigned long int n;
+    dup_heap.pop();
+    if ( read_setnumber(*dup_streams[top.second],n) ) {
+      dup_heap.push( heap_entry(n,top.second) );
+    }
+    if ( top.first == setnumber ) {
+      return true;
+    }
+  }
+  return false;
+
+}
+
+
+void external_dedup::cleanup() {
+  // close and remove all scratch files
+
+  for (std::size_t r=0; r<dup_streams.size(); r++) {
+    dup_streams[r]->close();
+    delete dup_streams[r];
+  }
+  dup_streams.clear();
+
+  for (std::size_t r=0; r<key_runs.size(); r++) {
+    std::remove( key_runs[r].c_str() );
+  }
+  key_runs.clear();
+  for (std::size_t r=0; r<dup_runs.size(); r++) {
+    std::remove( dup_runs[r].c_str() );
+  }
+  dup_runs.clear();
+
+}
+
+
+void sharded_dedup::insert(const std::string &key,
+			   const unsigned long int &setnumber) {
+  // record key, keeping the lowest set number seen with it
+
+  shard &S = shards[ std::hash<std::string>()(key) % Nshards ];
+  std::lock_guard<std::mutex> guard(S.lock);
+
+  std::pair< std::unordered_map<std::string,unsigned long int>::iterator,
+	     bool > ins = S.first.insert( std::make_pair(key,setnumber) );
+  if ( !ins.second && setnumber < ins.first->second ) {
+    ins.first->second = setnumber;
+  }
+
+}
+
+
+bool sharded_dedup::is_duplicate(const std::string &key,
+				 const unsigned long int &setnumber) {
+  // a set is a duplicate if its key was first seen in an earlier set
+
+  shard &S = shards[ std::hash<std::string>()(key) % Nshards ];
+  std::lock_guard<std::mutex> guard(S.lock);
+
+  std::unordered_map<std::string,unsigned long int>::const_iterator
+    it = S.first.find(key);
+  if ( it == S.first.end() ) {
+    throw std::runtime_error("read set key missing from duplicate table");
+  }
+  return it->second != setnumber;
+
+}
+
+
+unsigned long int sharded_dedup::size() {
+  // total number of distinct keys
+
+  unsigned long int n = 0;
+  for (unsigned int i=0; i<Nshards; i++) {
+    std::lock_guard<std::mutex> guard(shards[i].lock);
+    n += shards[i].first.size();
+  }
+  return n;
+
+}
@@ -0,0 +1,110 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+#ifndef DEDUP_H
+#define DEDUP_H
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <fstream>
+#include <utility>
+#include <functional>
+#include <unordered_map>
+#include <mutex>
+
+namespace CAPCMAIN_NS {
+
+  // Structures
+
+  struct external_dedup {
+    // Duplicate removal with a fixed memory budget. Keys for every mapped
+    // read set are added in input order together with the set number. When
+    // the buffered keys exceed the budget they are sorted and spilled to a
+    // run file on scratch. finish() merges the runs, keeping the first
+    // occurrence of each key, and records the set numbers of all repeats;
+    // these are then streamed back in order by is_duplicate().
+
+    unsigned long int max_mem;        // memory budget in bytes
+    std::string scratch_prefix;       // prefix for temporary run files
+
+    unsigned long int n_keys,
+      n_duplicates,
+      n_spills;
+
+    struct keyrecord {
+      std::string key;
+      unsigned long int setnumber;
+      bool operator< (const keyrecord &) const;
+    };
+
+    std::vector<keyrecord> keybuffer;
+    unsigned long int keybuffer_mem;
+    std::vector<std::string> key_runs;
+
+    std::vector<unsigned long int> dupbuffer;
+    std::vector<std::string> dup_runs;
+
+    // readers for the merge of duplicate runs
+    std::vector<std::ifstream*> dup_streams;
+    typedef std::pair<unsigned long int,unsigned int> heap_entry;
+    std::priority_queue<heap_entry, std::vector<heap_entry>,
+			std::greater<heap_entry> > dup_heap;
+    std::size_t dup_next;
+    bool finished;
+
+    external_dedup(const std::string &, const unsigned long int &);
+    ~external_dedup();
+
+    void add(const std::string &, const unsigned long int &);
+    void finish();
+    bool is_duplicate(const unsigned long int &);
+
+    void spill_keys();
+    void spill_dups();
+    void merge_key_runs();
+    void cleanup();
+
+  };
+
+
+  struct sharded_dedup {
+    // Duplicate table shared by worker threads. Each key stores the lowest
+    // set number it has been inserted with, so once every earlier set has
+    // been inserted a set is a duplicate unless it holds that lowest number.
+    // The table is split into shards, each with its own lock.
+
+    static const unsigned int Nshards = 64;
+
+    struct shard {
+      std::mutex lock;
+      std::unordered_map<std::string,unsigned long int> first;
+    } shards[Nshards];
+
+    void insert(const std::string &, const unsigned long int &);
+    bool is_duplicate(const std::string &, const unsigned long int &);
+    unsigned long int size();
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,201 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program which reads a pairs container written by capCmain --container
+// and writes out the .pairs files for one or all targets, exactly as
+// capCmain would have written them without --container.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "extractpairs.h"
+#include "pairscontainer.h"
+#include "messages.h"
+
+#include<string>
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<stdexcept>
+#include<cstdlib>
+
+using namespace EXTRACTPAIRS_NS;
+
+int main(int argc, char *argv[]) {
+
+  parameters params;
+
+  // parse command line
+  try {
+    parse_extractpairs_command_line(argc,argv,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR extracting pairs : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // write out the pairs files
+  try {
+    extract_pairs(params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR extracting pairs : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR extracting pairs : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Done!
+  return EXIT_SUCCESS;
+
+}
+
+
+
+void EXTRACTPAIRS_NS::parse_extractpairs_command_line(const int &argc,
+						      char **argv,
+						      parameters &params) {
+  // parse the command line
+
+  const std::string usage_message ="\nUsage :\n"
+    "   capCextractpairs -c container -o name [-n targetname]\n"
+    "\n"
+    "   Required arguments :\n"
+    "       -c  container     is a pairs container written by capCmain --container\n"
+    "       -o  name          is the first part of the output file names; files\n"
+    "                         are named as they would be by capCmain -o name\n"
+    "  Options  :\n"
+    "       -n  targetname    only extract the pairs for this target. Default is\n"
+    "                         to extract all targets.\n"
+    "\n";
+
+  unsigned short int cflag = 0,  // flags for arguments
+    oflag = 0,
+    nameflag = 0;
+
+  int argi=1;
+
+  while (argi < argc) {
+
+    if ( std::string(argv[argi]) == "-c" ) {
+      // container file
+      if (!(argi+1 < argc) || cflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.container = std::string(argv[argi+1]);
+      cflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-o" ) {
+      // output file prefix
+      if (!(argi+1 < argc) || oflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.outprefix = std::string(argv[argi+1]);
+      oflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-n" ) {
+      // target name
+      if (!(argi+1 < argc) || nameflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.targetname = std::string(argv[argi+1]);
+      nameflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--version" ) {
+      // version -- overrides all other option
+      COMMON_NS::print_version();
+      std::exit(EXIT_SUCCESS);
+
+    } else {
+      throw std::runtime_error("Unknown option "+std::string(argv[argi])+"\n"+usage_message);
+    }
+
+  }
+
+  // Check required parameters are there
+  if ( cflag!=1 || oflag!=1 ) {
+      throw std::runtime_error(usage_message);
+  }
+
+}
+
+
+void EXTRACTPAIRS_NS::extract_pairs(const parameters &params) {
+  // write the pairs files for the requested targets
+
+  using namespace CAPCMAIN_NS;
+
+  pairs_container_reader container(params.container);
+  std::ifstream inf;
+  std::ofstream ouf;
+  std::string fname;
+  std::size_t first = 0,
+    last = container.names.size(),
+    nfiles = 0;
+
+  if ( params.targetname != "" ) {
+    int t = container.find_target(params.targetname);
+    if ( t < 0 ) {
+      throw std::runtime_error("target "+params.targetname+" is not in "
+			       +params.container);
+    }
+    first = t;
+    last = t+1;
+  }
+
+  for (std::size_t t=first; t<last; t++) {
+    for (int k=intra_pairs; k<=inter_pairs; k++) {
+      if ( k == inter_pairs && !container.has_inter ) {
+	continue;
+      }
+      fname = params.outprefix
+	+ ( k == intra_pairs ? "_validpairs_" : "_validinterchom_" )
+	+ container.names[t] + ".pairs";
+
+      // test file does not exist
+      inf.open( fname.c_str() );
+      if ( inf.good() ) {
+	throw std::runtime_error("file "+fname+" already exists (will not "
+				 "overwrite).");
+      }
+      inf.close();
+
+      ouf.open( fname.c_str() );
+      container.extract(pairs_kind(k),t,ouf);
+      ouf.close();
+      if ( ouf.fail() ) {
+	throw std::runtime_error("error writing to file "+fname);
+      }
+      nfiles++;
+    }
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Extracted "<<nfiles<<" pairs files from "<<params.container;
+  COMMON_NS::message( mymessage.str() );
+
+}
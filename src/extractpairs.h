@@ -0,0 +1,43 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef EXTRACTPAIRS_H
+#define EXTRACTPAIRS_H
+
+#include <string>
+
+namespace EXTRACTPAIRS_NS {
+
+  struct parameters {
+
+    std::string container,
+      targetname,       // empty means all targets
+      outprefix;
+
+  };
+
+  void parse_extractpairs_command_line(const int &, char **, parameters &);
+  void extract_pairs(const parameters &);
+
+}
+
+#endif
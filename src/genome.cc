@@ -30,6 +30,9 @@
 #include <string>
 #include <iomanip>
 #include <stdexcept>
+#include <cmath>
+#include <map>
+#include <algorithm>
 
 using namespace CAPCMAIN_NS;
 
@@ -40,7 +43,6 @@ void genome::load_targets(const std::string &filename) {
   std::ifstream inf;
   std::string line;
   target newtarget;
-  int id;
   it_rest_set pntr_rest_frag;
   it_rest_map pntr_chrom;
   std::pair<it_targs,bool> pair_ptr_target;
@@ -55,14 +57,12 @@ void genome::load_targets(const std::string &filename) {
     throw std::runtime_error("cannot open file "+filename);
   }
 
-  id = 0;
+  targets_by_id.clear();
   while ( getline(inf,line) )  {
     newtarget = bed_feature::line2bed_feature(line);
-    newtarget.target_id = id;
-    id++;
 
     // check name is not empty
-    if ( newtarget.name == "" ) {
+    if ( newtarget.name.empty() ) {
       throw std::runtime_error("an entry in the targets list has no name - all"
 			       " target fragments must have a unique name");
     }
@@ -70,7 +70,7 @@ void genome::load_targets(const std::string &filename) {
     pntr_chrom = restriction_fragments.find( newtarget.chrom );
     if ( pntr_chrom==restriction_fragments.end() ) {
       // chromsome is not in fragments list
-      throw std::runtime_error("unknown target chromosome "+newtarget.chrom);
+      throw std::runtime_error("unknown target chromosome "+newtarget.chrom.str());
     }
    
     pntr_rest_frag = pntr_chrom->second.lower_bound( rest_fragment(newtarget) );
@@ -78,24 +78,26 @@ void genome::load_targets(const std::string &filename) {
 	|| pntr_rest_frag->start != newtarget.start
 	|| pntr_rest_frag->end != newtarget.end) {
       // this target does not match the restiction fragment
-      throw std::runtime_error("target "+newtarget.name+" is not a restriction"
+      throw std::runtime_error("target "+newtarget.name.str()+" is not a restriction"
 			       "enzyme fragment");
     }
 
     if ( pntr_rest_frag->is_target==1 ) {
       // a target at this location already existed
       COMMON_NS::warning_message("more than one target defined at same location - "
-		      "ignoring the dupliacte entry '"+newtarget.name+"'.");    
+		      "ignoring the dupliacte entry '"+newtarget.name.str()+"'.");    
     } else {
       // all seems in order - try to add to the targets list
+      newtarget.target_id = targets.size();
       pair_ptr_target = targets.insert( newtarget );
       if ( pair_ptr_target.second==false ) {
 	// this target name was alreasy in use
 	throw std::runtime_error("multiple targets with same name - all target"
 				 "fragments must have a unique name");
       }
+      targets_by_id.push_back( pair_ptr_target.first );
       pntr_rest_frag->is_target = 1;
-      pntr_rest_frag->targetname = newtarget.name;
+      pntr_rest_frag->target_id = newtarget.target_id;
     }
 
       
@@ -114,6 +116,44 @@ void genome::load_targets(const std::string &filename) {
 }
 
 
+void genome::mark_exclusion_zones(const unsigned int &exclusion) {
+  // flag every fragment whose midpoint is within exclusion of a target's
+  // midpoint. Fragments do not overlap, so midpoints increase along the
+  // chromosome and we only need to walk out from each target until we
+  // leave its zone.
+
+  unsigned long int n_excluded = 0;
+
+  for (it_targs T=targets.begin(); T!=targets.end(); ++T) {
+    const std::set<rest_fragment> &chrom =
+      restriction_fragments.find(T->chrom)->second;
+    const double tmid = 0.5*(T->start+T->end);
+    it_rest_set F = chrom.lower_bound( rest_fragment(*T) ),
+      G;
+
+    for ( G=F; G!=chrom.end() &&
+	    std::abs(0.5*(G->start+G->end) - tmid) <= exclusion; ++G ) {
+      n_excluded += !G->is_excluded;
+      G->is_excluded = 1;
+    }
+    for ( G=F; G!=chrom.begin(); ) {
+      --G;
+      if ( std::abs(0.5*(G->start+G->end) - tmid) > exclusion ) {
+	break;
+      }
+      n_excluded += !G->is_excluded;
+      G->is_excluded = 1;
+    }
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Marked "<<n_excluded<<" restriction fragments within "
+	   <<exclusion<<" bp of a target";
+  COMMON_NS::message( mymessage.str() );
+
+}
+
+
 void genome::load_rest_frags(const std::string &filename) {
   // Load a bed file of restriction fragments
 
@@ -177,6 +217,15 @@ void genome::load_rest_frags(const std::string &filename) {
     }
     
   }
+
+  // number the fragments in order of chromosome name, then start
+  Nfragments = 0;
+  for (it_rest_map chr=restriction_fragments.begin();
+       chr != restriction_fragments.end(); ++chr) {
+    for (it_rest_set fr=chr->second.begin(); fr != chr->second.end(); ++fr) {
+      fr->fragment_id = Nfragments++;
+    }
+  }
   
   std::stringstream mymessage;
   mymessage<<"...Loaded restriction enzymes from file "<<filename;
@@ -186,24 +235,91 @@ void genome::load_rest_frags(const std::string &filename) {
 }
 
 
-bool genome::is_duplicate(const std::vector<samfrag> &fragset) {
-  // check fragset agaist list to see if it is a duplicate
+void genome::set_references(const sam_references &refs) {
+  // point each reference ID of the SAM/BAM header at the fragments for
+  // that chromosome; references with no fragments are left NULL
+
+  ref_chroms.assign( refs.names.size(), NULL );
+  for (std::size_t r=0; r<refs.names.size(); r++) {
+    it_rest_map chr = restriction_fragments.find( refs.names[r] );
+    if ( chr != restriction_fragments.end() ) {
+      ref_chroms[r] = &(chr->second);
+    }
+  }
+
+}
+
+
+void genome::set_distance_bins(const unsigned int &per_decade) {
+  // Set up the bins for the histogram of reporter to target distance :
+  // per_decade bins for each factor of 10, from 1 kb, with a first bin
+  // below 1 kb and the last one ending beyond the longest chromosome.
+  // Call after loading the fragments and before setting up the counters.
+
+  long int longest = 0,
+    edge;
+
+  distance_bins = per_decade;
+  distance_edges.clear();
+  if ( per_decade == 0 ) {
+    return;
+  }
+
+  for (const_it_rest_map C=restriction_fragments.begin();
+       C != restriction_fragments.end(); ++C) {
+    if ( !C->second.empty() && C->second.rbegin()->end > longest ) {
+      longest = C->second.rbegin()->end;
+    }
+  }
+
+  distance_edges.push_back(0);
+  for (unsigned int i=0; distance_edges.size() < 2 ||
+	 distance_edges.back() < longest; i++) {
+    edge = std::lround( 1000.0*std::pow(10.0,double(i)/per_decade) );
+    if ( edge > distance_edges.back() ) {
+      distance_edges.push_back(edge);
+    }
+  }
+
+}
+
+
+std::size_t genome::distance_bin(const long int &distance) const {
+  // the bin a distance falls in; one lookup in the bin edges
+  std::size_t bin = std::upper_bound(distance_edges.begin(),
+				     distance_edges.end(), distance)
+    - distance_edges.begin();
+  return bin < distance_edges.size() ? bin-1 : distance_edges.size()-2;
+}
+
+
+std::string genome::duplicate_key(const std::vector<samfrag> &fragset) {
+  // build the key used to compare read sets when checking for duplicates
 
   std::stringstream sline;
-  std::pair< std::map<std::string,int>::iterator , bool > is_dup;
-     
+
   for (int i=0;i<fragset.size();i++) {
-    if (fragset[i].chrom=="*") {
+    if (fragset[i].refid < 0) {
       // if it didn't map, have to compare sequence
       sline<<fragset[i].sequence<<" "; 
     } else {
-      sline<<fragset[i].chrom<<" "<<fragset[i].start<<" "
+      sline<<fragset[i].refid<<" "<<fragset[i].start<<" "
 	   <<fragset[i].length<<" ";
     }
   }
 
+  return sline.str();
+
+}
+
+
+bool genome::is_duplicate(const std::vector<samfrag> &fragset) {
+  // check fragset agaist list to see if it is a duplicate
+
+  std::pair< std::map<std::string,int>::iterator , bool > is_dup;
+
   // insert if new; does not insert if already in list
-  is_dup = list_for_duplicates.insert ( std::pair<std::string,int>( sline.str() ,1) );
+  is_dup = list_for_duplicates.insert ( std::pair<std::string,int>( duplicate_key(fragset) ,1) );
 
   if ( is_dup.second == true ) {
     // it did not already exist, and was added to the map, return false
@@ -236,11 +352,11 @@ void genome::counters::output_interchrom(const std::string &filename) const {
     "interactions within 5Mb, interactions within 1Mb"<<std::endl;
   for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
     ouf<<T->name<<"\t"
-       <<validPairs.find(T->name)->second<<"\t"
-       <<onlyInter.find(T->name)->second<<"\t"
-       <<validPairs.find(T->name)->second+onlyInter.find(T->name)->second<<"\t"
-       <<within5Mb.find(T->name)->second<<"\t"
-       <<within1Mb.find(T->name)->second
+       <<validPairs[T->target_id]<<"\t"
+       <<onlyInter[T->target_id]<<"\t"
+       <<validPairs[T->target_id]+onlyInter[T->target_id]<<"\t"
+       <<within5Mb[T->target_id]<<"\t"
+       <<within1Mb[T->target_id]
        <<std::endl;;
   }
 
@@ -320,13 +436,51 @@ void genome::counters::output_report(const std::string &filename) const {
      <<std::endl;
   for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
     ouf<<"###   "<<std::setw(15)<<std::left<<T->name
-       <<"  "<<std::setw(10)<<std::right<<validPairs.find(T->name)->second
-       <<"  "<<std::setw(10)<<std::right<<onlyInter.find(T->name)->second
-       <<"  "<<std::setw(10)<<std::right<<validPairs.find(T->name)->second+onlyInter.find(T->name)->second
+       <<"  "<<std::setw(10)<<std::right<<validPairs[T->target_id]
+       <<"  "<<std::setw(10)<<std::right<<onlyInter[T->target_id]
+       <<"  "<<std::setw(10)<<std::right<<validPairs[T->target_id]+onlyInter[T->target_id]
        <<std::endl;;
   }
   ouf<<"###"<<std::endl;
   ouf<<"##################################################################################"<<std::endl;
+
+  if ( stopped_early ) {
+    // scale the counts up to the whole input, by the fraction of it read
+    ouf<<"###"<<std::endl;
+    ouf<<"### Stopped early, once targets were saturated "<<std::endl;
+    ouf<<"###"<<std::endl;
+    if ( input_read > 0 ) {
+      double scale = 1./input_read;
+      ouf<<"###                      % of input read : "<<std::setw(13)<<100.*input_read<<" %"<<std::endl;
+      ouf<<"###   estimated read sets in whole input : "<<std::setw(13)<<std::setprecision(0)<<total_read_sets*scale<<std::endl;
+      ouf<<"###     estimated valid interactions     : "<<std::setw(13)<<(total_interchrom+total_validPairs)*scale<<std::endl;
+      ouf<<"###"<<std::endl;
+      ouf<<"###   Estimated per target for the whole input, then the total"<<std::endl;
+      ouf<<"###   read so far"<<std::endl;
+      ouf<<"###"<<std::endl;
+      // not headed "target name", and with a column more than the table
+      // above, so that tools reading the totals from that skip these rows
+      ouf<<"###   "<<std::setw(15)<<std::left<<"estimated target"
+	 <<"  "<<std::setw(10)<<std::right<<"intra"
+	 <<"  "<<std::setw(10)<<"inter"
+	 <<"  "<<std::setw(10)<<"total"
+	 <<"  "<<std::setw(10)<<"so_far"
+	 <<std::endl;
+      for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+	ouf<<"###   "<<std::setw(15)<<std::left<<T->name
+	   <<"  "<<std::setw(10)<<std::right<<validPairs[T->target_id]*scale
+	   <<"  "<<std::setw(10)<<std::right<<onlyInter[T->target_id]*scale
+	   <<"  "<<std::setw(10)<<std::right<<(validPairs[T->target_id]+onlyInter[T->target_id])*scale
+	   <<"  "<<std::setw(10)<<std::right<<validPairs[T->target_id]+onlyInter[T->target_id]
+	   <<std::endl;
+      }
+    } else {
+      ouf<<"###   the size of the input is not known, so the totals for the"<<std::endl;
+      ouf<<"###   whole of it cannot be estimated"<<std::endl;
+    }
+    ouf<<"###"<<std::endl;
+    ouf<<"##################################################################################"<<std::endl;
+  }
   
   ouf.close();
 
@@ -339,6 +493,82 @@ void genome::counters::output_report(const std::string &filename) const {
 
 
 
+void genome::counters::output_distances(const std::string &filename) const {
+  // Output the histogram of reporter to target distance : a row for each
+  // bin, with a column for each target
+
+  std::ofstream ouf;
+  std::ifstream inf;
+  std::size_t nbins = me.distance_edges.size()-1;
+
+  inf.open( filename.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+filename+" already exists (will not "
+			     "overwrite).");
+  }
+  inf.close();
+
+  ouf.open( filename.c_str() );
+  ouf<<"# intrachromosomal interactions by distance from the target (bp), "
+    "in bins from start up to end, "<<me.distance_bins<<" bins per decade"
+     <<std::endl;
+  ouf<<"start\tend";
+  for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+    ouf<<"\t"<<T->name;
+  }
+  ouf<<std::endl;
+  for (std::size_t i=0; i<nbins; i++) {
+    ouf<<me.distance_edges[i]<<"\t"<<me.distance_edges[i+1];
+    for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+      ouf<<"\t"<<distances[ T->target_id*nbins + i ];
+    }
+    ouf<<std::endl;
+  }
+
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+  
+}
+
+
+
+void genome::counters::output_capture_matrix(const std::string &filename)
+  const {
+  // Output the read sets holding two (or more) targets, for each pair of
+  // targets which were found together : a sparse target by target matrix
+
+  std::ofstream ouf;
+  std::ifstream inf;
+
+  inf.open( filename.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+filename+" already exists (will not "
+			     "overwrite).");
+  }
+  inf.close();
+
+  ouf.open( filename.c_str() );
+  ouf<<"# read sets holding both targets, for each pair of targets found "
+    "together"<<std::endl;
+  ouf<<"target1\ttarget2\tread_sets"<<std::endl;
+  for (std::map<std::pair<int,int>,long unsigned int>::const_iterator
+	 it=capture_pairs.begin(); it!=capture_pairs.end(); ++it) {
+    ouf<<me.targets_by_id[it->first.first]->name<<"\t"
+       <<me.targets_by_id[it->first.second]->name<<"\t"<<it->second
+       <<std::endl;
+  }
+
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+  
+}
+
+
+
 void genome::counters::setup() {
   // set all counters to zero
 
@@ -359,13 +589,253 @@ void genome::counters::setup() {
   multiple_reporters = 0;
   total_interchrom = 0;
   total_validPairs = 0;
+  stopped_early = 0;
+  input_read = 1;
+  capture_pairs.clear();
   
   // set per target counters
-  for (it_targs T=me.targets.begin() ; T != me.targets.end() ; ++T ) {
-    validPairs[ T->name ] = 0;
-    onlyInter[ T->name ] = 0;
-    within1Mb[ T->name ] = 0;
-    within5Mb[ T->name ] = 0;
-  }
+  validPairs.assign( me.targets.size(), 0 );
+  onlyInter.assign( me.targets.size(), 0 );
+  within1Mb.assign( me.targets.size(), 0 );
+  within5Mb.assign( me.targets.size(), 0 );
+  distances.assign( me.distance_edges.empty() ? 0 :
+		    me.targets.size()*(me.distance_edges.size()-1), 0 );
   
 }
+
+
+void genome::counters::add(const counters &other) {
+  // add counts from another set of counters, e.g. from another thread
+
+  total_read_frags += other.total_read_frags;
+  total_read_sets += other.total_read_sets;
+  duplicates_removed += other.duplicates_removed;
+  none_mapped += other.none_mapped;
+  no_targets += other.no_targets;
+  multiple_targets += other.multiple_targets;
+  no_reporters += other.no_reporters;
+  exclusion += other.exclusion;
+  multiple_reporters += other.multiple_reporters;
+  total_interchrom += other.total_interchrom;
+  total_validPairs += other.total_validPairs;
+
+  for (std::size_t t=0; t<validPairs.size(); t++) {
+    validPairs[t] += other.validPairs[t];
+    onlyInter[t] += other.onlyInter[t];
+    within1Mb[t] += other.within1Mb[t];
+    within5Mb[t] += other.within5Mb[t];
+  }
+  for (std::size_t i=0; i<distances.size(); i++) {
+    distances[i] += other.distances[i];
+  }
+  for (std::map<std::pair<int,int>,long unsigned int>::const_iterator
+	 it=other.capture_pairs.begin(); it!=other.capture_pairs.end(); ++it) {
+    capture_pairs[it->first] += it->second;
+  }
+
+}
+
+
+void genome::counters::output_counts(const std::string &filename,
+				     const unsigned int &shard,
+				     const unsigned int &nshards) const {
+  // Output all the counters, one per line as name and value, followed by
+  // a line for each target, for capCmerge to add up
+
+  std::ofstream ouf;
+  std::ifstream inf;
+
+  inf.open( filename.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+filename+" already exists (will not "
+			     "overwrite).");
+  }
+  inf.close();
+
+  ouf.open( filename.c_str() );
+  ouf<<"# capC-MAP counters"<<std::endl;
+  ouf<<"shard\t"<<shard<<"\t"<<nshards<<std::endl;
+  ouf<<"total_read_frags\t"<<total_read_frags<<std::endl;
+  ouf<<"total_read_sets\t"<<total_read_sets<<std::endl;
+  ouf<<"duplicates_removed\t"<<duplicates_removed<<std::endl;
+  ouf<<"none_mapped\t"<<none_mapped<<std::endl;
+  ouf<<"no_targets\t"<<no_targets<<std::endl;
+  ouf<<"multiple_targets\t"<<multiple_targets<<std::endl;
+  ouf<<"no_reporters\t"<<no_reporters<<std::endl;
+  ouf<<"exclusion\t"<<exclusion<<std::endl;
+  ouf<<"multiple_reporters\t"<<multiple_reporters<<std::endl;
+  ouf<<"total_interchrom\t"<<total_interchrom<<std::endl;
+  ouf<<"total_validPairs\t"<<total_validPairs<<std::endl;
+  ouf<<"distance_bins\t"<<me.distance_bins<<std::endl;
+  ouf<<"capture_matrix\t"<<me.capture_matrix<<std::endl;
+  ouf<<"# target name, intrachromosomal, interchromosomal, within 1Mb, "
+    "within 5Mb"<<std::endl;
+  for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+    ouf<<"target\t"<<T->name<<"\t"
+       <<validPairs[T->target_id]<<"\t"
+       <<onlyInter[T->target_id]<<"\t"
+       <<within1Mb[T->target_id]<<"\t"
+       <<within5Mb[T->target_id]<<std::endl;
+  }
+  if ( me.distance_bins > 0 ) {
+    std::size_t nbins = me.distance_edges.size()-1;
+    ouf<<"# target name, pairs in each distance bin"<<std::endl;
+    for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+      ouf<<"distances\t"<<T->name;
+      for (std::size_t i=0; i<nbins; i++) {
+	ouf<<"\t"<<distances[ T->target_id*nbins + i ];
+      }
+      ouf<<std::endl;
+    }
+  }
+  if ( me.capture_matrix ) {
+    ouf<<"# target name, target name, read sets holding both"<<std::endl;
+    for (std::map<std::pair<int,int>,long unsigned int>::const_iterator
+	   it=capture_pairs.begin(); it!=capture_pairs.end(); ++it) {
+      ouf<<"capture\t"<<me.targets_by_id[it->first.first]->name<<"\t"
+	 <<me.targets_by_id[it->first.second]->name<<"\t"<<it->second
+	 <<std::endl;
+    }
+  }
+
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+}
+
+
+void genome::counters::add_counts(const std::string &filename,
+				  unsigned int &shard, unsigned int &nshards) {
+  // Add on the counters from a file written by output_counts, and give
+  // the shard it came from. The targets must be the same.
+
+  std::ifstream inf;
+  std::string line,
+    name;
+  counters other(me);
+  std::map<std::string,long unsigned int*> globals;
+  std::map<std::string,int> ids;
+  std::vector<char> seen( me.targets.size(), 0 ),
+    seen_distances( me.targets.size(), 0 );
+  unsigned int nglobals = 0,
+    bins;
+  bool bins_given = false,
+    matrix;
+  std::size_t nbins = 0;
+
+  globals["total_read_frags"] = &other.total_read_frags;
+  globals["total_read_sets"] = &other.total_read_sets;
+  globals["duplicates_removed"] = &other.duplicates_removed;
+  globals["none_mapped"] = &other.none_mapped;
+  globals["no_targets"] = &other.no_targets;
+  globals["multiple_targets"] = &other.multiple_targets;
+  globals["no_reporters"] = &other.no_reporters;
+  globals["exclusion"] = &other.exclusion;
+  globals["multiple_reporters"] = &other.multiple_reporters;
+  globals["total_interchrom"] = &other.total_interchrom;
+  globals["total_validPairs"] = &other.total_validPairs;
+  for (it_targs T=me.targets.begin(); T != me.targets.end(); ++T) {
+    ids[T->name] = T->target_id;
+  }
+
+  other.setup();
+  shard = 0;
+  nshards = 0;
+
+  inf.open( filename.c_str() );
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open file "+filename);
+  }
+
+  while ( getline(inf,line) ) {
+    if ( line.size() == 0 || line[0] == '#' ) {
+      continue;
+    }
+    std::istringstream sline(line);
+    sline>>name;
+
+    if ( name == "shard" ) {
+      sline>>shard>>nshards;
+    } else if ( name == "distance_bins" ) {
+      // the first file sets up the distance bins, the rest must match
+      sline>>bins;
+      if ( bins != me.distance_bins ) {
+	if ( total_read_sets > 0 ) {
+	  throw std::runtime_error("file "+filename+" is from a run with "
+				   "different --distance-bins");
+	}
+	me.set_distance_bins(bins);
+	setup();
+	other.setup();
+      }
+      nbins = me.distance_bins > 0 ? me.distance_edges.size()-1 : 0;
+      bins_given = true;
+    } else if ( name == "capture_matrix" ) {
+      // as for the distance bins
+      sline>>matrix;
+      if ( matrix != me.capture_matrix ) {
+	if ( total_read_sets > 0 ) {
+	  throw std::runtime_error("file "+filename+" is from a run with "
+				   "different --capture-matrix");
+	}
+	me.capture_matrix = matrix;
+      }
+    } else if ( name == "capture" ) {
+      std::string name2;
+      long unsigned int n;
+      sline>>name>>name2>>n;
+      std::map<std::string,int>::const_iterator it = ids.find(name),
+	it2 = ids.find(name2);
+      if ( it == ids.end() || it2 == ids.end() || !me.capture_matrix ) {
+	throw std::runtime_error("bad line in "+filename+" : "+line);
+      }
+      other.capture_pairs[ std::make_pair( std::min(it->second,it2->second),
+					   std::max(it->second,it2->second) )
+			   ] += n;
+    } else if ( name == "distances" ) {
+      sline>>name;
+      std::map<std::string,int>::const_iterator it = ids.find(name);
+      if ( it == ids.end() || nbins == 0 ) {
+	throw std::runtime_error("bad line in "+filename+" : "+line);
+      }
+      for (std::size_t i=0; i<nbins; i++) {
+	sline>>other.distances[ it->second*nbins + i ];
+      }
+      seen_distances[it->second] = 1;
+    } else if ( name == "target" ) {
+      sline>>name;
+      std::map<std::string,int>::const_iterator it = ids.find(name);
+      if ( it == ids.end() ) {
+	throw std::runtime_error("target "+name+" in "+filename+" is not in "
+				 "the targets file");
+      }
+      sline>>other.validPairs[it->second]>>other.onlyInter[it->second]
+	   >>other.within1Mb[it->second]>>other.within5Mb[it->second];
+      seen[it->second] = 1;
+    } else if ( globals.find(name) != globals.end() ) {
+      sline>>*globals[name];
+      nglobals++;
+    } else {
+      throw std::runtime_error("unknown counter "+name+" in "+filename);
+    }
+
+    if ( sline.fail() ) {
+      throw std::runtime_error("bad line in "+filename+" : "+line);
+    }
+  }
+
+  if ( nshards == 0 || nglobals != globals.size() ||
+       std::find(seen.begin(),seen.end(),0) != seen.end() ||
+       ( me.distance_bins > 0 &&
+	 ( !bins_given || std::find(seen_distances.begin(),
+				    seen_distances.end(),0)
+	   != seen_distances.end() ) ) ) {
+    throw std::runtime_error("file "+filename+" is not a complete counters "
+			     "file for these targets");
+  }
+
+  add(other);
+
+}
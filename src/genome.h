@@ -36,6 +36,7 @@ namespace CAPCMAIN_NS {
   struct rest_fragment;
   //struct target;
   struct samfrag;
+  struct sam_references;
 
   
   // Structures
@@ -46,6 +47,7 @@ namespace CAPCMAIN_NS {
     
     int Nchrom,
       Ntargets;
+    unsigned int Nfragments;
     
     std::map<std::string, std::set<rest_fragment> > restriction_fragments;
     typedef std::map<std::string,
@@ -54,21 +56,41 @@ namespace CAPCMAIN_NS {
       std::set<rest_fragment> >::const_iterator const_it_rest_map;
     typedef std::set<rest_fragment>::iterator it_rest_set;
     typedef std::set<rest_fragment>::const_iterator const_it_rest_set;
-	
+
+    // fragments for each reference ID in the SAM/BAM header
+    std::vector<const std::set<rest_fragment>*> ref_chroms;
+
     std::set<target> targets;
     typedef std::set<target>::iterator it_targs;
+    std::vector<it_targs> targets_by_id;   // indexed by target_id
 
     std::map<std::string,int> list_for_duplicates;
 
+    // log-spaced bins of reporter to target distance : bin i covers
+    // distance_edges[i] up to distance_edges[i+1]. Empty if not counted.
+    unsigned int distance_bins;            // bins per decade; 0 means none
+    std::vector<long int> distance_edges;
+
+    // count the read sets holding two or more targets, for each pair of
+    // targets (--capture-matrix)
+    bool capture_matrix;
+
     bool are_targets_loaded,
       are_restfrags_loaded;
 
     void load_targets(const std::string &);
+    void mark_exclusion_zones(const unsigned int &);
     void load_rest_frags(const std::string &);
+    void set_references(const sam_references &);
+    void set_distance_bins(const unsigned int &);
+    std::size_t distance_bin(const long int &) const;
     bool is_duplicate(const std::vector<samfrag> &);
+    static std::string duplicate_key(const std::vector<samfrag> &);
 
     genome() : count(*this) {
       // constructor
+      distance_bins=0;
+      capture_matrix=0;
       are_targets_loaded=0;
       are_restfrags_loaded=0;
     }
@@ -90,21 +112,46 @@ namespace CAPCMAIN_NS {
 	total_interchrom,
 	total_validPairs;
 
-      // per target counters
-      std::map<std::string, long unsigned int> validPairs,
+      // per target counters, indexed by target_id
+      std::vector<long unsigned int> validPairs,
 	onlyInter,
 	within1Mb,
 	within5Mb;
 
+      // pairs in each distance bin, for target t and bin i at
+      // t*nbins+i; empty if distances are not counted
+      std::vector<long unsigned int> distances;
+
+      // read sets holding both of a pair of targets, by their target_ids
+      // (lower first); empty if not counted
+      std::map<std::pair<int,int>,long unsigned int> capture_pairs;
+
+      // set if the run stopped before the end of the input
+      // (--stop-when-saturated), with the fraction of the input read, or
+      // 0 if that is not known (e.g. a pipe)
+      bool stopped_early;
+      double input_read;
+
       // constructor
       counters(genome &g) : me(g) {};
       
       // setup function
       void setup();
+
+      // add counts from another set of counters
+      void add(const counters &);
       
       // outputs
       void output_interchrom(const std::string &) const;
       void output_report(const std::string &) const;
+      void output_distances(const std::string &) const;
+      void output_capture_matrix(const std::string &) const;
+
+      // machine readable counts of one shard of a run, and reading them
+      // back to add up the shards
+      void output_counts(const std::string &, const unsigned int &,
+			 const unsigned int &) const;
+      void add_counts(const std::string &, unsigned int &, unsigned int &);
       
     } count;
     
@@ -0,0 +1,324 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// The Unix domain socket between capCclient and capCdaemon.
+//
+// A job is sent as a header (a tag and the length of the rest) carrying the
+// client's stdin, stdout and stderr as SCM_RIGHTS, followed by the working
+// directory and the arguments, each ended by a nul. The job writes straight
+// to the client's own stdout and stderr; when it is done one byte comes
+// back, its exit status.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "daemon.h"
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <cerrno>
+#include <stdexcept>
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace DAEMON_NS;
+
+
+namespace {
+
+  const char job_tag[8] = {'C','A','P','C','J','O','B','1'};
+  const std::uint32_t max_job_size = 1<<20;
+
+  sockaddr_un socket_address(const std::string &fname) {
+    sockaddr_un addr;
+    std::memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if ( fname.size() >= sizeof(addr.sun_path) ) {
+      throw std::runtime_error("socket name "+fname+" is too long");
+    }
+    std::strcpy(addr.sun_path,fname.c_str());
+    return addr;
+  }
+
+  // room for the file descriptors of a job, aligned for cmsghdr
+  union control_buffer {
+    char buf[CMSG_SPACE(sizeof(job::fds))];
+    cmsghdr align;
+  };
+
+  uid_t peer_uid(const int &fd) {
+    // the user at the other end of a connection
+#ifdef SO_PEERCRED
+    ucred cred;
+    socklen_t len = sizeof(cred);
+    if ( getsockopt(fd,SOL_SOCKET,SO_PEERCRED,&cred,&len) != 0 ) {
+      throw std::runtime_error("cannot tell which user sent the job");
+    }
+    return cred.uid;
+#else
+    uid_t uid;
+    gid_t gid;
+    if ( getpeereid(fd,&uid,&gid) != 0 ) {
+      throw std::runtime_error("cannot tell which user sent the job");
+    }
+    return uid;
+#endif
+  }
+
+  void write_all(const int &fd, const char *buf, std::size_t n) {
+    while ( n > 0 ) {
+      ssize_t w = write(fd,buf,n);
+      if ( w < 0 && errno == EINTR ) {
+	continue;
+      }
+      if ( w <= 0 ) {
+	throw std::runtime_error("lost the connection to capCdaemon");
+      }
+      buf += w;
+      n -= w;
+    }
+  }
+
+  void read_all(const int &fd, char *buf, std::size_t n) {
+    while ( n > 0 ) {
+      ssize_t r = read(fd,buf,n);
+      if ( r < 0 && errno == EINTR ) {
+	continue;
+      }
+      if ( r <= 0 ) {
+	throw std::runtime_error("job was cut short by the client");
+      }
+      buf += r;
+      n -= r;
+    }
+  }
+
+}
+
+
+int DAEMON_NS::listen_socket(const std::string &fname) {
+  // Make the socket the daemon listens on. A socket left behind by a
+  // daemon which is no longer running is replaced.
+
+  sockaddr_un addr = socket_address(fname);
+  struct stat st;
+  int fd;
+
+  if ( stat(fname.c_str(),&st) == 0 ) {
+    if ( !S_ISSOCK(st.st_mode) ) {
+      throw std::runtime_error(fname+" exists and is not a socket (will not "
+			       "overwrite).");
+    }
+    fd = socket(AF_UNIX,SOCK_STREAM,0);
+    if ( fd >= 0 && connect(fd,(sockaddr*)&addr,sizeof(addr)) == 0 ) {
+      close(fd);
+      throw std::runtime_error("a daemon is already listening on "+fname);
+    }
+    if ( fd >= 0 ) {
+      close(fd);
+    }
+    unlink(fname.c_str());
+  }
+
+  fd = socket(AF_UNIX,SOCK_STREAM,0);
+  if ( fd < 0 ) {
+    throw std::runtime_error("cannot make a socket");
+  }
+  // jobs run as the daemon's user, so only it may send them : the socket
+  // is made with no access for others, rather than changed after
+  mode_t mask = umask(077);
+  int bound = bind(fd,(sockaddr*)&addr,sizeof(addr));
+  int bind_errno = errno;
+  umask(mask);
+  if ( bound != 0 ) {
+    close(fd);
+    throw std::runtime_error("cannot make socket "+fname+" : "+
+			     std::strerror(bind_errno));
+  }
+  if ( chmod(fname.c_str(),0600) != 0 ) {
+    close(fd);
+    unlink(fname.c_str());
+    throw std::runtime_error("cannot set the permissions of socket "+fname);
+  }
+  if ( listen(fd,64) != 0 ) {
+    close(fd);
+    unlink(fname.c_str());
+    throw std::runtime_error("cannot listen on socket "+fname);
+  }
+
+  return fd;
+
+}
+
+
+int DAEMON_NS::connect_socket(const std::string &fname) {
+
+  sockaddr_un addr = socket_address(fname);
+  int fd = socket(AF_UNIX,SOCK_STREAM,0);
+
+  if ( fd < 0 ) {
+    throw std::runtime_error("cannot make a socket");
+  }
+  if ( connect(fd,(sockaddr*)&addr,sizeof(addr)) != 0 ) {
+    close(fd);
+    throw std::runtime_error("cannot connect to capCdaemon on "+fname+" : "+
+			     std::strerror(errno));
+  }
+  return fd;
+
+}
+
+
+void DAEMON_NS::send_job(const int &fd, const job &J) {
+
+  std::string body = J.cwd + '\0';
+  for (std::size_t i=0; i<J.args.size(); i++) {
+    body += J.args[i] + '\0';
+  }
+  if ( body.size() > max_job_size ) {
+    throw std::runtime_error("the command line is too long");
+  }
+
+  char head[12];
+  std::uint32_t n = body.size();
+  std::memcpy(head,job_tag,8);
+  for (int i=0; i<4; i++) {
+    head[8+i] = char( (n>>(8*i)) & 0xff );
+  }
+
+  // the header carries the file descriptors
+  iovec iov;
+  iov.iov_base = head;
+  iov.iov_len = sizeof(head);
+  control_buffer control;
+  std::memset(&control,0,sizeof(control));
+  msghdr msg;
+  std::memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  cmsg->cmsg_level = SOL_SOCKET;
+  cmsg->cmsg_type = SCM_RIGHTS;
+  cmsg->cmsg_len = CMSG_LEN(sizeof(J.fds));
+  std::memcpy(CMSG_DATA(cmsg),J.fds,sizeof(J.fds));
+
+  if ( sendmsg(fd,&msg,0) != ssize_t(sizeof(head)) ) {
+    throw std::runtime_error("cannot send the job to capCdaemon");
+  }
+  write_all(fd,body.data(),body.size());
+
+}
+
+
+bool DAEMON_NS::receive_job(const int &fd, job &J) {
+  // false if the client went away without sending anything. Only jobs
+  // from the daemon's own user are taken.
+
+  uid_t uid = peer_uid(fd);
+  if ( uid != getuid() ) {
+    throw std::runtime_error("job from another user (uid "+
+			     std::to_string(uid)+") refused");
+  }
+
+  char head[12];
+  iovec iov;
+  iov.iov_base = head;
+  iov.iov_len = sizeof(head);
+  control_buffer control;
+  msghdr msg;
+  std::memset(&msg,0,sizeof(msg));
+  msg.msg_iov = &iov;
+  msg.msg_iovlen = 1;
+  msg.msg_control = control.buf;
+  msg.msg_controllen = sizeof(control.buf);
+
+  ssize_t r;
+  do {
+    r = recvmsg(fd,&msg,0);
+  } while ( r < 0 && errno == EINTR );
+  if ( r == 0 ) {
+    return false;
+  }
+  cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+  if ( r != ssize_t(sizeof(head)) || std::memcmp(head,job_tag,8) != 0 ||
+       (msg.msg_flags & MSG_CTRUNC) || cmsg == NULL || cmsg->cmsg_level != SOL_SOCKET ||
+       cmsg->cmsg_type != SCM_RIGHTS ||
+       cmsg->cmsg_len != CMSG_LEN(sizeof(J.fds)) ) {
+    throw std::runtime_error("not a job from capCclient");
+  }
+  std::memcpy(J.fds,CMSG_DATA(cmsg),sizeof(J.fds));
+
+  std::uint32_t n = 0;
+  for (int i=0; i<4; i++) {
+    n |= std::uint32_t((unsigned char)head[8+i]) << (8*i);
+  }
+  if ( n > max_job_size ) {
+    throw std::runtime_error("job from capCclient is too long");
+  }
+  std::string body(n,'\0');
+  read_all(fd,&body[0],n);
+
+  // working directory, then the arguments
+  std::size_t start = 0,
+    end;
+  J.args.clear();
+  while ( (end = body.find('\0',start)) != std::string::npos ) {
+    J.args.push_back( body.substr(start,end-start) );
+    start = end+1;
+  }
+  if ( J.args.size() < 2 || start != body.size() ) {
+    throw std::runtime_error("job from capCclient is damaged");
+  }
+  J.cwd = J.args[0];
+  J.args.erase( J.args.begin() );
+  return true;
+
+}
+
+
+void DAEMON_NS::send_status(const int &fd, const int &status) {
+  char c = char(status);
+  write_all(fd,&c,1);
+}
+
+
+int DAEMON_NS::receive_status(const int &fd) {
+  // the job's exit status, or -1 if it ended without one
+  char c;
+  ssize_t r;
+  do {
+    r = read(fd,&c,1);
+  } while ( r < 0 && errno == EINTR );
+  if ( r != 1 ) {
+    return -1;
+  }
+  return (unsigned char)c;
+}
@@ -40,16 +40,20 @@
 
 using namespace LOC2FRAG_NS;
 
-int main(int argc, char *argv[]) {
+int LOC2FRAG_NS::run_loc2frag(int argc, char *argv[],
+			      const CAPCMAIN_NS::genome *loaded) {
+  // the whole of capClocation2fragment, giving its exit status; capCdaemon
+  // passes the genome it holds, whose fragments are then not loaded again
 
   parameters params;
-  std::vector<CAPCMAIN_NS::rest_fragment> locations;
-  std::vector<CAPCMAIN_NS::rest_fragment>  restfrags;
+  std::vector<location> locations;
+  std::vector<location> restfrags;
 
   std::ifstream inf;
   std::ofstream ouf;
 
-  CAPCMAIN_NS::genome gnm;
+  CAPCMAIN_NS::genome own;
+  const CAPCMAIN_NS::genome &gnm = loaded!=NULL ? *loaded : own;
 
   // parse command line
   try {
@@ -64,7 +68,9 @@ int main(int argc, char *argv[]) {
 
   // initialize genome -- load restriction enzyme fragments
   try {
-    gnm.load_rest_frags(params.fragfile);
+    if ( loaded==NULL ) {
+      own.load_rest_frags(params.fragfile);
+    }
   } catch (const std::runtime_error& e) {
     std::cerr<<"ERROR : "<<e.what()<<std::endl;
     return EXIT_FAILURE;
@@ -269,17 +275,16 @@ void LOC2FRAG_NS::parse_loc2frag_command_line(const int &argc,
 }
 
 
-std::vector<CAPCMAIN_NS::rest_fragment
-	 > LOC2FRAG_NS::load_locations(const parameters &params) {
+std::vector<location> LOC2FRAG_NS::load_locations(const parameters &params) {
   // load the list of locations from a bed file
 
-  std::vector<CAPCMAIN_NS::rest_fragment> locs;
+  std::vector<location> locs;
   std::ifstream inf;
   std::string line;
   std::stringstream sline;
   std::string bpss,
     bpee;
-  CAPCMAIN_NS::rest_fragment newloc;
+  location newloc;
 
   inf.open( params.bedfile.c_str() );
   if ( ! inf.good() ) {
@@ -296,8 +301,8 @@ std::vector<CAPCMAIN_NS::rest_fragment
 	   bpee.find_first_not_of("0123456789") != std::string::npos ) {
 	throw std::runtime_error("unreadable entry in bedgraph file");
       }
-      newloc.start=atoi( bpss.c_str() );
-      newloc.end=atoi( bpee.c_str() );
+      newloc.start=CAPCMAIN_NS::string2coord( bpss );
+      newloc.end=CAPCMAIN_NS::string2coord( bpee );
       getline(sline,newloc.restofline);
 
       locs.push_back(newloc);
@@ -310,11 +315,10 @@ std::vector<CAPCMAIN_NS::rest_fragment
 
 }
 
-std::vector<CAPCMAIN_NS::rest_fragment
-	 > LOC2FRAG_NS::locs2frags(const CAPCMAIN_NS::genome &gnm, 
-				   const std::vector<CAPCMAIN_NS::rest_fragment> &loc) {
+std::vector<location> LOC2FRAG_NS::locs2frags(const CAPCMAIN_NS::genome &gnm, 
+					      const std::vector<location> &loc) {
 
-  std::vector<CAPCMAIN_NS::rest_fragment> frags;
+  std::vector<location> frags;
   CAPCMAIN_NS::rest_fragment a_location;
   CAPCMAIN_NS::genome::const_it_rest_map achromosome;
   CAPCMAIN_NS::genome::const_it_rest_set afragment;
@@ -329,7 +333,7 @@ std::vector<CAPCMAIN_NS::rest_fragment
 
     achromosome = gnm.restriction_fragments.find(a_location.chrom);
     if ( achromosome == gnm.restriction_fragments.end() ) {
-      throw std::runtime_error("cannot find chromosome "+a_location.chrom+
+      throw std::runtime_error("cannot find chromosome "+a_location.chrom.str()+
 			       " in the restriction fragments file");
     }
 
@@ -22,17 +22,29 @@
 #ifndef LOCATION2FRAGMENT_H
 #define LOCATION2FRAGMENT_H
 
+#include "bedfiles.h"
+
 #include <string>
 #include <vector>
 
 // Forward declarations
 namespace CAPCMAIN_NS {
   struct genome;
-  struct rest_fragment;
 }
 
 namespace LOC2FRAG_NS {
 
+  struct location : CAPCMAIN_NS::rest_fragment {
+    // a location, or its fragment, with the rest of its line from the
+    // input file
+
+    std::string restofline;
+
+    location() {};
+    location(const CAPCMAIN_NS::rest_fragment &F) : rest_fragment(F) {};
+    
+  };
+
   struct parameters {
 
     std::string fragfile,
@@ -53,13 +65,13 @@ namespace LOC2FRAG_NS {
 
   };
 
+  int run_loc2frag(int, char *[], const CAPCMAIN_NS::genome *);
   void parse_loc2frag_command_line(const int &, char **, parameters &);
 
-  std::vector<CAPCMAIN_NS::rest_fragment
-    > locs2frags(const CAPCMAIN_NS::genome &, 
-		 const std::vector<CAPCMAIN_NS::rest_fragment> &);
+  std::vector<location> locs2frags(const CAPCMAIN_NS::genome &, 
+				   const std::vector<location> &);
 
-  std::vector<CAPCMAIN_NS::rest_fragment> load_locations(const parameters &);
+  std::vector<location> load_locations(const parameters &);
 
 }
 
@@ -42,8 +42,11 @@
 #include "parse_sam.h"
 #include "bedfiles.h"
 #include "messages.h"
+#include "checkpoint.h"
+#include "batch.h"
 
 #include <iostream>
+#include <cstdio>
 #include <cstdlib>
 #include <string>
 #include <sstream>
@@ -56,13 +59,37 @@ parameters::parameters() {
   // constructor for parameters structure
   // set default values here
   exclusion = 500;
+  max_dedup_mem = 0;
+  nthreads = 1;
+  container = false;
+  cpairs = false;
+  pairs_files = true;
+  pileup = false;
+  combine = false;
+  output_mem = 64*1024*1024;
+  flush_interval = 0;
+  sort_pairs = false;
+  checkpoint_every = 0;
+  resume = false;
+  progress_interval = 0;
+  shard = 1;
+  nshards = 1;
+  jobs = 1;
+  distance_bins = 0;
+  capture_matrix = false;
+  multiway = false;
+  stop_saturated = 0;
+  saturated_percent = 100;
 }
 
 
 
-int main(int argc, char *argv[]) {
-  
-  genome gnm;
+int CAPCMAIN_NS::run_capcmain(int argc, char *argv[], genome *loaded) {
+  // the whole of capCmain, giving its exit status; capCdaemon passes the
+  // genome it holds, whose fragments are then not loaded again
+
+  genome own;
+  genome &gnm = loaded!=NULL ? *loaded : own;
   
   filenames fname;
   parameters params;
@@ -83,7 +110,9 @@ int main(int argc, char *argv[]) {
 
   // initialize genome -- load restriction enzyme fragments
   try {
-    gnm.load_rest_frags(fname.restfrags);
+    if ( loaded==NULL ) {
+      gnm.load_rest_frags(fname.restfrags);
+    }
   } catch (const std::runtime_error& e) {
     std::cerr<<"ERROR in main processing stage : "<<e.what()<<std::endl;
     return EXIT_FAILURE;
@@ -98,6 +127,9 @@ int main(int argc, char *argv[]) {
   // initialize targets and set up counters
   try {
     gnm.load_targets(fname.targets);
+    gnm.mark_exclusion_zones(params.exclusion);
+    gnm.set_distance_bins(params.distance_bins);
+    gnm.capture_matrix = params.capture_matrix;
     gnm.count.setup();
   } catch (const std::runtime_error& e) {
     std::cerr<<"ERROR in main processing stage : "<<e.what()<<std::endl;
@@ -110,9 +142,23 @@ int main(int argc, char *argv[]) {
 
 
 
+  // process one sample, or all those in the manifest
+  if ( fname.manifest != "" ) {
+    return run_batch(gnm,fname,params);
+  }
+  return process_sample(gnm,fname.samfile,fname.outfile,params);
+  
+}
+
+
+int CAPCMAIN_NS::process_sample(genome &gnm, const std::string &samfile,
+				const std::string &outfile,
+				const parameters &params) {
+  // parse one SAM file and write its outputs; gives the exit status
+
   // parse SAM file
   try {
-    parse_sam_file(gnm,fname.samfile,fname.outfile,params);
+    parse_sam_file(gnm,samfile,outfile,params);
   } catch (const std::runtime_error& e) {
     std::cerr<<"ERROR in main processing stage : "<<e.what()<<std::endl;
     return EXIT_FAILURE;
@@ -124,10 +170,27 @@ int main(int argc, char *argv[]) {
 
  
   
-  // output counts and report
+  // output counts and report; those of the earlier lanes are replaced
   try {
-    gnm.count.output_interchrom(fname.outfile+"_interactioncounts.dat");
-    gnm.count.output_report(fname.outfile+"_report.dat");
+    if ( params.add_to != "" ) {
+      std::remove( (outfile+"_interactioncounts.dat").c_str() );
+      std::remove( (outfile+"_report.dat").c_str() );
+      std::remove( (outfile+"_counters.dat").c_str() );
+      std::remove( (outfile+"_distances.dat").c_str() );
+      std::remove( (outfile+"_capturematrix.dat").c_str() );
+    }
+    gnm.count.output_interchrom(outfile+"_interactioncounts.dat");
+    gnm.count.output_report(outfile+"_report.dat");
+    if ( params.distance_bins > 0 ) {
+      gnm.count.output_distances(outfile+"_distances.dat");
+    }
+    if ( params.capture_matrix ) {
+      gnm.count.output_capture_matrix(outfile+"_capturematrix.dat");
+    }
+    if ( params.nshards > 1 ) {
+      gnm.count.output_counts(outfile+"_counters.dat",params.shard,
+			      params.nshards);
+    }
   } catch (const std::runtime_error& e) {
     std::cerr<<"ERROR outputing report : "<<e.what()<<std::endl;
     return EXIT_FAILURE;
@@ -138,6 +201,12 @@ int main(int argc, char *argv[]) {
   }
 
 
+  // the run is complete, so the checkpoint is no longer needed
+  if ( params.checkpoint_every > 0 || params.resume ) {
+    std::remove( checkpoint::file_name(outfile).c_str() );
+  }
+
+
   // Done!
   return EXIT_SUCCESS;
   
@@ -150,29 +219,177 @@ void CAPCMAIN_NS::parse_command_line(const int &argc,  char **argv,
 
   const std::string usage_message ="\nUsage :\n"
     "   capCmain -r frag_file -t targ_file -s sam_file -o name [-e N] [-i]\n"
+    "            [-p N] [--max-dedup-mem M] [--scratch dir] [--container]\n"
+    "            [--output-mem M] [--flush-interval S] [--cpairs] [--sort-pairs]\n"
+    "            [--pileup [--combine]] [--no-pairs] [--checkpoint-every N]\n"
+    "            [--resume] [--progress S [--status-file file]] [--shard K/N]\n"
+    "            [--save-state file] [--add-to file] [--distance-bins N]\n"
+    "            [--save-readsets file] [--capture-matrix] [--multiway]\n"
+    "            [--stop-when-saturated N [--saturated-percent P]]\n"
+    "   capCmain -r frag_file -t targ_file -m manifest [-j N] [options as above]\n"
+    "   capCmain -r frag_file -t targ_file --from-readsets file -o name [-e N]\n"
+    "            [-i] [pairs and pile-up options as above]\n"
     "\n"
     "   Required arguments :\n"
     "       -r  frag_file   is a bed file of restriction enzyme fragments genome wide\n"
     "       -t  targ_file   is a bed file of capture targets\n"
-    "       -s  sam_file    is a SAM file containing groups of aligned\n"
-    "                       digested fragments, sorted by name\n"
+    "       -s  sam_file    is a SAM or BAM file containing groups of aligned\n"
+    "                       digested fragments, sorted by name. If sam_file\n"
+    "                       is - then SAM is read from stdin in aligner order\n"
+    "                       (e.g. bowtie --reorder), where the fragments of\n"
+    "                       each read set need only be consecutive\n"
     "       -o  name        is the first part of the output file name\n"
+    "   or\n"
+    "       -m  manifest    is a file listing samples, one per line as a sam_file\n"
+    "                       and a name, to be processed in turn with the same\n"
+    "                       fragments and targets; these are only loaded once\n"
+    "   or\n"
+    "       --from-readsets file\n"
+    "                       classify the read sets saved with --save-readsets\n"
+    "                       by an earlier run, in place of a sam_file. The\n"
+    "                       targets, -e and -i may differ from that run; the\n"
+    "                       frag_file and --shard must be the same.\n"
     "\n"
     "   Options :\n"
     "       -e N            exclusion zone; reporter fragments mapping within N bp of\n"
     "                       a target fragment are discarder. Default N=500.\n"
     "       -i              save interchromosomal. If present, interchomosomal\n"
     "                       interactions will be saved as well as counted.\n"
+    "       -j N            with -m, process N samples at a time. Default N=1.\n"
+    "       -p N            use N threads to parse the SAM file. Output is\n"
+    "                       identical to a single thread run. Default N=1.\n"
+    "       --max-dedup-mem M\n"
+    "                       limit the memory used for duplicate removal to M\n"
+    "                       megabytes. The SAM file is read twice, and keys\n"
+    "                       which do not fit are sorted on disk.\n"
+    "       --scratch dir   directory for temporary files. Default is to put\n"
+    "                       them alongside the output files.\n"
+    "       --container     write the pairs for all targets to one indexed file,\n"
+    "                       name_validpairs.container, instead of a .pairs file\n"
+    "                       for each target. Use capCextractpairs to get the\n"
+    "                       .pairs files back.\n"
+    "       --output-mem M  limit the memory used to buffer pairs output to M\n"
+    "                       megabytes. Default M=64.\n"
+    "       --flush-interval S\n"
+    "                       write out buffered pairs every S seconds, so that\n"
+    "                       the output files can be followed during a run.\n"
+    "                       Default is to write only when buffers are full.\n"
+    "       --cpairs        write compact binary .cpairs files in place of the\n"
+    "                       .pairs files. These can be read by capCpair2bg, or\n"
+    "                       converted to .pairs with capCcpairs2pairs; both\n"
+    "                       need the frag_file.\n"
+    "       --sort-pairs    write the pairs of each target sorted by reporter\n"
+    "                       chromosome and start, in place of input order.\n"
+    "                       Runs of up to half of --output-mem are sorted and\n"
+    "                       merged through scratch files.\n"
+    "       --pileup        also write the raw pile-up bedGraph for each target,\n"
+    "                       as capCpair2bg would make from the pairs files.\n"
+    "       --combine       with --pileup, also write bedGraphs for combined\n"
+    "                       targets : those named X_C1, X_C2, ... are\n"
+    "                       combined as X_combined.\n"
+    "       --no-pairs      do not write pairs files; needs --pileup.\n"
+    "       --checkpoint-every N\n"
+    "                       save the state of the run to name_checkpoint.dat\n"
+    "                       every N read sets, so that it can be resumed if\n"
+    "                       it is stopped. Read sets are then classified by\n"
+    "                       one thread; -p threads still inflate BAM input.\n"
+    "       --resume        carry on a run from name_checkpoint.dat. Use the\n"
+    "                       same arguments as the run which was stopped.\n"
+    "       --save-state file\n"
+    "                       at the end, save the duplicate table, counters and\n"
+    "                       pile-up to file, so that a later lane of the same\n"
+    "                       sample can be added with --add-to.\n"
+    "       --add-to file   add this input, a new lane, to the state saved in\n"
+    "                       file. Duplicates are found across all the lanes,\n"
+    "                       the reports and pile-up are for all of them, and\n"
+    "                       the pairs files of name (which must be those of the\n"
+    "                       run which saved the state) are added to.\n"
+    "       --save-readsets file\n"
+    "                       also save every read set which is mapped and not a\n"
+    "                       duplicate, as the restriction fragments it covers,\n"
+    "                       to file; see --from-readsets.\n"
+    "       --capture-matrix\n"
+    "                       count the read sets holding more than one target\n"
+    "                       (which are otherwise discarded) for each pair of\n"
+    "                       targets, and write them to name_capturematrix.dat.\n"
+    "       --multiway      save the read sets discarded for holding more than\n"
+    "                       one target, or reporters which are not adjacent,\n"
+    "                       to name_multiway.readsets, as the restriction\n"
+    "                       fragments of each (in the --save-readsets format).\n"
+    "       --stop-when-saturated N\n"
+    "                       stop reading the input once every target has N\n"
+    "                       valid intrachromosomal pairs, e.g. for a pilot\n"
+    "                       run. The report also gives the totals expected\n"
+    "                       for the whole input, from how much was read.\n"
+    "                       Read sets are then classified by one thread.\n"
+    "       --saturated-percent P\n"
+    "                       with --stop-when-saturated, stop once P percent\n"
+    "                       of the targets have N pairs. Default P=100.\n"
+    "       --distance-bins N\n"
+    "                       count the intrachromosomal interactions of each\n"
+    "                       target in bins of distance from it, N per factor\n"
+    "                       of 10 from 1 kb (1 to 100), and write them to\n"
+    "                       name_distances.dat.\n"
+    "       --progress S    every S seconds, write the progress so far to\n"
+    "                       stderr : reads per second, how much of the input\n"
+    "                       has been read, an estimated time left, counts so\n"
+    "                       far and memory use.\n"
+    "       --status-file file\n"
+    "                       with --progress, write the progress to file in\n"
+    "                       place of stderr (replaced each time).\n"
+    "       --shard K/N     process only shard K (from 1 to N) of the read sets,\n"
+    "                       so that N runs can share the work. Duplicates\n"
+    "                       always fall in the same shard. Also writes\n"
+    "                       name_counters.dat; use capCmerge to combine the\n"
+    "                       shards.\n"
     "\n";
   
-  std::string exclusion;
+  std::string exclusion,
+    dedupmem,
+    threads,
+    outputmem,
+    flushinterval,
+    checkpointevery,
+    progress,
+    shard,
+    jobs,
+    distancebins,
+    saturated,
+    saturatedpercent;
   unsigned short int narg = 4,       // number of required arguments
     resflag = 0,                     // flags for required arguments
     targflag = 0,
     samflag = 0,
     outflag = 0,
     saveIflag = 0;
-  unsigned short int   excflag = 0;  // flags for optional arguments
+  unsigned short int   excflag = 0,  // flags for optional arguments
+    dedupmemflag = 0,
+    scratchflag = 0,
+    threadflag = 0,
+    containerflag = 0,
+    cpairsflag = 0,
+    sortflag = 0,
+    pileupflag = 0,
+    nopairsflag = 0,
+    combineflag = 0,
+    outputmemflag = 0,
+    flushflag = 0,
+    checkpointflag = 0,
+    resumeflag = 0,
+    progressflag = 0,
+    statusflag = 0,
+    shardflag = 0,
+    saveflag = 0,
+    addflag = 0,
+    savesetsflag = 0,
+    fromsetsflag = 0,
+    saturatedflag = 0,
+    percentflag = 0,
+    matrixflag = 0,
+    multiwayflag = 0,
+    distanceflag = 0,
+    manifestflag = 0,
+    jobsflag = 0;
   
   int argi=1;
 
@@ -214,6 +431,24 @@ void CAPCMAIN_NS::parse_command_line(const int &argc,  char **argv,
       outflag++;
       argi += 2;
       
+    } else if ( std::string(argv[argi]) == "-m" ) {
+      // manifest of samples
+      if (!(argi+1 < argc) || manifestflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      fname.manifest = std::string(argv[argi+1]);
+      manifestflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-j" ) {
+      // number of samples at a time
+      if (!(argi+1 < argc) || jobsflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      jobs = std::string(argv[argi+1]);
+      jobsflag++;
+      argi += 2;
+
     } else if ( std::string(argv[argi]) == "-e" ) {
       // exclusion zone
       if (!(argi+1 < argc) || excflag!=0) {
@@ -231,6 +466,231 @@ void CAPCMAIN_NS::parse_command_line(const int &argc,  char **argv,
       saveIflag++;
       argi ++;
 
+    } else if ( std::string(argv[argi]) == "-p" ) {
+      // number of threads
+      if (!(argi+1 < argc) || threadflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      threads = std::string(argv[argi+1]);
+      threadflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--max-dedup-mem" ) {
+      // memory budget for duplicate removal
+      if (!(argi+1 < argc) || dedupmemflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      dedupmem = std::string(argv[argi+1]);
+      dedupmemflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--scratch" ) {
+      // directory for temporary files
+      if (!(argi+1 < argc) || scratchflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.scratch = std::string(argv[argi+1]);
+      scratchflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--container" ) {
+      // write pairs to a container
+      if ( containerflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.container = true;
+      containerflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--cpairs" ) {
+      // write pairs as cpairs files
+      if ( cpairsflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.cpairs = true;
+      cpairsflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--sort-pairs" ) {
+      // write pairs sorted by reporter
+      if ( sortflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.sort_pairs = true;
+      sortflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--pileup" ) {
+      // write pile-up bedGraphs
+      if ( pileupflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.pileup = true;
+      pileupflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--combine" ) {
+      // pile-ups for combined targets
+      if ( combineflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.combine = true;
+      combineflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--no-pairs" ) {
+      // do not write pairs files
+      if ( nopairsflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.pairs_files = false;
+      nopairsflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--output-mem" ) {
+      // memory budget for buffering output
+      if (!(argi+1 < argc) || outputmemflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      outputmem = std::string(argv[argi+1]);
+      outputmemflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--flush-interval" ) {
+      // time between flushes of output
+      if (!(argi+1 < argc) || flushflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      flushinterval = std::string(argv[argi+1]);
+      flushflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--checkpoint-every" ) {
+      // read sets between checkpoints
+      if (!(argi+1 < argc) || checkpointflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      checkpointevery = std::string(argv[argi+1]);
+      checkpointflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--resume" ) {
+      // carry on from a checkpoint
+      if ( resumeflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.resume = true;
+      resumeflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--progress" ) {
+      // time between heartbeats
+      if (!(argi+1 < argc) || progressflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      progress = std::string(argv[argi+1]);
+      progressflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--status-file" ) {
+      // file for heartbeats
+      if (!(argi+1 < argc) || statusflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.status_file = std::string(argv[argi+1]);
+      statusflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--save-state" ) {
+      // state for adding lanes
+      if (!(argi+1 < argc) || saveflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.save_state = std::string(argv[argi+1]);
+      saveflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--add-to" ) {
+      // add a lane to a saved state
+      if (!(argi+1 < argc) || addflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.add_to = std::string(argv[argi+1]);
+      addflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--save-readsets" ) {
+      // save read sets for classifying again
+      if (!(argi+1 < argc) || savesetsflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.save_readsets = std::string(argv[argi+1]);
+      savesetsflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--from-readsets" ) {
+      // classify saved read sets in place of a SAM file
+      if (!(argi+1 < argc) || fromsetsflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.from_readsets = std::string(argv[argi+1]);
+      fromsetsflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--capture-matrix" ) {
+      // count target pairs
+      if ( matrixflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.capture_matrix = true;
+      matrixflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--multiway" ) {
+      // save multi-way read sets
+      if ( multiwayflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.multiway = true;
+      multiwayflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--stop-when-saturated" ) {
+      // stop once targets have enough pairs
+      if (!(argi+1 < argc) || saturatedflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      saturated = std::string(argv[argi+1]);
+      saturatedflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--saturated-percent" ) {
+      // how many targets must have them
+      if (!(argi+1 < argc) || percentflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      saturatedpercent = std::string(argv[argi+1]);
+      percentflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--distance-bins" ) {
+      // distance histogram
+      if (!(argi+1 < argc) || distanceflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      distancebins = std::string(argv[argi+1]);
+      distanceflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "--shard" ) {
+      // which shard of the read sets to process
+      if (!(argi+1 < argc) || shardflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      shard = std::string(argv[argi+1]);
+      shardflag++;
+      argi += 2;
+
     } else if ( std::string(argv[argi]) == "--version" ) {
       // version -- overrides all other option
       COMMON_NS::print_version();
@@ -243,7 +703,23 @@ void CAPCMAIN_NS::parse_command_line(const int &argc,  char **argv,
     
   }
 
-  // Check required parameters are there
+  // Check required parameters are there; a manifest takes the place of
+  // the SAM file and output name, and saved read sets that of the SAM file
+  if ( fromsetsflag == 1 ) {
+    if ( samflag + manifestflag != 0 ) {
+      throw std::runtime_error("Error parsing command line : option "
+			       "--from-readsets cannot be used with -s or -m");
+    }
+    samflag = 1;
+  }
+  if ( manifestflag == 1 ) {
+    if ( samflag + outflag != 0 ) {
+      throw std::runtime_error("Error parsing command line : option -m "
+			       "cannot be used with -s or -o");
+    }
+    samflag = 1;
+    outflag = 1;
+  }
   if ( resflag + targflag + samflag + outflag != narg ) {
       throw std::runtime_error(usage_message);
   }
@@ -269,5 +745,321 @@ void CAPCMAIN_NS::parse_command_line(const int &argc,  char **argv,
   } else {
     params.save_inter = false;
   }
+
+  if ( dedupmemflag == 1 ) {
+
+    if ( dedupmem.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--max-dedup-mem requires positive integer");
+    }
+    std::istringstream(dedupmem) >> params.max_dedup_mem;
+
+    if ( params.max_dedup_mem < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--max-dedup-mem requires integer >0");
+    }
+    params.max_dedup_mem *= 1024*1024;
+
+  }
+
+  if ( threadflag == 1 ) {
+
+    if ( threads.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option -p "
+				 "requires positive integer");
+    }
+    std::istringstream(threads) >> params.nthreads;
+
+    if ( params.nthreads < 1 ) {
+	throw std::runtime_error("Error parsing command line : option -p "
+				 "requires integer >0");
+    }
+
+  }
+
+  if ( outputmemflag == 1 ) {
+
+    if ( outputmem.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--output-mem requires positive integer");
+    }
+    std::istringstream(outputmem) >> params.output_mem;
+
+    if ( params.output_mem < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--output-mem requires integer >0");
+    }
+    params.output_mem *= 1024*1024;
+
+  }
+
+  if ( flushflag == 1 ) {
+
+    if ( flushinterval.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--flush-interval requires positive integer");
+    }
+    std::istringstream(flushinterval) >> params.flush_interval;
+
+    if ( params.flush_interval < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--flush-interval requires integer >0");
+    }
+
+  }
+
+  if ( checkpointflag == 1 ) {
+
+    if ( checkpointevery.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--checkpoint-every requires positive integer");
+    }
+    std::istringstream(checkpointevery) >> params.checkpoint_every;
+
+    if ( params.checkpoint_every < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--checkpoint-every requires integer >0");
+    }
+
+  }
+
+  if ( progressflag == 1 ) {
+
+    if ( progress.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--progress requires positive integer");
+    }
+    std::istringstream(progress) >> params.progress_interval;
+
+    if ( params.progress_interval < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--progress requires integer >0");
+    }
+
+  }
+
+  if ( distanceflag == 1 ) {
+
+    if ( distancebins.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--distance-bins requires positive integer");
+    }
+    std::istringstream(distancebins) >> params.distance_bins;
+
+    if ( params.distance_bins < 1 || params.distance_bins > 100 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--distance-bins requires integer from 1 "
+				 "to 100");
+    }
+
+  }
+
+  if ( saturatedflag == 1 ) {
+
+    if ( saturated.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--stop-when-saturated requires positive "
+				 "integer");
+    }
+    std::istringstream(saturated) >> params.stop_saturated;
+
+    if ( params.stop_saturated < 1 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--stop-when-saturated requires integer >0");
+    }
+
+  }
+
+  if ( percentflag == 1 ) {
+
+    if ( saturatedpercent.find_first_not_of("0123456789") !=
+	 std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--saturated-percent requires positive "
+				 "integer");
+    }
+    std::istringstream(saturatedpercent) >> params.saturated_percent;
+
+    if ( params.saturated_percent < 1 || params.saturated_percent > 100 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--saturated-percent requires integer from 1 "
+				 "to 100");
+    }
+    if ( saturatedflag == 0 ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--saturated-percent requires "
+				 "--stop-when-saturated");
+    }
+
+  }
+
+  if ( jobsflag == 1 ) {
+
+    if ( jobs.find_first_not_of("0123456789") != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option -j "
+				 "requires positive integer");
+    }
+    std::istringstream(jobs) >> params.jobs;
+
+    if ( params.jobs < 1 ) {
+	throw std::runtime_error("Error parsing command line : option -j "
+				 "requires integer >0");
+    }
+    if ( manifestflag == 0 ) {
+	throw std::runtime_error("Error parsing command line : option -j "
+				 "requires -m");
+    }
+
+  }
+
+  if ( manifestflag == 1 && statusflag == 1 ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--status-file cannot be used with -m");
+  }
+
+  if ( statusflag == 1 && progressflag == 0 ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--status-file requires --progress");
+  }
+
+  if ( shardflag == 1 ) {
+
+    std::size_t slash = shard.find('/');
+    if ( slash == std::string::npos || slash == 0 || slash+1 == shard.size() ||
+	 shard.find_first_not_of("0123456789/") != std::string::npos ||
+	 shard.find('/',slash+1) != std::string::npos ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--shard requires K/N");
+    }
+    std::istringstream(shard.substr(0,slash)) >> params.shard;
+    std::istringstream(shard.substr(slash+1)) >> params.nshards;
+
+    if ( params.nshards < 1 || params.shard < 1 ||
+	 params.shard > params.nshards ) {
+	throw std::runtime_error("Error parsing command line : option "
+				 "--shard requires 1 <= K <= N");
+    }
+
+  }
+
+  if ( params.container && params.cpairs ) {
+    throw std::runtime_error("Error parsing command line : options "
+			     "--container and --cpairs cannot be used together");
+  }
+
+  if ( params.combine && !params.pileup ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--combine requires --pileup");
+  }
+
+  if ( !params.pairs_files && !params.pileup ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--no-pairs requires --pileup");
+  }
+
+  if ( !params.pairs_files && ( params.container || params.cpairs ) ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--no-pairs cannot be used with --container or "
+			     "--cpairs");
+  }
+
+  if ( params.sort_pairs ) {
+    if ( !params.pairs_files ) {
+      throw std::runtime_error("Error parsing command line : options "
+			       "--sort-pairs and --no-pairs cannot be used "
+			       "together");
+    }
+    if ( params.flush_interval > 0 ) {
+      throw std::runtime_error("Error parsing command line : options "
+			       "--sort-pairs and --flush-interval cannot be "
+			       "used together");
+    }
+    if ( params.checkpoint_every > 0 || params.resume ||
+	 saveflag + addflag > 0 ) {
+      throw std::runtime_error("Error parsing command line : option "
+			       "--sort-pairs cannot be used with "
+			       "--checkpoint-every, --resume, --save-state or "
+			       "--add-to");
+    }
+  }
+
+  if ( ( params.checkpoint_every > 0 || params.resume ) &&
+       ( params.container || params.cpairs ) ) {
+    throw std::runtime_error("Error parsing command line : options "
+			     "--checkpoint-every and --resume cannot be used "
+			     "with --container or --cpairs");
+  }
+
+  if ( saveflag + addflag > 0 ) {
+    if ( params.container || params.cpairs ) {
+      throw std::runtime_error("Error parsing command line : options "
+			       "--save-state and --add-to cannot be used "
+			       "with --container or --cpairs");
+    }
+    if ( params.max_dedup_mem > 0 ) {
+      throw std::runtime_error("Error parsing command line : options "
+			       "--save-state and --add-to cannot be used "
+			       "with --max-dedup-mem");
+    }
+    if ( manifestflag == 1 ) {
+      throw std::runtime_error("Error parsing command line : options "
+			       "--save-state and --add-to cannot be used "
+			       "with -m");
+    }
+  }
+
+  if ( addflag == 1 && ( params.checkpoint_every > 0 || params.resume ) ) {
+    throw std::runtime_error("Error parsing command line : option --add-to "
+			     "cannot be used with --checkpoint-every or "
+			     "--resume");
+  }
+
+  if ( params.nthreads > 1 && params.max_dedup_mem > 0 ) {
+    throw std::runtime_error("Error parsing command line : options -p and "
+			     "--max-dedup-mem cannot be used together");
+  }
+
+  if ( savesetsflag == 1 ) {
+    if ( manifestflag + fromsetsflag > 0 ) {
+      throw std::runtime_error("Error parsing command line : option "
+			       "--save-readsets cannot be used with -m or "
+			       "--from-readsets");
+    }
+    if ( params.checkpoint_every > 0 || params.resume ||
+	 saveflag + addflag > 0 ) {
+      throw std::runtime_error("Error parsing command line : option "
+			       "--save-readsets cannot be used with "
+			       "--checkpoint-every, --resume, --save-state or "
+			       "--add-to");
+    }
+  }
+
+  if ( params.multiway &&
+       ( params.checkpoint_every > 0 || params.resume ||
+	 saveflag + addflag > 0 ) ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--multiway cannot be used with "
+			     "--checkpoint-every, --resume, --save-state or "
+			     "--add-to");
+  }
+
+  if ( saturatedflag == 1 &&
+       ( params.checkpoint_every > 0 || params.resume || params.nshards > 1 ||
+	 saveflag + addflag + savesetsflag + fromsetsflag > 0 ) ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--stop-when-saturated cannot be used with "
+			     "--checkpoint-every, --resume, --shard, "
+			     "--save-state, --add-to, --save-readsets or "
+			     "--from-readsets");
+  }
+
+  if ( fromsetsflag == 1 &&
+       ( threadflag + dedupmemflag + progressflag + saveflag + addflag > 0 ||
+	 params.checkpoint_every > 0 || params.resume ) ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--from-readsets cannot be used with -p, "
+			     "--max-dedup-mem, --progress, --checkpoint-every, "
+			     "--resume, --save-state or --add-to");
+  }
   
 }
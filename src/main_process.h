@@ -31,7 +31,8 @@ namespace CAPCMAIN_NS {
     std::string restfrags,
       targets,
       samfile,
-      outfile;
+      outfile,
+      manifest;     // samples to process, in place of samfile and outfile
   };
 
   struct parameters {
@@ -40,11 +41,69 @@ namespace CAPCMAIN_NS {
 
     bool save_inter; // flag for if interchromosomal interactions are saved
 
+    unsigned long int max_dedup_mem; // memory budget for removing duplicates
+                                     // in bytes; 0 means no limit
+    std::string scratch;             // directory for temporary files
+
+    unsigned int nthreads;           // number of threads for parsing
+
+    bool container;                  // write pairs to one container file
+    bool cpairs;                     // write pairs as .cpairs files
+    bool pairs_files;                // write pairs at all
+    bool pileup;                     // write raw pile-up bedGraphs
+    bool combine;                    // and for combined targets
+
+    unsigned long int output_mem;    // memory for buffering pairs output,
+                                     // in bytes
+    unsigned int flush_interval;     // seconds between flushes of pairs
+                                     // output; 0 means only when full
+    bool sort_pairs;                 // write pairs sorted by reporter
+
+    unsigned long int checkpoint_every; // read sets between checkpoints;
+                                        // 0 means none
+    bool resume;                        // carry on from a checkpoint
+
+    std::string save_state,             // save the state at the end here
+      add_to;                           // add this input to a saved state
+
+    std::string save_readsets,          // save the read sets here
+      from_readsets;                    // classify these in place of a SAM
+                                        // file
+
+    unsigned int progress_interval;     // seconds between heartbeats;
+                                        // 0 means none
+    std::string status_file;            // heartbeat to this file rather
+                                        // than stderr
+
+    unsigned int shard,                 // this run is shard K (from 1)
+      nshards;                          // of N; 1 means no sharding
+
+    unsigned int jobs;                  // samples processed at a time
+
+    unsigned int distance_bins;         // distance histogram bins per
+                                        // decade; 0 means none
+
+    bool capture_matrix;                // count target pairs in read sets
+                                        // with several targets
+    bool multiway;                      // save read sets with several
+                                        // targets or reporters
+
+    unsigned long int stop_saturated;   // stop once targets have this many
+                                        // valid pairs; 0 means never
+    unsigned int saturated_percent;     // percent of targets which must
+                                        // have them
+
     parameters();
     
   };
   
+  // Forward Declarations
+  struct genome;
+
+  int run_capcmain(int, char *[], genome *);
   void parse_command_line(const int &, char **, filenames &, parameters &);
+  int process_sample(genome &, const std::string &, const std::string &,
+		     const parameters &);
   
 }
 
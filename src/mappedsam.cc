@@ -0,0 +1,153 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "mappedsam.h"
+
+#include <string>
+#include <cstring>
+#include <stdexcept>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+using namespace CAPCMAIN_NS;
+
+
+mapped_samfile::mapped_samfile(const std::string &filename) {
+  // map the file and find the end of the header
+
+  struct stat sb;
+  int fd;
+
+  fd = open( filename.c_str(), O_RDONLY );
+  if ( fd < 0 ) {
+    throw std::runtime_error("cannot open file "+filename+".");
+  }
+  if ( fstat(fd,&sb) != 0 || !S_ISREG(sb.st_mode) ) {
+    close(fd);
+    throw std::runtime_error("file "+filename+" is not a regular file and "
+			     "cannot be split between threads.");
+  }
+  size = sb.st_size;
+  if ( size == 0 ) {
+    close(fd);
+    throw std::runtime_error("samfile does not contain any entries");
+  }
+
+  void *p = mmap( NULL, size, PROT_READ, MAP_PRIVATE, fd, 0 );
+  close(fd);
+  if ( p == MAP_FAILED ) {
+    throw std::runtime_error("cannot map file "+filename+" into memory.");
+  }
+  data = static_cast<const char*>(p);
+  madvise( p, size, MADV_SEQUENTIAL );
+
+  // read the reference names from the header
+  body = 0;
+  while ( body < size && data[body] == '@' ) {
+    refs.add_header_line( std::string_view(data+body, line_end(body)-body) );
+    body = next_line(body);
+  }
+  if ( body >= size ) {
+    munmap( const_cast<char*>(data), size );
+    throw std::runtime_error("samfile does not contain any entries");
+  }
+
+}
+
+
+bool mapped_samfile::can_map(const std::string &filename) {
+  // only regular files can be mapped; pipes must be read in order
+  struct stat sb;
+  return stat( filename.c_str(), &sb ) == 0 && S_ISREG(sb.st_mode);
+}
+
+
+mapped_samfile::~mapped_samfile() {
+  munmap( const_cast<char*>(data), size );
+}
+
+
+std::size_t mapped_samfile::line_end(const std::size_t &pos) const {
+  // position of the newline ending the line containing pos (or size)
+  const void *nl = std::memchr( data+pos, '\n', size-pos );
+  if ( nl == NULL ) {
+    return size;
+  }
+  return static_cast<const char*>(nl) - data;
+}
+
+
+std::size_t mapped_samfile::next_line(const std::size_t &pos) const {
+  // start of the line after the one containing pos
+  std::size_t e = line_end(pos);
+  return e < size ? e+1 : size;
+}
+
+
+std::string_view mapped_samfile::setname_at(const std::size_t &pos) const {
+  // read set name of the line starting at pos
+  const void *tab = std::memchr( data+pos, '\t', line_end(pos)-pos );
+  std::size_t e = tab ? static_cast<const char*>(tab)-data : line_end(pos);
+  std::string_view name(data+pos, e-pos);
+  return name.substr( 0, name.find("DIGEST") );
+}
+
+
+std::size_t mapped_samfile::snap(const std::size_t &pos) const {
+  // move pos forward to the first line of a read set. Any two calls with
+  // the same pos give the same answer, so neighbouring ranges agree on
+  // where their shared boundary is.
+
+  std::size_t p,
+    prev;
+  std::string_view prevname;
+
+  if ( pos <= body ) {
+    return body;
+  }
+  if ( pos >= size ) {
+    return size;
+  }
+
+  // start of the first line beginning at or after pos
+  p = data[pos-1]=='\n' ? pos : next_line(pos);
+  if ( p >= size ) {
+    return size;
+  }
+
+  // the line before p
+  prev = p-1;
+  while ( prev > body && data[prev-1] != '\n' ) {
+    prev--;
+  }
+  prevname = setname_at(prev);
+
+  while ( p < size && setname_at(p) == prevname ) {
+    p = next_line(p);
+  }
+
+  return p;
+
+}
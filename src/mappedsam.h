@@ -0,0 +1,58 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef MAPPEDSAM_H
+#define MAPPEDSAM_H
+
+#include "samfragments.h"
+
+#include <string>
+#include <string_view>
+#include <cstddef>
+
+namespace CAPCMAIN_NS {
+
+  struct mapped_samfile {
+    // A SAM file mapped into memory. The alignments can be split into byte
+    // ranges which always start and end on a read set boundary, so that
+    // the ranges can be processed independently.
+
+    const char *data;
+    std::size_t size,
+      body;             // offset of the first line after the header
+    sam_references refs;
+
+    mapped_samfile(const std::string &);
+    ~mapped_samfile();
+
+    static bool can_map(const std::string &);
+
+    std::size_t next_line(const std::size_t &) const;
+    std::size_t line_end(const std::size_t &) const;
+    std::string_view setname_at(const std::size_t &) const;
+    std::size_t snap(const std::size_t &) const;
+
+  };
+
+}
+
+#endif
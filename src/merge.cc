@@ -0,0 +1,409 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+///////////////////////////////////////////////////////////////////////////////
+//
+// Program which combines the shards of a capCmain run (capCmain --shard
+// K/N) into the outputs of a single run : the report and interaction
+// counts, the pairs files, and the raw pile-up bedGraphs.
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "merge.h"
+#include "genome.h"
+#include "bedfiles.h"
+#include "targets.h"
+#include "pileup.h"
+#include "messages.h"
+
+#include<string>
+#include<vector>
+#include<iostream>
+#include<fstream>
+#include<sstream>
+#include<stdexcept>
+#include<cstdlib>
+
+using namespace MERGE_NS;
+
+int main(int argc, char *argv[]) {
+
+  parameters params;
+  CAPCMAIN_NS::genome gnm;
+
+  // parse command line
+  try {
+    parse_merge_command_line(argc,argv,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR merging shards : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // load the fragments and targets, and add up the counters
+  try {
+    gnm.load_rest_frags(params.fragfile);
+    gnm.load_targets(params.targetfile);
+    gnm.count.setup();
+    merge_counters(gnm,params);
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR merging shards : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR merging shards : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // combine the pairs files and pile-ups
+  try {
+    if ( params.pairs_files ) {
+      merge_pairs(gnm,params);
+    }
+    if ( params.pileup ) {
+      merge_pileups(gnm,params);
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR merging shards : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR merging shards : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // output counts and report
+  try {
+    gnm.count.output_interchrom(params.outprefix+"_interactioncounts.dat");
+    gnm.count.output_report(params.outprefix+"_report.dat");
+    if ( gnm.distance_bins > 0 ) {
+      gnm.count.output_distances(params.outprefix+"_distances.dat");
+    }
+    if ( gnm.capture_matrix ) {
+      gnm.count.output_capture_matrix(params.outprefix+"_capturematrix.dat");
+    }
+  } catch (const std::runtime_error& e) {
+    std::cerr<<"ERROR outputing report : "<<e.what()<<std::endl;
+    return EXIT_FAILURE;
+  } catch (...) {
+    std::cerr<<"ERROR merging shards : An unknown error has occured."<<std::endl;
+    return EXIT_FAILURE;
+  }
+
+  // Done!
+  return EXIT_SUCCESS;
+
+}
+
+
+
+void MERGE_NS::parse_merge_command_line(const int &argc, char **argv,
+					parameters &params) {
+  // parse the command line
+
+  const std::string usage_message ="\nUsage :\n"
+    "   capCmerge -r frag_file -t targ_file -o name [-i] [--pileup [--combine]]\n"
+    "             [--no-pairs] shard_name [shard_name ...]\n"
+    "\n"
+    "   Required arguments :\n"
+    "       -r  frag_file     is the bed file of restriction enzyme fragments\n"
+    "                         given to capCmain\n"
+    "       -t  targ_file     is the bed file of capture targets given to capCmain\n"
+    "       -o  name          is the first part of the output file names\n"
+    "       shard_name ...    are the -o names of the capCmain --shard K/N runs;\n"
+    "                         all N shards must be given\n"
+    "  Options  :\n"
+    "       -i                also combine the interchromosomal pairs files (and\n"
+    "                         pile-ups), as written by capCmain -i\n"
+    "       --pileup          combine the raw pile-up bedGraphs, as written by\n"
+    "                         capCmain --pileup\n"
+    "       --combine         with --pileup, also write bedGraphs for combined\n"
+    "                         targets, as capCmain --combine\n"
+    "       --no-pairs        do not combine the pairs files\n"
+    "\n";
+
+  unsigned short int rflag = 0,  // flags for arguments
+    tflag = 0,
+    oflag = 0,
+    iflag = 0,
+    pileupflag = 0,
+    combineflag = 0,
+    nopairsflag = 0;
+
+  int argi=1;
+
+  params.save_inter = false;
+  params.pairs_files = true;
+  params.pileup = false;
+  params.combine = false;
+
+  while (argi < argc) {
+
+    if ( std::string(argv[argi]) == "-r" ) {
+      // restriction fragments file
+      if (!(argi+1 < argc) || rflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.fragfile = std::string(argv[argi+1]);
+      rflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-t" ) {
+      // targets file
+      if (!(argi+1 < argc) || tflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.targetfile = std::string(argv[argi+1]);
+      tflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-o" ) {
+      // output file prefix
+      if (!(argi+1 < argc) || oflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.outprefix = std::string(argv[argi+1]);
+      oflag++;
+      argi += 2;
+
+    } else if ( std::string(argv[argi]) == "-i" ) {
+      // interchromosomal files
+      if ( iflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.save_inter = true;
+      iflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--pileup" ) {
+      // pile-up bedGraphs
+      if ( pileupflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.pileup = true;
+      pileupflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--combine" ) {
+      // pile-ups for combined targets
+      if ( combineflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.combine = true;
+      combineflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--no-pairs" ) {
+      // no pairs files
+      if ( nopairsflag!=0 ) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.pairs_files = false;
+      nopairsflag++;
+      argi ++;
+
+    } else if ( std::string(argv[argi]) == "--version" ) {
+      // version -- overrides all other option
+      COMMON_NS::print_version();
+      std::exit(EXIT_SUCCESS);
+
+    } else if ( argv[argi][0] == '-' ) {
+      throw std::runtime_error("Unknown option "+std::string(argv[argi])+"\n"+usage_message);
+
+    } else {
+      // a shard
+      params.shards.push_back( std::string(argv[argi]) );
+      argi ++;
+    }
+
+  }
+
+  // Check required parameters are there
+  if ( rflag!=1 || tflag!=1 || oflag!=1 || params.shards.size()==0 ) {
+      throw std::runtime_error(usage_message);
+  }
+
+  if ( params.combine && !params.pileup ) {
+    throw std::runtime_error("Error parsing command line : option "
+			     "--combine requires --pileup");
+  }
+
+}
+
+
+void MERGE_NS::check_new_file(const std::string &fname) {
+  // make sure an output file does not exist already
+
+  std::ifstream inf( fname.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+fname+" already exists (will not "
+			     "overwrite).");
+  }
+
+}
+
+
+void MERGE_NS::merge_counters(CAPCMAIN_NS::genome &gnm,
+			      const parameters &params) {
+  // add up the counters of all the shards, checking that each of the N
+  // shards is there once
+
+  unsigned int shard,
+    nshards;
+  std::vector<char> seen;
+
+  for (std::size_t s=0; s<params.shards.size(); s++) {
+    gnm.count.add_counts(params.shards[s]+"_counters.dat",shard,nshards);
+    if ( seen.size() == 0 ) {
+      seen.assign(nshards,0);
+    }
+    if ( nshards != seen.size() || shard < 1 || shard > nshards ) {
+      throw std::runtime_error("shard "+params.shards[s]+" is from a run "
+			       "with a different number of shards");
+    }
+    if ( seen[shard-1] ) {
+      throw std::runtime_error("shard "+params.shards[s]+" is a repeat of "
+			       "an earlier shard");
+    }
+    seen[shard-1] = 1;
+  }
+
+  if ( params.shards.size() != seen.size() ) {
+    std::stringstream msg;
+    msg<<"only "<<params.shards.size()<<" of "<<seen.size()<<" shards given";
+    throw std::runtime_error(msg.str());
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Added up the counters from "<<seen.size()<<" shards";
+  COMMON_NS::message( mymessage.str() );
+
+}
+
+
+void MERGE_NS::merge_pairs(const CAPCMAIN_NS::genome &gnm,
+			   const parameters &params) {
+  // Each target's pairs files are the shards' files one after the other.
+  // This gives the same pairs as a single run, though not in the same
+  // order (which does not change the pile-up).
+
+  using namespace CAPCMAIN_NS;
+
+  std::ifstream inf;
+  std::ofstream ouf;
+  std::string fname,
+    part;
+  std::size_t nfiles = 0;
+
+  for (int k=0; k <= ( params.save_inter ? 1 : 0 ); k++) {
+    for ( genome::it_targs T=gnm.targets.begin(); T != gnm.targets.end(); ++T ) {
+      part = ( k == 0 ? "_validpairs_" : "_validinterchom_" ) + T->name.str()
+	+ ".pairs";
+      fname = params.outprefix + part;
+      check_new_file(fname);
+
+      ouf.open( fname.c_str() );
+      for (std::size_t s=0; s<params.shards.size(); s++) {
+	inf.open( (params.shards[s]+part).c_str() );
+	if ( !inf.good() ) {
+	  throw std::runtime_error("cannot open file "+params.shards[s]+part);
+	}
+	if ( inf.peek() != std::ifstream::traits_type::eof() ) {
+	  ouf<<inf.rdbuf();
+	}
+	inf.close();
+      }
+      ouf.close();
+      if ( ouf.fail() ) {
+	throw std::runtime_error("error writing to file "+fname);
+      }
+      nfiles++;
+    }
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Combined "<<nfiles<<" pairs files";
+  COMMON_NS::message( mymessage.str() );
+
+}
+
+
+void MERGE_NS::merge_pileups(const CAPCMAIN_NS::genome &gnm,
+			     const parameters &params) {
+  // Add up the shards' pile-ups for each target by fragment, then write
+  // them out exactly as a single run would have
+
+  using namespace CAPCMAIN_NS;
+
+  pileup_counts pileup;
+  std::vector<std::string> names;
+  std::ifstream inf;
+  std::string fname,
+    line;
+  bed_feature B;
+  unsigned long int value;
+
+  names = pileup_counts::output_files(gnm,params.outprefix,params.save_inter,
+				      params.combine);
+  for (std::size_t i=0; i<names.size(); i++) {
+    check_new_file(names[i]);
+  }
+
+  pileup.setup(gnm,params.save_inter,params.combine);
+
+  for (std::size_t s=0; s<params.shards.size(); s++) {
+    for (int k=0; k <= ( params.save_inter ? 1 : 0 ); k++) {
+      for (std::size_t t=0; t<gnm.targets_by_id.size(); t++) {
+	fname = params.shards[s] + ( k == 0 ? "_rawpileup_" :
+				     "_rawpileup_interchom_" )
+	  + gnm.targets_by_id[t]->name.str() + ".bdg";
+	pileup_counts::fragment_counts &counts = k == 0 ?
+	  pileup.intra[t] : pileup.inter[t];
+
+	inf.open( fname.c_str() );
+	if ( !inf.good() ) {
+	  throw std::runtime_error("cannot open file "+fname);
+	}
+	while ( getline(inf,line) ) {
+	  if ( line.size() == 0 || line.compare(0,5,"track") == 0 ) {
+	    continue;
+	  }
+	  std::istringstream sline(line);
+	  sline>>B.chrom>>B.start>>B.end>>value;
+	  genome::const_it_rest_map C = gnm.restriction_fragments.find(B.chrom);
+	  genome::const_it_rest_set F;
+	  if ( sline.fail() || C == gnm.restriction_fragments.end() ||
+	       ( F = C->second.find( rest_fragment(B) ) ) == C->second.end() ||
+	       F->end != B.end ) {
+	    throw std::runtime_error("line in "+fname+" is not a restriction "
+				     "fragment : "+line);
+	  }
+	  counts[F->fragment_id] += value;
+	}
+	inf.close();
+      }
+    }
+  }
+
+  pileup.output(gnm,params.outprefix);
+
+}
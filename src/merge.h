@@ -0,0 +1,58 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef MERGE_H
+#define MERGE_H
+
+#include <string>
+#include <vector>
+
+// Forward declarations
+namespace CAPCMAIN_NS {
+  struct genome;
+}
+
+namespace MERGE_NS {
+
+  struct parameters {
+
+    std::string fragfile,
+      targetfile,
+      outprefix;
+    std::vector<std::string> shards;    // output names of the shard runs
+
+    bool save_inter,
+      pairs_files,
+      pileup,
+      combine;
+
+  };
+
+  void parse_merge_command_line(const int &, char **, parameters &);
+  void merge_counters(CAPCMAIN_NS::genome &, const parameters &);
+  void merge_pairs(const CAPCMAIN_NS::genome &, const parameters &);
+  void merge_pileups(const CAPCMAIN_NS::genome &, const parameters &);
+  void check_new_file(const std::string &);
+
+}
+
+#endif
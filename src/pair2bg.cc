@@ -30,6 +30,7 @@
 #include "postprocess.h"
 #include "bedfiles.h"
 #include "messages.h"
+#include "cpairs.h"
 
 #include<string>
 #include<iostream>
@@ -37,9 +38,32 @@
 #include<stdexcept>
 #include<cstdlib>
 #include<map>
+#include<vector>
+#include<cstdint>
+#include<cstdio>
 
 using namespace POSTPROCESS_NS;
 
+
+namespace {
+
+  void write_header(std::ofstream &ouf, const parameters &params) {
+    // output a header line
+    ouf<<"track type=bedGraph name=\""<<params.targetname<<"\" description=\""
+       <<"Target: "<<params.targetname;
+    if ( params.location.size() > 1 ) {
+      ouf<<" at locations";
+    } else {
+      ouf<<" at location";
+    }
+    for (std::size_t L=0;L<params.location.size();L++) {
+      ouf<<" "<<params.location[L];
+    }
+    ouf<<"\""<<std::endl;
+  }
+
+}
+
 int main(int argc, char *argv[]) {
 
   parameters params;
@@ -80,6 +104,7 @@ void POSTPROCESS_NS::parse_pair2bg_command_line(const int &argc, char **argv,
 
  const std::string usage_message ="\nUsage :\n"
    "   capCpair2bg -i pairsfile -o bgfile -n targetname -t chr:start-end [--interchrom]\n"
+   "               [-r frag_file]\n"
    "\n"
    "   Required arguments :\n"
    "       -i  pairfile       is the input file name; can use this option more\n"
@@ -91,6 +116,8 @@ void POSTPROCESS_NS::parse_pair2bg_command_line(const int &argc, char **argv,
    "                          files are specified.\n"
    "  Options  :\n"
    "       --interchrom       flag to specify interchromosomal interactions are present\n"
+   "       -r  frag_file      is the bed file of restriction fragments which was given\n"
+   "                          to capCmain; needed if any input is a .cpairs file\n"
    "\n";
  
   unsigned short int infcount = 0,  // flags for required arguments
@@ -98,7 +125,8 @@ void POSTPROCESS_NS::parse_pair2bg_command_line(const int &argc, char **argv,
     nameflag = 0,
     oflag= 0;
   
-  unsigned short int flagichrom = 0;  // flags for required arguments
+  unsigned short int flagichrom = 0,  // flags for optional arguments
+    fragflag = 0;
 
   int argi=1;
   
@@ -140,6 +168,15 @@ void POSTPROCESS_NS::parse_pair2bg_command_line(const int &argc, char **argv,
       loccount++;
       argi += 2;
 
+    } else if ( std::string(argv[argi]) == "-r" ) {
+      // restriction fragments file
+      if (!(argi+1 < argc) || fragflag!=0) {
+	throw std::runtime_error("Error parsing command line.\n"+usage_message);
+      }
+      params.fragfile = std::string(argv[argi+1]);
+      fragflag++;
+      argi += 2;
+
     } else if ( std::string(argv[argi]) == "--interchrom" ) {
       // are interchromosomal interactions present
       if (!(argi < argc)) {
@@ -209,6 +246,10 @@ void POSTPROCESS_NS::do_pileup(const parameters &params) {
   std::ifstream inf;
   std::ofstream ouf;
   std::string line;
+
+  CAPCMAIN_NS::fragment_table frags;     // loaded if there are cpairs files
+  std::vector<unsigned int> counts;      // by fragment ID, from cpairs files
+  std::vector<std::uint32_t> ids;
   
   // have a pilup for each chromosome
   for (parameters::itchrom C=params.chrom.begin() ; C!=params.chrom.end() ;
@@ -233,8 +274,39 @@ void POSTPROCESS_NS::do_pileup(const parameters &params) {
   }
   
   
+  // a sorted pairs file needs no pile-up held in memory
+  if ( params.infile.size() == 1 &&
+       !CAPCMAIN_NS::is_cpairs(params.infile[0]) &&
+       stream_sorted_pileup(params) ) {
+    return;
+  }
+
   // loop round input files
   for (int F=0; F<params.infile.size(); F++) {
+
+    if ( CAPCMAIN_NS::is_cpairs(params.infile[F]) ) {
+      // binary file : count by fragment ID, added to the pile-up below
+      CAPCMAIN_NS::cpairs_reader cpairs(params.infile[F]);
+      if ( counts.empty() ) {
+	if ( params.fragfile == "" ) {
+	  throw std::runtime_error("the restriction fragments file (option -r)"
+				   " is needed to read "+params.infile[F]);
+	}
+	frags.load(params.fragfile);
+	counts.assign( frags.starts.size(), 0 );
+      }
+      frags.check(cpairs.header,params.infile[F]);
+      while ( cpairs.read_block(ids) ) {
+	for (std::size_t i=0; i<ids.size(); i++) {
+	  if ( ids[i] >= counts.size() ) {
+	    throw std::runtime_error("corrupt block in cpairs file "
+				     +params.infile[F]);
+	  }
+	  counts[ ids[i] ]++;
+	}
+      }
+      continue;
+    }
     
     // open file
     inf.open( params.infile[F].c_str() );
@@ -259,23 +331,30 @@ void POSTPROCESS_NS::do_pileup(const parameters &params) {
     inf.close();
     
   }
+
+  // add the counts from cpairs files
+  for (std::size_t id=0; id<counts.size(); id++) {
+    if ( counts[id] == 0 ) {
+      continue;
+    }
+    const std::string &chrom = frags.chroms[ frags.chrom_of[id] ];
+    itpileup = pileup.find( chrom );
+    if ( itpileup == pileup.end() ) {
+      if ( !params.interchromflag ) {
+	throw std::runtime_error("interchromosomal interaction in pairs file");
+      }
+      itpileup = pileup.insert( std::make_pair( chrom,
+	std::map<CAPCMAIN_NS::rest_fragment,unsigned int>() ) ).first;
+    }
+    itpileup->second[ CAPCMAIN_NS::rest_fragment(chrom,frags.starts[id],
+						 frags.ends[id]) ]
+      += counts[id];
+  }
   
   
   // output bedgraph
   ouf.open( params.outfile.c_str() );
-  
-  // output a header line
-  ouf<<"track type=bedGraph name=\""<<params.targetname<<"\" description=\""
-     <<"Target: "<<params.targetname;
-  if ( params.location.size() > 1 ) {
-    ouf<<" at locations";
-  } else {
-    ouf<<" at location";
-  }
-  for (int L=0;L<params.location.size();L++) {
-    ouf<<" "<<params.location[L];
-  }
-  ouf<<"\""<<std::endl;
+  write_header(ouf,params);
     
   // now output pilups
   for (itpileup=pileup.begin() ; itpileup!=pileup.end() ; ++itpileup) {
@@ -296,3 +375,65 @@ void POSTPROCESS_NS::do_pileup(const parameters &params) {
   
   
 }
+
+
+bool POSTPROCESS_NS::stream_sorted_pileup(const parameters &params) {
+  // With one .pairs file sorted by chromosome and start (as written by
+  // capCmain --sort-pairs) the pile-up is counted in one pass, holding
+  // only the current fragment. Gives false, leaving no output file, if
+  // the file turns out not to be sorted.
+
+  std::ifstream inf;
+  std::ofstream ouf;
+  std::string line;
+  CAPCMAIN_NS::bed_feature current;
+  unsigned int count = 0;
+
+  inf.open( params.infile[0].c_str() );
+  ouf.open( params.outfile.c_str() );
+  write_header(ouf,params);
+
+  while ( getline(inf,line) )  {
+
+    CAPCMAIN_NS::bed_feature pair = CAPCMAIN_NS::bed_feature::line2bed_feature(line);
+
+    if ( count > 0 && pair.chrom == current.chrom &&
+	 pair.start == current.start ) {
+      count++;
+      continue;
+    }
+
+    if ( count > 0 && ( pair.chrom < current.chrom ||
+			( pair.chrom == current.chrom &&
+			  pair.start < current.start ) ) ) {
+      // not sorted; start again holding the pile-up
+      ouf.close();
+      std::remove( params.outfile.c_str() );
+      return false;
+    }
+
+    if ( !params.interchromflag &&
+	 params.chrom.find( pair.chrom.str() ) == params.chrom.end() ) {
+      ouf.close();
+      std::remove( params.outfile.c_str() );
+      throw std::runtime_error("interchromosomal interaction in pairs file");
+    }
+
+    if ( count > 0 ) {
+      ouf<<current.chrom<<"\t"<<current.start<<"\t"<<current.end<<"\t"
+	 <<count<<"\n";
+    }
+    current = pair;
+    count = 1;
+
+  }
+
+  if ( count > 0 ) {
+    ouf<<current.chrom<<"\t"<<current.start<<"\t"<<current.end<<"\t"
+       <<count<<"\n";
+  }
+  ouf.close();
+
+  return true;
+
+}
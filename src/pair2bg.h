@@ -28,6 +28,7 @@ namespace POSTPROCESS_NS {
   
  void parse_pair2bg_command_line(const int &, char **, parameters &);
  void do_pileup(const parameters &);
+ bool stream_sorted_pileup(const parameters &);
  
 }
 
@@ -0,0 +1,324 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "pairscontainer.h"
+
+#include <stdexcept>
+#include <cstring>
+#include <algorithm>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  const char file_magic[8] = {'C','A','P','C','P','R','S','1'},
+    index_magic[8] = {'C','A','P','C','I','D','X','1'};
+
+  void put_u32(std::string &buf, const std::uint32_t &x) {
+    for (int i=0; i<4; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  void put_u64(std::string &buf, const std::uint64_t &x) {
+    for (int i=0; i<8; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  std::uint64_t get_uint(const char *p, const int &nbytes) {
+    std::uint64_t x = 0;
+    for (int i=0; i<nbytes; i++) {
+      x |= std::uint64_t( (unsigned char)p[i] ) << (8*i);
+    }
+    return x;
+  }
+
+  void read_bytes(std::ifstream &inf, char *p, const std::size_t &n,
+		  const std::string &fname) {
+    inf.read(p,n);
+    if ( inf.gcount() != std::streamsize(n) ) {
+      throw std::runtime_error("pairs container "+fname+" is truncated");
+    }
+  }
+
+}
+
+
+pairs_container_writer::pairs_container_writer(const std::string &fname,
+					       const std::vector<std::string>
+					       &targetnames,
+					       const bool &inter,
+					       const std::size_t &max_mem) :
+  filename(fname), names(targetnames), has_inter(inter), buffered(0),
+  max_buffered(max_mem), offset(0) {
+  // open the container and write its header
+
+  ouf.open( fname.c_str(), std::ios::binary );
+  if ( !ouf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+  ouf.write(file_magic,8);
+  offset = 8;
+
+  buffers[intra_pairs].resize( names.size() );
+  if ( has_inter ) {
+    buffers[inter_pairs].resize( names.size() );
+  }
+
+}
+
+
+pairs_container_writer::~pairs_container_writer() {
+  if ( ouf.is_open() ) {
+    ouf.close();
+  }
+}
+
+
+void pairs_container_writer::append(const pairs_kind &kind,
+				    const std::uint32_t &target,
+				    const std::string &lines) {
+  // add lines for one target, writing a block once its buffer is full,
+  // or some early if the buffers take too much memory
+
+  std::string &buf = buffers[kind][target];
+  std::size_t before = buf.capacity();
+
+  buf += lines;
+  buffered += buf.capacity() - before;
+  if ( buf.size() >= block_size ) {
+    write_block(kind,target);
+  }
+  if ( buffered > max_buffered ) {
+    write_largest();
+  }
+
+}
+
+
+void pairs_container_writer::write_block(const pairs_kind &kind,
+					 const std::uint32_t &target) {
+  // write the buffered lines for one target as a block, and index it
+
+  std::string &buf = buffers[kind][target];
+  std::string head;
+  block b;
+
+  if ( buf.empty() ) {
+    return;
+  }
+
+  put_u32(head,target);
+  put_u32(head,kind);
+  put_u64(head,buf.size());
+  ouf.write(head.data(),head.size());
+  ouf.write(buf.data(),buf.size());
+  if ( !ouf.good() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+  b.offset = offset + head.size();
+  b.length = buf.size();
+  b.target = target;
+  b.kind = kind;
+  blocks.push_back(b);
+
+  offset += head.size() + buf.size();
+  buffered -= buf.capacity();
+  std::string().swap(buf);
+
+}
+
+
+void pairs_container_writer::write_largest() {
+  // write out the largest buffers, until they take no more than half of
+  // max_buffered
+
+  std::vector< std::pair<std::size_t,std::uint32_t> > sizes;   // size, and
+                                                  // kind*targets + target
+  std::size_t n = names.size();
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::uint32_t t=0; t<buffers[k].size(); t++) {
+      if ( !buffers[k][t].empty() ) {
+	sizes.push_back( std::make_pair( buffers[k][t].capacity(), k*n + t ) );
+      }
+    }
+  }
+  std::sort( sizes.begin(), sizes.end() );
+
+  while ( buffered > max_buffered/2 && !sizes.empty() ) {
+    write_block( pairs_kind(sizes.back().second/n), sizes.back().second % n );
+    sizes.pop_back();
+  }
+
+}
+
+
+void pairs_container_writer::flush() {
+  // write any part filled blocks, so that everything appended so far is
+  // in the file
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::uint32_t t=0; t<buffers[k].size(); t++) {
+      write_block(pairs_kind(k),t);
+    }
+  }
+  ouf.flush();
+
+}
+
+
+void pairs_container_writer::close() {
+  // write any part filled blocks, then the index and trailer
+
+  std::string index;
+
+  flush();
+
+  put_u32(index,has_inter);
+  put_u32(index,names.size());
+  for (std::size_t t=0; t<names.size(); t++) {
+    put_u32(index,names[t].size());
+    index += names[t];
+  }
+  put_u64(index,blocks.size());
+  for (std::size_t i=0; i<blocks.size(); i++) {
+    put_u64(index,blocks[i].offset);
+    put_u64(index,blocks[i].length);
+    put_u32(index,blocks[i].target);
+    put_u32(index,blocks[i].kind);
+  }
+  put_u64(index,offset);
+  index.append(index_magic,8);
+
+  ouf.write(index.data(),index.size());
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+}
+
+
+pairs_container_reader::pairs_container_reader(const std::string &fname) :
+  filename(fname) {
+  // open a container and load its index
+
+  char buf[16];
+  std::uint64_t index_offset,
+    end,
+    nblocks;
+  std::uint32_t ntargets,
+    len;
+  std::string name;
+  pairs_container_writer::block b;
+
+  inf.open( fname.c_str(), std::ios::binary );
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+  read_bytes(inf,buf,8,fname);
+  if ( std::memcmp(buf,file_magic,8) != 0 ) {
+    throw std::runtime_error(fname+" is not a pairs container");
+  }
+
+  // the trailer gives the position of the index
+  inf.seekg(0,std::ios::end);
+  end = inf.tellg();
+  if ( end < 8+16 ) {
+    throw std::runtime_error("pairs container "+fname+" is truncated");
+  }
+  inf.seekg(end-16);
+  read_bytes(inf,buf,16,fname);
+  if ( std::memcmp(buf+8,index_magic,8) != 0 ) {
+    throw std::runtime_error("pairs container "+fname+" has no index "
+			     "(was it written completely?)");
+  }
+  index_offset = get_uint(buf,8);
+  if ( index_offset > end-16 ) {
+    throw std::runtime_error("pairs container "+fname+" has a bad index");
+  }
+
+  inf.seekg(index_offset);
+  read_bytes(inf,buf,8,fname);
+  has_inter = get_uint(buf,4);
+  ntargets = get_uint(buf+4,4);
+  for (std::uint32_t t=0; t<ntargets; t++) {
+    read_bytes(inf,buf,4,fname);
+    len = get_uint(buf,4);
+    name.resize(len);
+    read_bytes(inf,&name[0],len,fname);
+    names.push_back(name);
+  }
+  read_bytes(inf,buf,8,fname);
+  nblocks = get_uint(buf,8);
+  for (std::uint64_t i=0; i<nblocks; i++) {
+    read_bytes(inf,buf,16,fname);
+    b.offset = get_uint(buf,8);
+    b.length = get_uint(buf+8,8);
+    read_bytes(inf,buf,8,fname);
+    b.target = get_uint(buf,4);
+    b.kind = get_uint(buf+4,4);
+    if ( b.target >= ntargets || b.kind > inter_pairs ||
+	 b.offset + b.length > index_offset ) {
+      throw std::runtime_error("pairs container "+fname+" has a bad index");
+    }
+    blocks.push_back(b);
+  }
+
+}
+
+
+int pairs_container_reader::find_target(const std::string &name) const {
+  // target number from its name, or -1 if not present
+
+  for (std::size_t t=0; t<names.size(); t++) {
+    if ( names[t] == name ) {
+      return t;
+    }
+  }
+  return -1;
+
+}
+
+
+void pairs_container_reader::extract(const pairs_kind &kind,
+				     const std::uint32_t &target,
+				     std::ostream &ouf) {
+  // copy the pairs for one target to a stream, in the order written
+
+  std::string buf;
+
+  for (std::size_t i=0; i<blocks.size(); i++) {
+    if ( blocks[i].target != target || blocks[i].kind != std::uint32_t(kind) ) {
+      continue;
+    }
+    buf.resize( blocks[i].length );
+    inf.seekg( blocks[i].offset );
+    read_bytes(inf,&buf[0],buf.size(),filename);
+    ouf.write(buf.data(),buf.size());
+  }
+
+}
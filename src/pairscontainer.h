@@ -0,0 +1,109 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+#ifndef PAIRSCONTAINER_H
+#define PAIRSCONTAINER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <ostream>
+#include <cstdint>
+
+namespace CAPCMAIN_NS {
+
+  // The pairs container holds the valid pairs for every target in one
+  // file, in place of one .pairs file per target. Layout :
+  //
+  //   "CAPCPRS1"
+  //   blocks  : target (u32), kind (u32), length (u64), then that many
+  //             bytes of pairs lines exactly as in the .pairs files
+  //   index   : has_inter (u32), number of targets (u32), then for each
+  //             target its name length (u32) and name; number of blocks
+  //             (u64), then for each block its data offset (u64), length
+  //             (u64), target (u32) and kind (u32)
+  //   trailer : offset of the index (u64), "CAPCIDX1"
+  //
+  // All integers are little-endian. Targets are numbered by target_id,
+  // and the blocks for each target and kind are in the order written.
+
+  enum pairs_kind { intra_pairs = 0, inter_pairs = 1 };
+
+
+  struct pairs_container_writer {
+
+    static const std::size_t block_size = 1<<16;
+
+    struct block {
+      std::uint64_t offset,
+	length;
+      std::uint32_t target,
+	kind;
+    };
+
+    std::ofstream ouf;
+    std::string filename;
+    std::vector<std::string> names;
+    bool has_inter;
+
+    // Lines are buffered for each target until there is a block's worth.
+    // The buffers are held within max_buffered bytes (counting what they
+    // have allocated); past that the largest are written out early, as
+    // shorter blocks.
+    std::vector<std::string> buffers[2];   // by kind, then target
+    std::size_t buffered,
+      max_buffered;
+    std::vector<block> blocks;
+    std::uint64_t offset;
+
+    pairs_container_writer(const std::string &,
+			   const std::vector<std::string> &, const bool &,
+			   const std::size_t &);
+    ~pairs_container_writer();
+
+    void append(const pairs_kind &, const std::uint32_t &,
+		const std::string &);
+    void write_block(const pairs_kind &, const std::uint32_t &);
+    void write_largest();
+    void flush();
+    void close();
+
+  };
+
+
+  struct pairs_container_reader {
+
+    std::ifstream inf;
+    std::string filename;
+    std::vector<std::string> names;
+    bool has_inter;
+    std::vector<pairs_container_writer::block> blocks;
+
+    pairs_container_reader(const std::string &);
+
+    int find_target(const std::string &) const;
+    void extract(const pairs_kind &, const std::uint32_t &, std::ostream &);
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,249 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "pairsort.h"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <vector>
+#include <queue>
+#include <algorithm>
+#include <functional>
+#include <stdexcept>
+#include <cstdio>
+#include <cstring>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  std::string runfilename(const std::string &prefix, const std::size_t &n) {
+    std::stringstream name;
+    name<<prefix<<"_pairsort_"<<n<<".tmp";
+    return name.str();
+  }
+
+  struct run_reader {
+    // one target's records in one run, read a chunk at a time
+    std::ifstream *inf;
+    std::uint64_t left;               // records not yet read
+    std::vector<std::uint32_t> chunk;
+    std::size_t next;
+
+    run_reader() : inf(NULL), left(0), next(0) {};
+
+    bool refill() {
+      std::size_t n = pairs_sorter::chunk_records;
+      if ( left < n ) {
+	n = left;
+      }
+      chunk.resize(n);
+      next = 0;
+      if ( n == 0 ) {
+	return false;
+      }
+      if ( !inf->read( reinterpret_cast<char*>(&chunk[0]),
+		       n*sizeof(std::uint32_t) ) ) {
+	throw std::runtime_error("scratch file for sorting pairs is "
+				 "truncated");
+      }
+      left -= n;
+      return true;
+    }
+  };
+
+  typedef std::pair<std::uint32_t,std::size_t> heap_entry;
+
+}
+
+
+pairs_sorter::pairs_sorter(const std::string &prefix,
+			   const unsigned long int &mem,
+			   const std::size_t &ntargets,
+			   const bool &save_inter) :
+  max_mem(mem), scratch_prefix(prefix), held_mem(0), n_records(0) {
+  // constructor
+  held[intra_pairs].resize(ntargets);
+  if ( save_inter ) {
+    held[inter_pairs].resize(ntargets);
+  }
+}
+
+
+pairs_sorter::~pairs_sorter() {
+  cleanup();
+}
+
+
+void pairs_sorter::add(const pairs_kind &kind, const int &target_id,
+		       const std::string &ids) {
+  // add records for one target, as 4 byte fragment IDs
+
+  std::vector<std::uint32_t> &v = held[kind][target_id];
+  std::size_t n = ids.size()/sizeof(std::uint32_t),
+    before = v.size(),
+    capacity = v.capacity();
+
+  v.resize(before+n);
+  std::memcpy(&v[before],ids.data(),n*sizeof(std::uint32_t));
+  // count what the vectors have allocated, which can be up to twice what
+  // they hold
+  held_mem += (v.capacity()-capacity)*sizeof(std::uint32_t);
+  n_records += n;
+
+  if ( held_mem > max_mem ) {
+    spill();
+  }
+
+}
+
+
+void pairs_sorter::spill() {
+  // sort the held records of every target and write them out as a run
+
+  std::ofstream ouf;
+  run R;
+  std::uint64_t offset = 0;
+
+  R.filename = runfilename(scratch_prefix,runs.size());
+  std::ifstream inf( R.filename.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+R.filename+" already exists (will not "
+			     "overwrite).");
+  }
+  inf.close();
+  ouf.open( R.filename.c_str(), std::ios::binary );
+  if ( !ouf.good() ) {
+    throw std::runtime_error("cannot open scratch file "+R.filename);
+  }
+  runs.push_back(R);
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    std::vector<std::uint64_t> &offsets = runs.back().offsets[k];
+    for (std::size_t t=0; t<held[k].size(); t++) {
+      std::vector<std::uint32_t> &v = held[k][t];
+      offsets.push_back(offset);
+      std::sort( v.begin(), v.end() );
+      ouf.write( reinterpret_cast<const char*>(v.data()),
+		 v.size()*sizeof(std::uint32_t) );
+      offset += v.size();
+      std::vector<std::uint32_t>().swap(v);
+    }
+    offsets.push_back(offset);
+  }
+
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing scratch file "+R.filename);
+  }
+  held_mem = 0;
+
+}
+
+
+void pairs_sorter::merge(const pairs_kind &kind, const int &target_id,
+			 const std::function<void(const std::string&)> &out) {
+  // k-way merge of one target's records from the runs and from those
+  // held; they are passed to out a chunk at a time, as 4 byte IDs
+
+  std::vector<run_reader> readers( runs.size() );
+  std::priority_queue<heap_entry, std::vector<heap_entry>,
+		      std::greater<heap_entry> > heap;
+  std::vector<std::uint32_t> &v = held[kind][target_id];
+  std::string chunk;
+  std::size_t r;
+
+  std::sort( v.begin(), v.end() );
+
+  try {
+    for (r=0; r<runs.size(); r++) {
+      const std::vector<std::uint64_t> &offsets = runs[r].offsets[kind];
+      readers[r].inf = new std::ifstream( runs[r].filename.c_str(),
+					  std::ios::binary );
+      if ( !readers[r].inf->good() ) {
+	throw std::runtime_error("cannot open scratch file "+
+				 runs[r].filename);
+      }
+      readers[r].inf->seekg( offsets[target_id]*sizeof(std::uint32_t) );
+      readers[r].left = offsets[target_id+1] - offsets[target_id];
+      if ( readers[r].refill() ) {
+	heap.push( heap_entry(readers[r].chunk[0],r) );
+      }
+    }
+
+    // what is held is read like a run which is all in memory
+    std::size_t held_next = 0;
+    if ( v.size() > 0 ) {
+      heap.push( heap_entry(v[0],runs.size()) );
+    }
+
+    chunk.reserve( chunk_records*sizeof(std::uint32_t) );
+    while ( !heap.empty() ) {
+      heap_entry e = heap.top();
+      heap.pop();
+      chunk.append( reinterpret_cast<const char*>(&e.first),
+		    sizeof(std::uint32_t) );
+      if ( chunk.size() >= chunk_records*sizeof(std::uint32_t) ) {
+	out(chunk);
+	chunk.clear();
+      }
+
+      if ( e.second == runs.size() ) {
+	if ( ++held_next < v.size() ) {
+	  heap.push( heap_entry(v[held_next],e.second) );
+	}
+      } else {
+	run_reader &R = readers[e.second];
+	if ( ++R.next < R.chunk.size() || R.refill() ) {
+	  heap.push( heap_entry(R.chunk[R.next],e.second) );
+	}
+      }
+    }
+    if ( chunk.size() > 0 ) {
+      out(chunk);
+    }
+  } catch (...) {
+    for (r=0; r<readers.size(); r++) {
+      delete readers[r].inf;
+    }
+    throw;
+  }
+
+  for (r=0; r<readers.size(); r++) {
+    delete readers[r].inf;
+  }
+  std::vector<std::uint32_t>().swap(v);
+
+}
+
+
+void pairs_sorter::cleanup() {
+  // remove the run files
+
+  for (std::size_t r=0; r<runs.size(); r++) {
+    std::remove( runs[r].filename.c_str() );
+  }
+  runs.clear();
+
+}
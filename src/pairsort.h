@@ -0,0 +1,75 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef PAIRSORT_H
+#define PAIRSORT_H
+
+#include "pairscontainer.h"
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <functional>
+
+namespace CAPCMAIN_NS {
+
+  struct pairs_sorter {
+    // Sorts the pairs of each target by reporter fragment ID, which is the
+    // order of chromosome name then start, with a fixed memory budget.
+    // Records (fragment IDs) are held for each target; when they exceed
+    // the budget those of every target are sorted and spilled as one run
+    // file on scratch, which records where each target's records start.
+    // merge() then gives one target's records in order, from the runs and
+    // from what is still held.
+
+    static const std::size_t chunk_records = 1<<14;
+
+    unsigned long int max_mem;        // memory budget in bytes
+    std::string scratch_prefix;       // prefix for temporary run files
+
+    std::vector<std::vector<std::uint32_t> > held[2];  // by kind, then
+                                                       // target_id
+    unsigned long int held_mem,
+      n_records;
+
+    struct run {
+      std::string filename;
+      std::vector<std::uint64_t> offsets[2];   // by kind, then target_id,
+                                               // and one past the end
+    };
+    std::vector<run> runs;
+
+    pairs_sorter(const std::string &, const unsigned long int &,
+		 const std::size_t &, const bool &);
+    ~pairs_sorter();
+
+    void add(const pairs_kind &, const int &, const std::string &);
+    void spill();
+    void merge(const pairs_kind &, const int &,
+	       const std::function<void(const std::string &)> &);
+    void cleanup();
+
+  };
+
+}
+
+#endif
@@ -0,0 +1,633 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "pairsout.h"
+#include "parse_sam.h"
+#include "genome.h"
+#include "main_process.h"
+#include "messages.h"
+
+#include <stdexcept>
+#include <charconv>
+#include <chrono>
+#include <cstring>
+#include <sstream>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CAPCMAIN_NS;
+
+
+pairs_output::pairs_output(const genome& gnm, const std::string& fname_out,
+			   const parameters &params,
+			   const std::vector<unsigned long int> *resume_sizes) :
+  container(NULL), sorter(NULL), gnm(gnm), binary(params.cpairs),
+  save_inter(params.save_inter),
+  buffered(0), queued(0),
+  max_queued( params.container || params.sort_pairs ? params.output_mem/4 :
+	      params.output_mem/2 ),
+  finished(0), failed(0), busy(0),
+  flush_due(0), flush_interval(params.flush_interval) {
+  // set up output files, then start the writer thread. When resuming a
+  // run, or adding a lane to a saved state, resume_sizes gives the size of
+  // each .pairs file at the checkpoint (in the order of sync); the files
+  // are cut back to these sizes and added to. The output buffers and the
+  // queue are held within output_mem. When lines are collected into a
+  // container, or pairs are held to be sorted, they get half of it and the
+  // container or sorter the other half. (Sorted pairs only reach the
+  // container once the output buffers are empty.)
+
+  std::ifstream inf;
+  std::string astring;
+  std::vector<std::string> names;
+  cpairs_header header;
+
+  if ( params.container ) {
+    // one container, with the targets numbered by target_id
+    astring = fname_out + "_validpairs.container";
+    inf.open( astring.c_str() );
+    if ( inf.good() ) {
+      throw std::runtime_error("file "+astring+" already exists (will not "
+			       "overwrite).");
+    }
+    inf.close();
+
+    names.resize( gnm.targets.size() );
+    for ( genome::it_targs T=gnm.targets.begin(); T != gnm.targets.end(); ++T ) {
+      names[ T->target_id ] = T->name;
+    }
+    container = new pairs_container_writer(astring,names,save_inter,
+					   params.output_mem/2);
+
+  } else {
+
+    // cpairs files refer to the fragments by number, so record which
+    // fragments those are
+    if ( binary ) {
+      header.checksum = checksum_start;
+      for ( genome::const_it_rest_map C=gnm.restriction_fragments.begin();
+	    C != gnm.restriction_fragments.end(); ++C ) {
+	header.chroms.push_back( C->first );
+	header.nfragments.push_back( C->second.size() );
+	for ( genome::const_it_rest_set F=C->second.begin();
+	      F != C->second.end(); ++F ) {
+	  checksum_fragment(header.checksum, F->chrom, F->start, F->end);
+	}
+      }
+    }
+
+    // a file for each target, and if save_inter is true also for
+    // interchromosomal interactions
+    for (int k=intra_pairs; k <= ( save_inter ? inter_pairs : intra_pairs ); k++) {
+      if ( binary ) {
+	cfiles[k].assign( gnm.targets.size(), NULL );
+      } else {
+	files[k].assign( gnm.targets.size(), NULL );
+      }
+      for ( genome::it_targs T=gnm.targets.begin(); T != gnm.targets.end(); ++T ) {
+	// test file does not exist
+	astring = fname_out + ( k == intra_pairs ? "_validpairs_" :
+				"_validinterchom_" )
+	  + T->name.str() + ( binary ? ".cpairs" : ".pairs" );
+
+	if ( resume_sizes != NULL ) {
+	  struct stat st;
+	  std::size_t n = ( k == intra_pairs ? 0 : gnm.targets.size() )
+	    + T->target_id;
+	  if ( n >= resume_sizes->size() || ::stat(astring.c_str(),&st) != 0 ||
+	       (unsigned long int)st.st_size < (*resume_sizes)[n] ||
+	       ::truncate(astring.c_str(),(*resume_sizes)[n]) != 0 ) {
+	    close_files();
+	    throw std::runtime_error("file "+astring+" does not match the "
+				     "checkpoint or saved state; cannot "
+				     "carry on from it.");
+	  }
+	  files[k][ T->target_id ] = new std::ofstream( astring.c_str(),
+					   std::ios::app | std::ios::ate );
+	  continue;
+	}
+
+	inf.open( astring.c_str() );
+	if ( inf.good() ) {
+	  close_files();
+	  throw std::runtime_error("file "+astring+" already exists (will not "
+				   "overwrite).");
+	}
+	inf.close();
+
+	// open file for writting
+	if ( binary ) {
+	  cfiles[k][ T->target_id ] = new cpairs_writer(astring,header,true);
+	} else {
+	  files[k][ T->target_id ] = new  std::ofstream( astring.c_str() );
+	}
+      }
+    }
+
+  }
+
+  if ( params.sort_pairs ) {
+    sorter = new pairs_sorter(scratch_prefix(fname_out,params),
+			      params.output_mem/2, gnm.targets.size(),
+			      save_inter);
+  }
+
+  buffers[intra_pairs].resize( gnm.targets.size() );
+  if ( save_inter ) {
+    buffers[inter_pairs].resize( gnm.targets.size() );
+  }
+
+  writer = std::thread(&pairs_output::writer_loop, this);
+
+}
+
+
+pairs_output::~pairs_output() {
+  // if close() was not reached the files are left as they are; a
+  // container is then missing its index
+  stop_writer();
+  close_files();
+  delete sorter;
+}
+
+
+void pairs_output::write(const set_outcome& outcome) {
+  // add the pair for a read set to its target's buffer, if it is one
+  // which is kept
+
+  std::lock_guard<std::mutex> hold(buffers_lock);
+  pairs_kind kind;
+
+  if ( outcome.kind == set_outcome::intrachrom ) {
+    kind = intra_pairs;
+  } else if ( outcome.kind == set_outcome::interchrom && save_inter ) {
+    kind = inter_pairs;
+  } else {
+    return;
+  }
+
+  std::string &buf = buffers[kind][outcome.target_id];
+  std::size_t before = buf.size();
+
+  append_record(buf,*outcome.reporter);
+  buffered += buf.size() - before;
+
+  if ( buf.size() >= buffer_size ) {
+    hand_off(kind,outcome.target_id);
+  }
+  if ( buffered > max_queued || flush_due ) {
+    hand_off_all();
+  }
+
+}
+
+
+void pairs_output::write(const pairs_kind& kind, const int& target_id,
+			 const std::string& lines) {
+  // add records already formatted by append_record
+
+  std::lock_guard<std::mutex> hold(buffers_lock);
+  std::string &buf = buffers[kind][target_id];
+
+  buf += lines;
+  buffered += lines.size();
+
+  if ( buf.size() >= buffer_size ) {
+    hand_off(kind,target_id);
+  }
+  if ( buffered > max_queued || flush_due ) {
+    hand_off_all();
+  }
+
+}
+
+
+void pairs_output::hand_off(const pairs_kind& kind, const int& target_id) {
+  // queue one target's buffer for the writer, waiting if the queue is
+  // full; an emptied buffer is taken back in its place
+
+  std::string &buf = buffers[kind][target_id];
+
+  if ( buf.empty() ) {
+    return;
+  }
+
+  std::unique_lock<std::mutex> guard(lock);
+  while ( queued > 0 && queued + buf.size() > max_queued && !failed ) {
+    cond.wait(guard);
+  }
+  if ( failed ) {
+    throw std::runtime_error(error);
+  }
+
+  queued += buf.size();
+  buffered -= buf.size();
+  queue.push_back( queued_buffer() );
+  queue.back().kind = kind;
+  queue.back().target_id = target_id;
+  queue.back().lines.swap(buf);
+  if ( !spare.empty() ) {
+    buf.swap( spare.back() );
+    spare.pop_back();
+  }
+  cond.notify_all();
+
+}
+
+
+void pairs_output::hand_off_all() {
+  // queue every buffer which is not empty; if a timed flush is due the
+  // writer is also asked to flush the files
+
+  bool flush = flush_due.exchange(0);
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<buffers[k].size(); t++) {
+      hand_off(pairs_kind(k),t);
+    }
+  }
+
+  if ( flush ) {
+    std::unique_lock<std::mutex> guard(lock);
+    queue.push_back( queued_buffer() );
+    queue.back().target_id = -1;
+    cond.notify_all();
+  }
+
+}
+
+
+void pairs_output::write_out(const pairs_kind& kind, const int& target_id,
+			     const std::string& lines) {
+  // write lines for one target (called by the writer thread); a target_id
+  // of -1 asks for the files to be flushed
+
+  if ( target_id < 0 ) {
+    flush_files();
+  } else if ( sorter != NULL ) {
+    sorter->add(kind,target_id,lines);
+  } else {
+    write_records(kind,target_id,lines);
+  }
+
+}
+
+
+void pairs_output::write_records(const pairs_kind& kind, const int& target_id,
+				 const std::string& lines) {
+  // write records to one target's file : fragment IDs for cpairs, lines
+  // otherwise
+
+  if ( container != NULL ) {
+    container->append(kind,target_id,lines);
+  } else if ( binary ) {
+    cpairs_writer &ouf = *cfiles[kind][target_id];
+    for (std::size_t i=0; i+4<=lines.size(); i+=4) {
+      std::uint32_t id;
+      std::memcpy(&id,lines.data()+i,4);
+      ouf.add(id);
+    }
+  } else {
+    std::ofstream &ouf = *files[kind][target_id];
+    ouf.write(lines.data(),lines.size());
+    if ( !ouf.good() ) {
+      throw std::runtime_error("error writing to a pairs file");
+    }
+  }
+
+}
+
+
+bool pairs_output::timed_flush() {
+  // Called by the writer thread, with the queue empty, when a flush is
+  // due : if the caller is not writing, write out all the buffers and
+  // flush the files. Otherwise false, and the caller is asked to do it.
+
+  if ( !buffers_lock.try_lock() ) {
+    return false;
+  }
+
+  try {
+    for (int k=intra_pairs; k<=inter_pairs; k++) {
+      for (std::size_t t=0; t<buffers[k].size(); t++) {
+	if ( !buffers[k][t].empty() ) {
+	  write_out(pairs_kind(k),t,buffers[k][t]);
+	  buffers[k][t].clear();
+	}
+      }
+    }
+    buffered = 0;
+    flush_files();
+  } catch (...) {
+    buffers_lock.unlock();
+    throw;
+  }
+
+  buffers_lock.unlock();
+  return true;
+
+}
+
+
+void pairs_output::flush_files() {
+  // push everything written so far out to the files
+
+  if ( container != NULL ) {
+    container->flush();
+    return;
+  }
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<files[k].size(); t++) {
+      files[k][t]->flush();
+    }
+    for (std::size_t t=0; t<cfiles[k].size(); t++) {
+      cfiles[k][t]->write_block();
+      cfiles[k][t]->ouf.flush();
+    }
+  }
+
+}
+
+
+void pairs_output::writer_loop() {
+  // Writer thread : write queued buffers in order until close. If a flush
+  // interval is set, ask for a flush each time it passes.
+
+  typedef std::chrono::steady_clock clock;
+
+  const std::size_t max_spare = 16;
+  queued_buffer b;
+  bool flush_pending = 0;
+  clock::time_point next_flush = clock::now()
+    + std::chrono::seconds(flush_interval);
+
+  std::unique_lock<std::mutex> guard(lock);
+  while ( true ) {
+
+    if ( flush_interval > 0 && clock::now() >= next_flush ) {
+      flush_pending = 1;
+      next_flush += std::chrono::seconds(flush_interval);
+    }
+
+    // a timed flush waits until the queue has been written; the queue
+    // cannot grow while we hold the buffers
+    if ( flush_pending && queue.empty() && !failed ) {
+      flush_pending = 0;
+      try {
+	if ( !timed_flush() ) {
+	  flush_due = 1;
+	}
+      } catch (const std::exception& e) {
+	failed = 1;
+	error = e.what();
+	cond.notify_all();
+      }
+    }
+
+    if ( queue.empty() ) {
+      if ( finished ) {
+	break;
+      }
+      if ( flush_interval > 0 ) {
+	cond.wait_until(guard,next_flush);
+      } else {
+	cond.wait(guard);
+      }
+      continue;
+    }
+
+    b.kind = queue.front().kind;
+    b.target_id = queue.front().target_id;
+    b.lines.swap( queue.front().lines );
+    queue.pop_front();
+
+    if ( !failed ) {
+      busy = 1;
+      guard.unlock();
+      try {
+	write_out(b.kind,b.target_id,b.lines);
+      } catch (const std::exception& e) {
+	guard.lock();
+	failed = 1;
+	error = e.what();
+	guard.unlock();
+      }
+      guard.lock();
+      busy = 0;
+    }
+
+    queued -= b.lines.size();
+    b.lines.clear();
+    if ( spare.size() < max_spare ) {
+      spare.push_back( std::string() );
+      spare.back().swap(b.lines);
+    }
+    cond.notify_all();
+
+  }
+
+}
+
+
+void pairs_output::stop_writer() {
+  // let the writer finish what is queued, and wait for it
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    finished = 1;
+    cond.notify_all();
+  }
+  if ( writer.joinable() ) {
+    writer.join();
+  }
+
+}
+
+
+void pairs_output::sync(std::vector<unsigned long int> &sizes) {
+  // Write out everything so far, wait for the writer to finish it, and
+  // give the size of each .pairs file (intrachromosomal files by
+  // target_id, then interchromosomal). Used to take a checkpoint.
+
+  std::lock_guard<std::mutex> hold(buffers_lock);
+  hand_off_all();
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    while ( ( !queue.empty() || busy ) && !failed ) {
+      cond.wait(guard);
+    }
+    if ( failed ) {
+      throw std::runtime_error(error);
+    }
+  }
+
+  // the writer is idle, and cannot start a timed flush while we hold
+  // the buffers
+  flush_files();
+  sizes.clear();
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<files[k].size(); t++) {
+      if ( !files[k][t]->good() ) {
+	throw std::runtime_error("error writing to a pairs file");
+      }
+      sizes.push_back( files[k][t]->tellp() );
+    }
+  }
+
+}
+
+
+void pairs_output::close() {
+  // write out what is left, then close the files and tidy up
+
+  {
+    std::lock_guard<std::mutex> hold(buffers_lock);
+    hand_off_all();
+  }
+  stop_writer();
+  if ( failed ) {
+    throw std::runtime_error(error);
+  }
+
+  if ( sorter != NULL ) {
+    write_sorted();
+  }
+
+  if ( container != NULL ) {
+    container->close();
+  }
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<cfiles[k].size(); t++) {
+      cfiles[k][t]->close();
+    }
+  }
+  close_files();
+
+}
+
+
+void pairs_output::write_sorted() {
+  // merge each target's sorted records into its file; for .pairs files
+  // and the container the fragment IDs are turned back into lines
+
+  std::vector<const rest_fragment*> fragments;
+  std::string lines;
+
+  if ( !binary ) {
+    fragments.resize( gnm.Nfragments );
+    for ( genome::const_it_rest_map C=gnm.restriction_fragments.begin();
+	  C != gnm.restriction_fragments.end(); ++C ) {
+      for ( genome::const_it_rest_set F=C->second.begin();
+	    F != C->second.end(); ++F ) {
+	fragments[ F->fragment_id ] = &*F;
+      }
+    }
+  }
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<buffers[k].size(); t++) {
+      sorter->merge(pairs_kind(k),t,[&](const std::string& ids) {
+	  if ( binary ) {
+	    write_records(pairs_kind(k),t,ids);
+	    return;
+	  }
+	  lines.clear();
+	  for (std::size_t i=0; i+4<=ids.size(); i+=4) {
+	    std::uint32_t id;
+	    std::memcpy(&id,ids.data()+i,4);
+	    append_pairs_line(lines,*fragments[id]);
+	  }
+	  write_records(pairs_kind(k),t,lines);
+	});
+    }
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Sorted "<<sorter->n_records<<" pairs";
+  if ( sorter->runs.size() > 0 ) {
+    mymessage<<" ("<<sorter->runs.size()<<" runs spilled to scratch)";
+  }
+  COMMON_NS::message( mymessage.str() );
+
+  delete sorter;
+  sorter = NULL;
+
+}
+
+
+void pairs_output::close_files() {
+
+  for (int k=intra_pairs; k<=inter_pairs; k++) {
+    for (std::size_t t=0; t<files[k].size(); t++) {
+      if ( files[k][t] != NULL ) {
+	files[k][t]->close();
+	delete files[k][t];
+      }
+    }
+    files[k].clear();
+
+    for (std::size_t t=0; t<cfiles[k].size(); t++) {
+      delete cfiles[k][t];
+    }
+    cfiles[k].clear();
+  }
+
+  delete container;
+  container = NULL;
+
+}
+
+
+void CAPCMAIN_NS::append_pairs_line(std::string& buf,
+				    const rest_fragment& reporter) {
+  // add one line of a .pairs file to a buffer
+
+  char num[24];
+  std::to_chars_result r;
+
+  buf += reporter.chrom;
+  buf += '\t';
+  r = std::to_chars(num,num+sizeof(num),reporter.start);
+  buf.append(num,r.ptr);
+  buf += '\t';
+  r = std::to_chars(num,num+sizeof(num),reporter.end);
+  buf.append(num,r.ptr);
+  buf += '\n';
+
+}
+
+
+void pairs_output::append_record(std::string& buf,
+				 const rest_fragment& reporter) const {
+  // add the record for one reporter to a buffer : a line of a .pairs
+  // file, or for cpairs (or to be sorted) the fragment ID
+
+  if ( binary || sorter != NULL ) {
+    std::uint32_t id = reporter.fragment_id;
+    buf.append( (const char*)&id, 4 );
+  } else {
+    append_pairs_line(buf,reporter);
+  }
+
+}
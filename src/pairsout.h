@@ -0,0 +1,126 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef PAIRSOUT_H
+#define PAIRSOUT_H
+
+#include "pairscontainer.h"
+#include "cpairs.h"
+#include "pairsort.h"
+
+#include <string>
+#include <fstream>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+namespace CAPCMAIN_NS {
+
+  // Forward Declarations
+  struct genome;
+  struct parameters;
+  struct set_outcome;
+  struct rest_fragment;
+
+  struct pairs_output {
+    // Where valid pairs are written : a .pairs file for each target, with
+    // --cpairs a .cpairs file for each target, or with --container one
+    // file holding them all.
+    //
+    // With --sort-pairs the records are fragment IDs, which the writer
+    // thread passes to a pairs_sorter in place of the files; the sorted
+    // pairs are written out by close().
+    //
+    // Lines are collected in a buffer for each target. Full buffers are
+    // queued for a writer thread, which does the file writes while the
+    // caller carries on; each target's lines are written in order, so the
+    // output is the same as writing each line directly. With a flush
+    // interval the writer also empties the buffers itself when the caller
+    // is not writing (e.g. while it waits for input).
+
+    static const std::size_t buffer_size = 1<<16;
+
+    struct queued_buffer {
+      pairs_kind kind;
+      int target_id;
+      std::string lines;
+    };
+
+    std::vector<std::ofstream*> files[2];    // by kind, then target_id
+    std::vector<cpairs_writer*> cfiles[2];   // by kind, then target_id
+    pairs_container_writer *container;
+    pairs_sorter *sorter;                    // NULL unless sorting
+    const genome &gnm;
+    bool binary;                             // files hold fragment IDs
+    bool save_inter;
+
+    // held by the caller while writing, and by the writer thread for a
+    // timed flush
+    std::mutex buffers_lock;
+    std::vector<std::string> buffers[2];     // by kind, then target_id
+    std::size_t buffered;                    // bytes held in buffers
+
+    // shared with the writer thread
+    std::mutex lock;
+    std::condition_variable cond;
+    std::deque<queued_buffer> queue;
+    std::vector<std::string> spare;          // emptied buffers, for reuse
+    std::size_t queued,                      // bytes waiting in the queue
+      max_queued;
+    bool finished,
+      failed,
+      busy;                                  // writer is writing a buffer
+    std::string error;
+    std::atomic<bool> flush_due;
+    unsigned int flush_interval;             // seconds; 0 for no timed flush
+    std::thread writer;
+
+    pairs_output(const genome&, const std::string&, const parameters&,
+		 const std::vector<unsigned long int>* = NULL);
+    ~pairs_output();
+
+    void write(const set_outcome&);
+    void write(const pairs_kind&, const int&, const std::string&);
+    void append_record(std::string&, const rest_fragment&) const;
+    void sync(std::vector<unsigned long int>&);
+    void close();
+
+    void hand_off(const pairs_kind&, const int&);
+    void hand_off_all();
+    void write_out(const pairs_kind&, const int&, const std::string&);
+    void write_records(const pairs_kind&, const int&, const std::string&);
+    void write_sorted();
+    bool timed_flush();
+    void flush_files();
+    void writer_loop();
+    void stop_writer();
+    void close_files();
+  };
+
+  void append_pairs_line(std::string&, const rest_fragment&);
+
+}
+
+#endif
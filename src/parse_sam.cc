@@ -26,363 +26,1281 @@
 #include "targets.h"
 #include "main_process.h"
 #include "messages.h"
+#include "dedup.h"
+#include "mappedsam.h"
+#include "bamfile.h"
+#include "samreader.h"
+#include "pairsout.h"
+#include "pileup.h"
+#include "checkpoint.h"
+#include "progress.h"
+#include "readsets.h"
 
 #include <map>
 #include <string>
 #include <sstream>
 #include <cmath>
+#include <iomanip>
 #include <stdexcept>
 #include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <cstdlib>
+#include <new>
+#include <memory>
+#include <sys/stat.h>
 
 using namespace CAPCMAIN_NS;
 
 
-bool CAPCMAIN_NS::peakheader(std::ifstream& inf) {
-  // peak at the next line in the SAM file
-  // return TRUE if it is a header
-  // return FLASE if it is not a header
-  // throw an exception if reached the end of file
+#ifdef CAPC_COUNT_ALLOCS
+// Debug builds (-DCAPC_COUNT_ALLOCS) count every heap allocation, so we
+// can check that classifying a read set does not allocate.
 
-  int pp = inf.peek();
+namespace {
+  thread_local unsigned long int n_allocations = 0;
+}
 
-  if ( pp == EOF ) {
-    throw std::runtime_error("samfile does not contain any entries");
-  } else if ( pp == '@') {
-    return 1;
-  } else {
-    return 0;
+void* operator new(std::size_t size) {
+  n_allocations++;
+  void *p = std::malloc( size ? size : 1 );
+  if ( p == NULL ) {
+    throw std::bad_alloc();
+  }
+  return p;
+}
+
+void operator delete(void *p) noexcept {
+  std::free(p);
+}
+
+void operator delete(void *p, std::size_t) noexcept {
+  std::free(p);
+}
+#endif
+
+
+std::string CAPCMAIN_NS::scratch_prefix(const std::string& fname_out,
+				       const parameters &params) {
+  // prefix for temporary files; these go next to the output files unless
+  // a scratch directory was given
+
+  if ( params.scratch == "" ) {
+    return fname_out;
+  }
+  return params.scratch + "/" + fname_out.substr( fname_out.rfind('/')+1 );
+
+}
+
+
+bam_reader* CAPCMAIN_NS::open_sam_input(const std::string& samfile,
+					sam_reader& insam,
+					const unsigned int& nthreads) {
+  // open a SAM or BAM file for reading; for BAM a reader is returned,
+  // otherwise the SAM reader is opened
+
+  if ( bam_reader::is_bam(samfile) ) {
+    return new bam_reader(samfile,nthreads);
+  }
+
+  insam.open(samfile);
+  return NULL;
+
+}
+
+
+bool CAPCMAIN_NS::next_read_set(sam_reader& insam, bam_reader* bam,
+				std::vector<samfrag>& current_sams) {
+  // get the next read set from a SAM or BAM file; false at end of file
+
+  if ( bam != NULL ) {
+    return bam->get_read_set(current_sams);
   }
+  return insam.get_read_set(current_sams);
 
 }
 
 
-bool CAPCMAIN_NS::peaksamline(std::ifstream& inf, const std::string& setname) {
-  // look at the next line in the sam file
-  // compare name with current name
-  // return TRUE if they match
-  // return FALSE if they match
+void CAPCMAIN_NS::scan_for_duplicates(const std::string& samfile,
+				      external_dedup& dedup,
+				      const parameters &params) {
+  // First pass over the SAM file when duplicates are removed with bounded
+  // memory : give the key of every mapped read set to dedup. Sets are
+  // numbered in the same way as in parse_sam_file.
+
+  sam_reader insam;
+  std::vector<samfrag> current_sams;
+  unsigned long int setnumber = 0;
+  bam_reader *bam;
+
+  bam = open_sam_input(samfile,insam,1);
+
+  while ( next_read_set(insam,bam,current_sams) ) {
+    if ( params.nshards > 1 && !in_shard(shard_key(current_sams),params) ) {
+      continue;
+    }
+    setnumber++;
+    if ( count_mapped(current_sams) > 0 ) {
+      dedup.add( genome::duplicate_key(current_sams), setnumber );
+    }
+  }
+
+  insam.close();
+  delete bam;
+
+  dedup.finish();
 
-  std::string line,
-    nextsetname;
-  std::stringstream sline;
+}
   
-  // peak at next line - return 0 if it is EOF
-  if ( inf.peek() == EOF ) {
-    return 0;
+
+
+int CAPCMAIN_NS::count_mapped(const std::vector<samfrag>& current_sams) {
+  // count number of fragments in a read set which mapped
+
+  int n_mapped = 0;
+  for (int i=0; i<current_sams.size(); i++) {
+    if ( current_sams[i].refid >= 0 ) {
+      n_mapped++;
+    }
+  }
+  return n_mapped;
+
+}
+
+
+unsigned long int CAPCMAIN_NS::string_hash(const std::string& s) {
+  // FNV-1a hash; unlike std::hash this is the same on every machine
+
+  unsigned long int h = 14695981039346656037UL;
+  for (std::size_t i=0; i<s.size(); i++) {
+    h ^= static_cast<unsigned char>(s[i]);
+    h *= 1099511628211UL;
+  }
+  return h;
+
+}
+
+
+std::size_t CAPCMAIN_NS::pick_interchrom(const unsigned long int& set_hash,
+					 const std::size_t& n) {
+  // choose one of n interchromosomal reporters "at random". The choice is
+  // made from a hash of the set name, so it does not depend on the order
+  // sets are processed in, and a threaded run gives the same output.
+
+  return set_hash % n;
+
+}
+
+
+std::string CAPCMAIN_NS::shard_key(const std::vector<samfrag>& current_sams) {
+  // what decides the shard of a read set : the duplicate key, so that
+  // duplicates always go to the same shard, or the set name if nothing
+  // mapped
+
+  if ( count_mapped(current_sams) > 0 ) {
+    return genome::duplicate_key(current_sams);
+  }
+  return current_sams.back().setname;
+
+}
+
+
+bool CAPCMAIN_NS::in_shard(const std::string& key,
+			   const parameters &params) {
+  // is a read set with this shard key part of this run? (--shard K/N)
+  return string_hash(key) % params.nshards == params.shard - 1;
+}
+
+
+void CAPCMAIN_NS::expand_read_set(const genome& gnm,
+				  const std::vector<samfrag>& current_sams,
+				  classify_workspace& work) {
+  // Expand the mapped fragments of a read set to restriction fragments,
+  // into work.frags. They are kept sorted by start with an insertion
+  // sort; if the same frag is inserted more than once, we only keep the
+  // first copy.
+
+  std::vector<const rest_fragment*> &current_frags = work.frags;
+  std::size_t i, j;
+
+  current_frags.clear();
+  for (i=0; i<current_sams.size(); i++) {
+    if ( current_sams[i].refid < 0 ) {
+      continue;
+    }
+    const rest_fragment *F = &current_sams[i].expand_to_restfrag(gnm);
+    for (j=current_frags.size(); j>0 && F->start < current_frags[j-1]->start;
+	 j--) {}
+    if ( j>0 && F->start == current_frags[j-1]->start ) {
+      continue;
+    }
+    current_frags.insert( current_frags.begin()+j, F );
+  }
+
+}
+
+
+void CAPCMAIN_NS::classify_fragments(const genome& gnm,
+				     const parameters &params,
+				     genome::counters& count,
+				     const unsigned long int& set_hash,
+				     classify_workspace& work,
+				     set_outcome& outcome) {
+  // Classify a mapped read set which is not a duplicate, from the
+  // fragments expand_read_set put in work.frags and the hash of its name.
+  // Counters are updated, and if the set is a valid interaction the
+  // target and the reporter fragment to output are returned in outcome.
+  // Fragments are handled as pointers into the genome, in the lists held
+  // by work, so nothing is copied or allocated once those lists have grown.
+
+  std::vector<const rest_fragment*> &current_frags = work.frags,
+    &set_of_interchroms = work.inter;
+  const target *current_target = NULL;
+  std::size_t n,
+    i;
+  int currentNtargs,
+    nonAdjacent;
+
+  outcome.kind = set_outcome::discarded;
+  set_of_interchroms.clear();
+  if ( params.multiway ) {
+    work.all = current_frags;
   }
     
-  // save the file position
-  std::streampos fileposition = inf.tellg();
-  getline(inf,line);
+  // count targets
+  currentNtargs = 0;
+  for (i=0; i<current_frags.size(); i++) {
+    if ( current_frags[i]->is_target ) {
+      currentNtargs++;
+    }
+  }
+   
+  // discard notargets
+  if ( currentNtargs == 0 ) {
+    count.no_targets++;
+    return;
+  }
 
-  sline.clear(); sline.str(line);
-  sline>>nextsetname;
-  nextsetname = name2setname(nextsetname);
+  // discard multitargets, counting each pair of targets for the capture
+  // matrix
+  if ( currentNtargs > 1 ) {
+    count.multiple_targets++;
+    outcome.kind = set_outcome::multiple_targets;
+    for (i=0; gnm.capture_matrix && i<current_frags.size(); i++) {
+      if ( ! current_frags[i]->is_target ) {
+	continue;
+      }
+      for (n=i+1; n<current_frags.size(); n++) {
+	if ( current_frags[n]->is_target ) {
+	  int t1 = current_frags[i]->target_id,
+	    t2 = current_frags[n]->target_id;
+	  count.capture_pairs[ std::make_pair( std::min(t1,t2),
+					       std::max(t1,t2) ) ]++;
+	}
+      }
+    }
+    return;
+  }
 
-  // return to that file position
-  inf.seekg( fileposition );
-  
-  if ( nextsetname==setname ) {
-    // the next line if from the same read set
-    return 1;
-  } else {
-    // the next line is a new read set
-    return 0;
+    
+  // get the current target, and remove it from the list
+  for (i=0, n=0; i<current_frags.size(); i++) {
+    if ( current_frags[i]->is_target ) {
+      current_target = &*gnm.targets_by_id[ current_frags[i]->target_id ];
+    } else {
+      current_frags[n++] = current_frags[i];
+    }
   }
+  current_frags.resize(n);
   
+  // discard no reporters
+  if ( current_frags.size() == 0 ) {
+    count.no_reporters++;
+    return;
+  }
+
+
+  // discard due to exclusion around targets
+  for (i=0, n=0; i<current_frags.size(); i++) {
+    if ( ! current_frags[i]->is_excluded ) {
+      current_frags[n++] = current_frags[i];
+    }
+  }
+  current_frags.resize(n);
+  if ( current_frags.size() == 0 ) {
+    count.exclusion++;
+    return;
+  }
+    
+  // count and then discard if only interchrom
+  for (i=0, n=0; i<current_frags.size(); i++) {
+    if ( current_frags[i]->chrom != current_target->chrom ) {
+      set_of_interchroms.push_back( current_frags[i] );
+    } else {
+      current_frags[n++] = current_frags[i];
+    }
+  }
+  current_frags.resize(n);
+  if ( current_frags.size() == 0 ) {
+    count.onlyInter[current_target->target_id]++;
+    count.total_interchrom++;
+    // choose one of the reporters to output
+    outcome.kind = set_outcome::interchrom;
+    outcome.target_id = current_target->target_id;
+    outcome.reporter = set_of_interchroms[
+      pick_interchrom(set_hash,set_of_interchroms.size()) ];
+    return;
+  }
+
+    
+  // discard multi nonadjacent reporters
+  nonAdjacent = 0;
+  for (i=1; i<current_frags.size(); i++) {
+    if ( current_frags[i]->start != current_frags[i-1]->end ) {
+      nonAdjacent++;
+    }
+  }
+  if ( nonAdjacent > 0 ) { 
+    count.multiple_reporters++;
+    outcome.kind = set_outcome::multiple_reporters;
+    return;
+  }
+
+
+  // it must be a valid read!!!!
+  count.total_validPairs++;
+  count.validPairs[current_target->target_id]++;
+
+  // is it within 5Mb of the target? (lets use the start coords of the first)
+  long int distance = abs(current_frags[0]->start-current_target->start);
+  if (distance<=5e6) {
+    count.within5Mb[current_target->target_id]++;
+    // is it within 1Mb of the target?
+    if (distance<=1e6) {
+      count.within1Mb[current_target->target_id]++;
+    }
+  }
+
+  // and add it to the distance histogram
+  if ( gnm.distance_bins > 0 ) {
+    count.distances[ current_target->target_id*(gnm.distance_edges.size()-1)
+		     + gnm.distance_bin(distance) ]++;
+  }
+
+
+  // Choice here to give only the middle of any adjacent set of frags
+  outcome.kind = set_outcome::intrachrom;
+  outcome.target_id = current_target->target_id;
+  outcome.reporter = current_frags[ current_frags.size()/2 ];
+
 }
 
 
-  
+void CAPCMAIN_NS::check_pileup_files(const genome& gnm,
+				     const std::string& fname_out,
+				     const parameters &params) {
+  // make sure the pile-up bedGraphs do not exist before starting; when
+  // resuming they may have been written by the run which was stopped, and
+  // when adding a lane by the earlier run; either way they are written again
+
+  std::vector<std::string> names;
+  std::ifstream inf;
+
+  if ( !params.pileup || params.resume || params.add_to != "" ) {
+    return;
+  }
+
+  names = pileup_counts::output_files(gnm,fname_out,params.save_inter,
+				     params.combine);
+  for (std::size_t i=0; i<names.size(); i++) {
+    inf.open( names[i].c_str() );
+    if ( inf.good() ) {
+      throw std::runtime_error("file "+names[i]+" already exists (will not "
+			       "overwrite).");
+    }
+    inf.close();
+  }
+
+}
+
+
+namespace {
+
+  CAPCMAIN_NS::readset_writer* open_multiway(const CAPCMAIN_NS::genome &gnm,
+					     const std::string &fname_out,
+					     const CAPCMAIN_NS::parameters &params) {
+    // the file of read sets with several targets or reporters, for
+    // --multiway; NULL if not wanted
+    if ( !params.multiway ) {
+      return NULL;
+    }
+    return new CAPCMAIN_NS::readset_writer(fname_out+"_multiway.readsets",
+					   gnm,params);
+  }
+
+  bool is_multiway(const CAPCMAIN_NS::set_outcome &outcome) {
+    return outcome.kind == CAPCMAIN_NS::set_outcome::multiple_targets ||
+      outcome.kind == CAPCMAIN_NS::set_outcome::multiple_reporters;
+  }
+
+  double input_fraction(const std::string &samfile,
+			const unsigned long int &consumed) {
+    // how much of the input has been read, from the bytes consumed; 0 if
+    // its size is not known
+
+    struct stat sb;
+    if ( samfile == "-" || stat( samfile.c_str(), &sb ) != 0 ||
+	 !S_ISREG(sb.st_mode) || sb.st_size == 0 ) {
+      return 0;
+    }
+    return std::min( 1., double(consumed)/double(sb.st_size) );
+
+  }
+
+  void show_progress(CAPCMAIN_NS::progress_meter &meter,
+		     const CAPCMAIN_NS::genome &gnm,
+		     const CAPCMAIN_NS::sam_reader &insam,
+		     const CAPCMAIN_NS::bam_reader *bam,
+		     const CAPCMAIN_NS::external_dedup &dedup,
+		     const CAPCMAIN_NS::parameters &params) {
+    // hand the totals of a serial parse to the progress meter
+
+    using namespace CAPCMAIN_NS;
+
+    meter.set( progress_meter::totals(gnm.count) );
+    meter.bytes.store( bam != NULL ? bam->consumed : insam.consumed,
+		       std::memory_order_relaxed );
+    meter.dedup_keys.store( params.max_dedup_mem > 0 ? dedup.n_keys :
+			    gnm.list_for_duplicates.size(),
+			    std::memory_order_relaxed );
+
+  }
+
+}
 
 
 void CAPCMAIN_NS::parse_sam_file(genome& gnm, const std::string& samfile,
 				 const std::string& fname_out,
 				 const parameters &params) {
-  // Main function for parsing the sam file
+  // Main function for parsing the sam file. With checkpoints the state
+  // is saved every so many read sets, at the start of a set; this is done
+  // here rather than in the threaded parse, where there is no single point
+  // at which every earlier set (and no later one) has been handled. The
+  // same goes for a lane state, which holds the duplicate table as this
+  // parse keeps it. Stopping once the targets are saturated is also
+  // done here, so that it happens after the same read set every time.
+
+  if ( params.from_readsets != "" ) {
+    reclassify_read_sets(gnm,fname_out,params);
+    return;
+  }
+  if ( params.nthreads > 1 && params.checkpoint_every == 0 &&
+       !params.resume && params.save_state == "" && params.add_to == "" &&
+       params.stop_saturated == 0 ) {
+    parse_sam_file_threaded(gnm,samfile,fname_out,params);
+    return;
+  }
   
-  std::ifstream infsam;
-  std::map< std::string,std::ofstream* > oufpairs,
-    oufinter;
-  std::string astring,
-    line;
+  sam_reader insam;
+  bam_reader *bam;
   std::vector<samfrag> current_sams;
-  std::set<rest_fragment> current_frags;
-  std::vector<rest_fragment> set_of_interchroms;
-  target current_target;
-  samfrag asam;
-  int currentNtargs,
-    nonAdjacent,
-    n_mapped;
-
-  // set up output files
-  for ( genome::it_targs T=gnm.targets.begin(); T != gnm.targets.end(); ++T ) {
-    // test file does not exist
-    astring = fname_out + "_validpairs_" + T->name + ".pairs";
-    infsam.open( astring.c_str() );
-    if ( infsam.good() ) {
-      throw std::runtime_error("file "+astring+" already exists (will not "
-			       "overwrite).");
+  set_outcome outcome;
+  classify_workspace work;
+  unsigned long int set_hash;
+  std::size_t nsaturated = 0,         // targets with --stop-when-saturated
+    saturated_needed;                 // pairs, and how many must have them
+#ifdef CAPC_COUNT_ALLOCS
+  unsigned long int classify_allocations = 0;
+#endif
+  external_dedup dedup(scratch_prefix(fname_out,params),
+		       params.max_dedup_mem);
+
+  // set up output files, from the checkpoint if resuming
+  std::unique_ptr<pairs_output> ouf;
+  pileup_counts pileup;
+  checkpoint ckpt,
+    lanes;                  // state of the earlier lanes, or to be saved
+  std::string ckpt_name = checkpoint::file_name(fname_out);
+  check_pileup_files(gnm,fname_out,params);
+  if ( params.pileup ) {
+    pileup.setup(gnm,params.save_inter,params.combine);
+  }
+  if ( params.checkpoint_every > 0 || params.resume ) {
+    ckpt.settings = checkpoint::run_settings(gnm,samfile,params);
+  }
+  if ( params.save_state != "" || params.add_to != "" ) {
+    lanes.settings = checkpoint::analysis_settings(gnm,params);
+  }
+  if ( params.resume ) {
+    ckpt.load(ckpt_name,gnm,pileup);
+  }
+  if ( params.add_to != "" ) {
+    lanes.load(params.add_to,gnm,pileup);
+  }
+  if ( params.pairs_files ) {
+    ouf.reset( new pairs_output(gnm,fname_out,params,
+				params.resume ? &ckpt.pairs_sizes :
+				params.add_to != "" ? &lanes.pairs_sizes :
+				NULL) );
+  }
+  std::unique_ptr<readset_writer> readsets,
+    multiway( open_multiway(gnm,fname_out,params) );
+  if ( params.save_readsets != "" ) {
+    readsets.reset( new readset_writer(params.save_readsets,gnm,params) );
+  }
+
+  // with bounded memory, duplicates are found in a first pass
+  if ( params.max_dedup_mem > 0 ) {
+    if ( ! mapped_samfile::can_map(samfile) ) {
+      throw std::runtime_error("--max-dedup-mem reads the input twice, so "
+			       "cannot be used when it is a pipe");
     }
-    infsam.close();
+    scan_for_duplicates(samfile,dedup,params);
+  }
+
+  // Open SAM or BAM file, and match its references to the chromosomes
+  bam = open_sam_input(samfile,insam,params.nthreads);
+  const sam_references &refs = bam != NULL ? bam->refs : insam.refs;
+  gnm.set_references(refs);
 
-    // open file for writting
-    oufpairs[ T->name ] = new  std::ofstream( astring.c_str() );
+  // duplicate keys hold reference IDs, so a saved state only applies to
+  // input with the same references in the same order
+  std::vector<std::string> refnames(refs.names.begin(),refs.names.end());
+  if ( params.resume && ckpt.references != refnames ) {
+    throw std::runtime_error("the input does not have the same references "
+			     "as when the checkpoint was saved; cannot resume.");
   }
-  
-  // if save_inter is true, set up inter out files
-  if ( params.save_inter ) {
-    for ( genome::it_targs T=gnm.targets.begin(); T != gnm.targets.end(); ++T ) {
-      // test file does not exist
-      astring = fname_out + "_validinterchom_" + T->name + ".pairs";
-      infsam.open( astring.c_str() );
-      if ( infsam.good() ) {
-	throw std::runtime_error("file "+astring+" already exists (will not "
-				 "overwrite).");
+  if ( params.add_to != "" && lanes.references != refnames ) {
+    throw std::runtime_error("the header of "+samfile+" does not list the "
+			     "same references, in the same order, as the "
+			     "lanes in "+params.add_to);
+  }
+  ckpt.references = refnames;
+  lanes.references = refnames;
+
+  // when resuming, go to where the checkpoint was taken : seek in a SAM
+  // file, otherwise read past the sets which were done
+  if ( params.resume && bam == NULL && samfile != "-" ) {
+    insam.seek(ckpt.input_offset);
+  } else if ( params.resume ) {
+    for (unsigned long int n=0; n<ckpt.sets_done; ) {
+      if ( !next_read_set(insam,bam,current_sams) ) {
+	throw std::runtime_error("input ends before the checkpoint; cannot "
+				 "resume.");
+      }
+      if ( params.nshards == 1 || in_shard(shard_key(current_sams),params) ) {
+	n++;
       }
-      infsam.close();
-      
-      // open file for writting
-      oufinter[ T->name ] = new  std::ofstream( astring.c_str() );
     }
   }
-  
-  // Open SAM files
-  infsam.open( samfile.c_str() );
-  if ( ! infsam.good() ) {
-    throw std::runtime_error("cannot open file "+samfile+".");
+  if ( params.resume ) {
+    std::stringstream mymessage;
+    mymessage<<"...Resuming after "<<ckpt.sets_done<<" reads";
+    COMMON_NS::message( mymessage.str() );
+  }
+  if ( params.add_to != "" ) {
+    std::stringstream mymessage;
+    mymessage<<"...Adding to the "<<lanes.sets_done<<" reads of the lanes in "
+	     <<params.add_to;
+    COMMON_NS::message( mymessage.str() );
+  }
+
+  std::unique_ptr<progress_meter> meter;
+  if ( params.progress_interval > 0 ) {
+    meter.reset( new progress_meter(samfile,params) );
   }
 
-  // throw away headers
-  while ( peakheader(infsam) ) {
-    getline(infsam,line);
+  saturated_needed = ( gnm.targets.size()*params.saturated_percent + 99 )/100;
+  if ( saturated_needed == 0 ) {
+    saturated_needed = 1;
   }
 
   
   // parse rest of sam file
-  do {
-    
-    current_frags.clear();
-    current_sams.clear();
-    
-    // read a group of fragments
-    getline(infsam,line);
-    
-    current_sams.push_back( samfrag::samline2samfrag(line)  );
-    gnm.count.total_read_frags++;
-    while ( peaksamline(infsam,current_sams.back().setname) ) {
-      // if the next line has the same name, get it
-      getline(infsam,line);
-      current_sams.push_back( samfrag::samline2samfrag(line)  );
-      gnm.count.total_read_frags++;
+  while ( next_read_set(insam,bam,current_sams) ) {
+
+    // save a checkpoint before this set if it is due
+    if ( params.checkpoint_every > 0 &&
+	 gnm.count.total_read_sets >= ckpt.sets_done + params.checkpoint_every ) {
+      ckpt.sets_done = gnm.count.total_read_sets;
+      ckpt.input_offset = bam == NULL ? insam.set_offset : 0;
+      if ( ouf ) {
+	ouf->sync(ckpt.pairs_sizes);
+      }
+      ckpt.save(ckpt_name,gnm,pileup);
     }
 
+    // pass on progress every few thousand sets
+    if ( meter && ( gnm.count.total_read_sets & 4095 ) == 0 ) {
+      show_progress(*meter,gnm,insam,bam,dedup,params);
+    }
+
+    // with shards, skip sets which belong to another shard
+    if ( params.nshards > 1 && !in_shard(shard_key(current_sams),params) ) {
+      continue;
+    }
+    
+    gnm.count.total_read_frags += current_sams.size();
+
     gnm.count.total_read_sets++;
 
 
     // count number mapped, discard if none mapped
-    n_mapped = 0;
-    for (int i=0; i<current_sams.size(); i++) {
-      if ( current_sams[i].chrom != "*" ) {
-	n_mapped++;
-      }
-    }
-    if ( n_mapped==0 ) {
+    if ( count_mapped(current_sams)==0 ) {
       gnm.count.none_mapped++;
       continue;
     }
     
     // check for duplicates -- do this after discarding none mapped
-    if ( gnm.is_duplicate(current_sams) ) {
+    if ( params.max_dedup_mem > 0 ?
+	 dedup.is_duplicate(gnm.count.total_read_sets) :
+	 gnm.is_duplicate(current_sams) ) {
       gnm.count.duplicates_removed++;
       continue;
     }
 
-    
-    // expand to restfrags
-    for (int i=0; i<current_sams.size(); i++) {
-      if ( current_sams[i].chrom != "*" ) {
-	// expand mapped fragment to restriction fragment
-	// if the same frag is inserted more than once, we only get one copy
-	current_frags.insert( current_sams[i].expand_to_restfrag(gnm) );
-      }
+    // classify, and output any valid interaction
+#ifdef CAPC_COUNT_ALLOCS
+    unsigned long int allocs_before = n_allocations;
+#endif
+    expand_read_set(gnm,current_sams,work);
+    set_hash = string_hash(current_sams.back().setname);
+    if ( readsets ) {
+      // saved before classify_fragments trims work.frags, but not counted
+      // as part of classification
+#ifdef CAPC_COUNT_ALLOCS
+      unsigned long int allocs_saving = n_allocations;
+#endif
+      readsets->add(work.frags,set_hash);
+#ifdef CAPC_COUNT_ALLOCS
+      allocs_before += n_allocations - allocs_saving;
+#endif
     }
+    classify_fragments(gnm,params,gnm.count,set_hash,work,outcome);
+#ifdef CAPC_COUNT_ALLOCS
+    classify_allocations += n_allocations - allocs_before;
+#endif
 
-    // discard none mapped
-    //if ( current_frags.size()==0 ) {
-    //  gnm.count.none_mapped++;
-    //  continue;
-    //}
+    if ( params.pileup ) {
+      pileup.add(outcome);
+    }
+    if ( ouf ) {
+      ouf->write(outcome);
+    }
+    if ( multiway && is_multiway(outcome) ) {
+      multiway->add(work.all,set_hash);
+    }
 
+    // stop once enough targets have reached --stop-when-saturated
+    if ( params.stop_saturated > 0 &&
+	 outcome.kind == set_outcome::intrachrom &&
+	 gnm.count.validPairs[outcome.target_id] == params.stop_saturated &&
+	 ++nsaturated == saturated_needed ) {
+      gnm.count.stopped_early = 1;
+      gnm.count.input_read = input_fraction(samfile, bam != NULL ?
+					    bam->position() : insam.consumed);
+      break;
+    }
     
-    // count targets
-    currentNtargs = 0;
-    for (genome::it_rest_set F=current_frags.begin(); F!=current_frags.end();
-	 ++F) {
-      if ( F->is_target ) {
-	currentNtargs++;
-      }
+  }
+
+  if ( meter ) {
+    show_progress(*meter,gnm,insam,bam,dedup,params);
+    meter->stop();
+  }
+
+  insam.close();
+  delete bam;
+  if ( gnm.count.total_read_sets == 0 ) {
+    throw std::runtime_error("samfile does not contain any entries");
+  }
+
+  if ( readsets ) {
+    readsets->close(gnm);
+  }
+  if ( multiway ) {
+    multiway->close(gnm);
+  }
+  if ( ouf ) {
+    if ( params.save_state != "" ) {
+      ouf->sync(lanes.pairs_sizes);
     }
-   
-    // discard notargets
-    if ( currentNtargs == 0 ) {
-      gnm.count.no_targets++;
-      continue;
+    ouf->close();
+  }
+  if ( params.pileup ) {
+    pileup.output(gnm,fname_out);
+  }
+
+
+  // Output a message
+  std::stringstream mymessage;
+  mymessage<<"...Parsed "<<gnm.count.total_read_sets-lanes.sets_done
+	   <<" reads from SAM file "<<samfile;
+  COMMON_NS::message( mymessage.str() );
+  if ( gnm.count.stopped_early ) {
+    mymessage.str("");
+    mymessage<<"...Stopped as "<<nsaturated<<" of "<<gnm.targets.size()
+	     <<" targets have "<<params.stop_saturated<<" valid pairs";
+    if ( gnm.count.input_read > 0 ) {
+      mymessage<<", after "<<std::fixed<<std::setprecision(2)
+	       <<100.*gnm.count.input_read<<"% of the input";
     }
+    COMMON_NS::message( mymessage.str() );
+  }
+  if ( readsets ) {
+    mymessage.str("");
+    mymessage<<"...Saved the read sets to "<<params.save_readsets;
+    COMMON_NS::message( mymessage.str() );
+  }
 
-    // discard multitargets
-    if ( currentNtargs > 1 ) {
-      gnm.count.multiple_targets++;
-      continue;
+  // save the state for adding later lanes
+  if ( params.save_state != "" ) {
+    lanes.sets_done = gnm.count.total_read_sets;
+    lanes.input_offset = 0;
+    lanes.save(params.save_state,gnm,pileup);
+    mymessage.str("");
+    mymessage<<"...Saved the state after "<<lanes.sets_done<<" reads to "
+	     <<params.save_state;
+    COMMON_NS::message( mymessage.str() );
+  }
+
+#ifdef CAPC_COUNT_ALLOCS
+  mymessage.str("");
+  mymessage<<"...Heap allocations during read set classification : "
+	   <<classify_allocations;
+  COMMON_NS::message( mymessage.str() );
+#endif
+  
+}
+
+
+namespace {
+
+  // shared state for a threaded parse of a SAM file
+
+  typedef std::vector< std::vector<CAPCMAIN_NS::samfrag> > chunk_sets;
+
+  struct chunk_output {
+    // output from one chunk, held until it is that chunk's turn to write
+    std::map<int,std::string> pairs,        // by target_id
+      inter;
+    std::string readsets,                   // encoded for --save-readsets
+      multiway;                             // and for --multiway
+    std::uint32_t nreadsets,
+      nmultiway;
+    chunk_output() : nreadsets(0), nmultiway(0) {}
+  };
+
+  struct threaded_parse {
+
+    const CAPCMAIN_NS::genome &gnm;
+    const CAPCMAIN_NS::parameters &params;
+
+    // chunks come either from byte ranges of a mapped SAM file, or are
+    // read in order by the main thread and queued
+    const CAPCMAIN_NS::mapped_samfile *sam;
+    std::size_t chunksize;
+    std::atomic<std::size_t> next_chunk;
+
+    std::deque< std::pair<std::size_t,chunk_sets*> > queue;
+    bool all_queued;
+
+    CAPCMAIN_NS::sharded_dedup dedup;
+
+    // chunks wait until all earlier chunks have put their keys in the
+    // duplicate table, and write in order of chunk number
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<char> inserted;
+    std::size_t all_inserted_below,
+      written_below;
+    bool failed;
+    std::string error;
+
+    CAPCMAIN_NS::pairs_output *ouf;         // NULL if no pairs files
+    CAPCMAIN_NS::progress_meter *meter;     // NULL if no heartbeat
+    CAPCMAIN_NS::readset_writer *readsets,  // NULL if not saved
+      *multiway;
+
+    threaded_parse(const CAPCMAIN_NS::genome &g,
+		   const CAPCMAIN_NS::parameters &p,
+		   CAPCMAIN_NS::pairs_output *o) :
+      gnm(g), params(p), sam(NULL), chunksize(0), next_chunk(0),
+      all_queued(0), all_inserted_below(0), written_below(0), failed(0),
+      ouf(o), meter(NULL), readsets(NULL), multiway(NULL) {}
+
+  };
+
+
+  void read_chunk(threaded_parse &tp, const std::size_t &c,
+		  chunk_sets &sets) {
+    // read all the sets in one byte range of the mapped file
+
+    using namespace CAPCMAIN_NS;
+
+    std::size_t pos = tp.sam->snap( c*tp.chunksize ),
+      end = tp.sam->snap( (c+1)*tp.chunksize ),
+      e;
+    samfrag frag;
+
+    while ( pos < end ) {
+      e = tp.sam->line_end(pos);
+      samfrag::samline2samfrag( std::string_view(tp.sam->data+pos, e-pos),
+				tp.sam->refs, frag );
+      pos = e < tp.sam->size ? e+1 : e;
+      if ( sets.empty() || sets.back().back().setname != frag.setname ) {
+	sets.push_back( std::vector<samfrag>() );
+      }
+      sets.back().push_back(frag);
     }
 
-    
-    // get the current target
-    for (genome::it_rest_set F =current_frags.begin(); F!=current_frags.end() ;
-	 ) {
-      if ( F->is_target ) {
-	genome::it_targs T;
-	T = gnm.targets.lower_bound( target(F->targetname) );
-	if ( T->name != F->targetname ) {
-	  throw std::runtime_error("something went wrong "
-				   "identifying a target.");
-	}
-	current_target = *(T);
-	current_frags.erase(F++);
-	F = current_frags.end();
-      } else {
-	++F;
+  }
+
+
+  void do_chunk(threaded_parse &tp, const std::size_t &c,
+		const chunk_sets &sets, CAPCMAIN_NS::genome::counters &count,
+		CAPCMAIN_NS::pileup_counts &pileup) {
+    // dedup, classify and write one chunk
+
+    using namespace CAPCMAIN_NS;
+
+    std::vector<std::string> keys;
+    std::vector<char> skip;
+    chunk_output out;
+    set_outcome outcome;
+    CAPCMAIN_NS::classify_workspace work;
+    unsigned long int set_hash;
+
+    // put keys in the duplicate table; set numbers are chunk then position.
+    // With shards, sets belonging to another shard are skipped.
+    keys.resize( sets.size() );
+    skip.assign( sets.size(), 0 );
+    for (std::size_t i=0; i<sets.size(); i++) {
+      if ( count_mapped(sets[i]) > 0 ) {
+	keys[i] = genome::duplicate_key(sets[i]);
+      }
+      if ( tp.params.nshards > 1 &&
+	   !in_shard( keys[i].empty() ? sets[i].back().setname : keys[i],
+		      tp.params) ) {
+	skip[i] = 1;
+	continue;
+      }
+      if ( !keys[i].empty() ) {
+	tp.dedup.insert( keys[i], (c<<32) + i );
       }
     }
-  
-    // discard no reporters
-    if ( current_frags.size() == 0 ) {
-      gnm.count.no_reporters++;
-      continue;
+
+    // wait for all earlier chunks to do the same
+    {
+      std::unique_lock<std::mutex> guard(tp.lock);
+      tp.inserted[c] = 1;
+      while ( tp.all_inserted_below < tp.inserted.size() &&
+	      tp.inserted[tp.all_inserted_below] ) {
+	tp.all_inserted_below++;
+      }
+      tp.cond.notify_all();
+      while ( tp.all_inserted_below < c && !tp.failed ) {
+	tp.cond.wait(guard);
+      }
+      if ( tp.failed ) {
+	return;
+      }
     }
 
+    // now classify
+    progress_meter::totals before(count);
+    for (std::size_t i=0; i<sets.size(); i++) {
+      if ( skip[i] ) {
+	continue;
+      }
+      count.total_read_frags += sets[i].size();
+      count.total_read_sets++;
 
-    // discard due to exclusion around targets
-    for (genome::it_targs T=gnm.targets.begin()  ; T!=gnm.targets.end()  ;
-	 ++T) {
-      for (genome::it_rest_set F=current_frags.begin(); F!=current_frags.end();
-	   ) {
-	if ( F->chrom==T->chrom &&
-	     std::abs(0.5*(F->start+F->end) - 0.5*(T->start+T->end))
-	     <=params.exclusion ) {
-	  current_frags.erase(F++);
-	} else {
-	  ++F;
-	}
-      } 
-    }
-    if ( current_frags.size() == 0 ) {
-      gnm.count.exclusion++;
-      continue;
+      if ( keys[i].empty() ) {
+	count.none_mapped++;
+	continue;
+      }
+      if ( tp.dedup.is_duplicate( keys[i], (c<<32) + i ) ) {
+	count.duplicates_removed++;
+	continue;
+      }
+
+      expand_read_set(tp.gnm,sets[i],work);
+      set_hash = string_hash(sets[i].back().setname);
+      if ( tp.readsets != NULL ) {
+	readset_writer::encode(out.readsets,work.frags,set_hash);
+	out.nreadsets++;
+      }
+      classify_fragments(tp.gnm,tp.params,count,set_hash,work,outcome);
+      if ( tp.multiway != NULL && is_multiway(outcome) ) {
+	readset_writer::encode(out.multiway,work.all,set_hash);
+	out.nmultiway++;
+      }
+
+      if ( tp.params.pileup ) {
+	pileup.add(outcome);
+      }
+      if ( tp.ouf == NULL ) {
+	continue;
+      }
+      if ( outcome.kind == set_outcome::intrachrom ) {
+	tp.ouf->append_record(out.pairs[outcome.target_id],*outcome.reporter);
+      } else if ( outcome.kind == set_outcome::interchrom &&
+		  tp.params.save_inter ) {
+	tp.ouf->append_record(out.inter[outcome.target_id],*outcome.reporter);
+      }
     }
-    
-    // count and then discard if only interchrom
-    set_of_interchroms.clear();
-    for (genome::it_rest_set F=current_frags.begin(); F!=current_frags.end();
-	 ) {
-      if ( F->chrom != current_target.chrom ) {
-	set_of_interchroms.push_back(*F);
-	current_frags.erase(F++);
-	// this is the correct way to remove without invalidating the iterator
-	// passes a copy of F, then increments the original F
-	// before the current one is erased
-      } else {
-	++F;
+
+    if ( tp.meter != NULL ) {
+      tp.meter->add( before, progress_meter::totals(count) );
+      tp.meter->dedup_keys.store( tp.dedup.size(), std::memory_order_relaxed );
+      if ( tp.sam != NULL ) {
+	tp.meter->bytes.fetch_add( tp.sam->snap( (c+1)*tp.chunksize ) -
+				   tp.sam->snap( c*tp.chunksize ),
+				   std::memory_order_relaxed );
       }
     }
-    if ( current_frags.size() == 0 ) {
-      gnm.count.onlyInter[current_target.name]++;
-      gnm.count.total_interchrom++;
-      if ( params.save_inter ) {
-	// choose one at random by shuffling the vector
-	std::random_shuffle ( set_of_interchroms.begin(), set_of_interchroms.end() );
-	*(oufinter.find(current_target.name)->second)<<
-	  set_of_interchroms[0].chrom<<"\t"<<
-	  set_of_interchroms[0].start<<"\t"<<
-	  set_of_interchroms[0].end<<//"\t"<<     // uncomment these lines to 
-	  //current_sams.back().setname<<         // also output the read name
-	  std::endl;
+
+    // write out in chunk order
+    {
+      std::unique_lock<std::mutex> guard(tp.lock);
+      while ( tp.written_below < c && !tp.failed ) {
+	tp.cond.wait(guard);
       }
-      continue;
+      if ( tp.failed ) {
+	return;
+      }
+      for (std::map<int,std::string>::iterator it=out.pairs.begin();
+	   it!=out.pairs.end(); ++it) {
+	tp.ouf->write(intra_pairs,it->first,it->second);
+      }
+      for (std::map<int,std::string>::iterator it=out.inter.begin();
+	   it!=out.inter.end(); ++it) {
+	tp.ouf->write(inter_pairs,it->first,it->second);
+      }
+      if ( tp.readsets != NULL ) {
+	tp.readsets->add_encoded(out.readsets,out.nreadsets);
+      }
+      if ( tp.multiway != NULL ) {
+	tp.multiway->add_encoded(out.multiway,out.nmultiway);
+      }
+      tp.written_below++;
+      tp.cond.notify_all();
     }
 
-    
-    // discard multi nonadjacent reporters
-    nonAdjacent = 0;
-    if ( current_frags.size() > 1 ) {
-      genome::it_rest_set F = current_frags.begin();
-      int lastend = F->end;
-      for ( ++F ; F != current_frags.end() ; ++F ) {
-	if ( F->start != lastend ) {
-	  nonAdjacent++;
-	}
-	lastend = F->end;
+  }
+
+
+  bool get_chunk(threaded_parse &tp, std::size_t &c, chunk_sets* &sets) {
+    // get the next chunk to work on; false if there are none left
+
+    if ( tp.sam != NULL ) {
+      c = tp.next_chunk++;
+      if ( c >= tp.inserted.size() ) {
+	return false;
       }
+      sets = new chunk_sets;
+      read_chunk(tp,c,*sets);
+      return true;
     }
-    if ( nonAdjacent > 0 ) { 
-      gnm.count.multiple_reporters++;
-      continue;
+
+    std::unique_lock<std::mutex> guard(tp.lock);
+    while ( tp.queue.empty() && !tp.all_queued && !tp.failed ) {
+      tp.cond.wait(guard);
+    }
+    if ( tp.queue.empty() || tp.failed ) {
+      return false;
     }
+    c = tp.queue.front().first;
+    sets = tp.queue.front().second;
+    tp.queue.pop_front();
+    tp.cond.notify_all();
+    return true;
+
+  }
 
 
-    // it must be a valid read!!!!
-    gnm.count.total_validPairs++;
-    gnm.count.validPairs[current_target.name]++;
+  void set_failed(threaded_parse &tp, const std::string &what) {
+    // record the first error, and wake everyone so they can stop
+    std::unique_lock<std::mutex> guard(tp.lock);
+    if ( !tp.failed ) {
+      tp.failed = 1;
+      tp.error = what;
+    }
+    tp.cond.notify_all();
+  }
 
-    // is it within 5Mb of the target? (lets use the start coords of the first)
-    if (abs(current_frags.begin()->start-current_target.start)<=5e6) {
-      gnm.count.within5Mb[current_target.name]++;
-      // is it within 1Mb of the target?
-      if (abs(current_frags.begin()->start-current_target.start)<=1e6) {
-	gnm.count.within1Mb[current_target.name]++;
+
+  void worker(threaded_parse &tp, CAPCMAIN_NS::genome::counters &count,
+	      CAPCMAIN_NS::pileup_counts &pileup) {
+    // take chunks in order until there are none left
+
+    std::size_t c;
+    chunk_sets *sets = NULL;
+
+    try {
+      while ( get_chunk(tp,c,sets) ) {
+	do_chunk(tp,c,*sets,count,pileup);
+	delete sets;
+	sets = NULL;
       }
+    } catch (const std::exception& e) {
+      delete sets;
+      set_failed(tp,e.what());
     }
 
+  }
 
-    // Choice here to give only the middle of any adjacent set of frags
-    {
-      genome::it_rest_set F = current_frags.begin();
-      std::advance(F, std::floor( 0.5*double(current_frags.size()) ));
-      if ( oufpairs.find(current_target.name)==oufpairs.end() ) {
-	// check if found one : this should never happen
-	throw std::runtime_error("target error");
+
+  void queue_chunks(threaded_parse &tp, CAPCMAIN_NS::sam_reader &insam,
+		    CAPCMAIN_NS::bam_reader *bam) {
+    // read sets in order from a BAM file or a SAM stream, and queue them
+    // in chunks for the workers
+
+    const std::size_t sets_per_chunk = 20000;
+    const std::size_t max_queued = 2*tp.params.nthreads;
+    chunk_sets *sets = new chunk_sets;
+
+    try {
+      sets->push_back( std::vector<CAPCMAIN_NS::samfrag>() );
+      while ( CAPCMAIN_NS::next_read_set(insam,bam,sets->back()) ) {
+	if ( sets->size() < sets_per_chunk ) {
+	  sets->push_back( std::vector<CAPCMAIN_NS::samfrag>() );
+	  continue;
+	}
+	std::unique_lock<std::mutex> guard(tp.lock);
+	while ( tp.queue.size() >= max_queued && !tp.failed ) {
+	  tp.cond.wait(guard);
+	}
+	if ( tp.failed ) {
+	  break;
+	}
+	tp.queue.push_back( std::make_pair(tp.inserted.size(),sets) );
+	tp.inserted.push_back(0);
+	tp.cond.notify_all();
+	if ( tp.meter != NULL ) {
+	  tp.meter->bytes.store( bam != NULL ? bam->consumed : insam.consumed,
+				 std::memory_order_relaxed );
+	}
+	sets = new chunk_sets;
+	sets->push_back( std::vector<CAPCMAIN_NS::samfrag>() );
       }
-      *(oufpairs.find(current_target.name)->second)<<F->chrom<<"\t"
-						   <<F->start<<"\t"
-						   <<F->end//<<"\t" // uncomment these lines to 
-	//<<current_sams.back().setname  // also output the read name
-						   <<std::endl;
+      // the last set is always empty
+      sets->pop_back();
+    } catch (const std::exception& e) {
+      set_failed(tp,e.what());
     }
 
-    
-  } while ( infsam.peek() != EOF );
+    std::unique_lock<std::mutex> guard(tp.lock);
+    if ( sets->size() > 0 && !tp.failed ) {
+      tp.queue.push_back( std::make_pair(tp.inserted.size(),sets) );
+      tp.inserted.push_back(0);
+    } else {
+      delete sets;
+    }
+    tp.all_queued = 1;
+    tp.cond.notify_all();
+
+  }
+
+}
+
+
+void CAPCMAIN_NS::parse_sam_file_threaded(genome& gnm,
+					  const std::string& samfile,
+					  const std::string& fname_out,
+					  const parameters &params) {
+  // Parse the SAM file using several threads. A SAM file is mapped into
+  // memory and split into chunks at read set boundaries; a BAM file, or a
+  // SAM file which cannot be mapped (e.g. a pipe), is read by this thread
+  // and passed out in chunks. Each thread keeps its own
+  // counters and pile-up, and output is written in chunk order, so
+  // everything matches a serial run.
+
+  std::vector<std::thread> threads;
+  std::vector<genome::counters*> counts;
+  std::vector<pileup_counts> piles(params.nthreads);
+  mapped_samfile *sam = NULL;
+  bam_reader *bam = NULL;
+  sam_reader insam;
+
+  if ( bam_reader::is_bam(samfile) || !mapped_samfile::can_map(samfile) ) {
+    bam = open_sam_input(samfile,insam,params.nthreads);
+    gnm.set_references( bam != NULL ? bam->refs : insam.refs );
+  } else {
+    sam = new mapped_samfile(samfile);
+    gnm.set_references( sam->refs );
+  }
+
+  std::unique_ptr<pairs_output> ouf;
+  check_pileup_files(gnm,fname_out,params);
+  if ( params.pairs_files ) {
+    ouf.reset( new pairs_output(gnm,fname_out,params) );
+  }
+
+  std::unique_ptr<readset_writer> readsets,
+    multiway( open_multiway(gnm,fname_out,params) );
+  if ( params.save_readsets != "" ) {
+    readsets.reset( new readset_writer(params.save_readsets,gnm,params) );
+  }
+
+  std::unique_ptr<progress_meter> meter;
+  if ( params.progress_interval > 0 ) {
+    meter.reset( new progress_meter(samfile,params) );
+  }
 
-  // Now close the files and tidy up
-  for (std::map< std::string,std::ofstream* >::iterator it  = oufpairs.begin() ;
-       it != oufpairs.end() ; ++it) {
-    it->second->close();
-    delete it->second;
+  threaded_parse tp(gnm,params,ouf.get());
+  tp.meter = meter.get();
+  tp.readsets = readsets.get();
+  tp.multiway = multiway.get();
+  if ( sam != NULL ) {
+    tp.sam = sam;
+    tp.chunksize = 4*1024*1024;
+    tp.inserted.assign( (sam->size + tp.chunksize - 1)/tp.chunksize, 0 );
   }
 
-  if ( params.save_inter ) {
-    for (std::map< std::string,std::ofstream* >::iterator it  = oufinter.begin() ;
-	 it != oufinter.end() ; ++it) {
-      it->second->close();
-      delete it->second;
+  for (unsigned int t=0; t<params.nthreads; t++) {
+    counts.push_back( new genome::counters(gnm) );
+    counts.back()->setup();
+    if ( params.pileup ) {
+      piles[t].setup(gnm,params.save_inter,params.combine);
     }
   }
+  for (unsigned int t=0; t<params.nthreads; t++) {
+    threads.push_back( std::thread(worker, std::ref(tp),
+				   std::ref(*counts[t]), std::ref(piles[t])) );
+  }
+  if ( sam == NULL ) {
+    queue_chunks(tp,insam,bam);
+  }
+  for (unsigned int t=0; t<params.nthreads; t++) {
+    threads[t].join();
+  }
 
+  // merge the counters from each thread
+  for (unsigned int t=0; t<params.nthreads; t++) {
+    gnm.count.add( *counts[t] );
+    delete counts[t];
+  }
+  if ( meter ) {
+    meter->set( progress_meter::totals(gnm.count) );
+    meter->bytes.store( sam != NULL ? sam->size : bam != NULL ? bam->consumed :
+			insam.consumed, std::memory_order_relaxed );
+    meter->stop();
+  }
+
+  delete sam;
+  delete bam;
+
+  if ( tp.failed ) {
+    throw std::runtime_error(tp.error);
+  }
+  if ( readsets ) {
+    readsets->close(gnm);
+  }
+  if ( multiway ) {
+    multiway->close(gnm);
+  }
+  if ( ouf ) {
+    ouf->close();
+  }
+  if ( params.pileup ) {
+    for (unsigned int t=1; t<params.nthreads; t++) {
+      piles[0].add( piles[t] );
+    }
+    piles[0].output(gnm,fname_out);
+  }
+  if ( gnm.count.total_read_sets == 0 ) {
+    throw std::runtime_error("samfile does not contain any entries");
+  }
 
   // Output a message
   std::stringstream mymessage;
   mymessage<<"...Parsed "<<gnm.count.total_read_sets
-	   <<" reads from SAM file "<<samfile;
+	   <<" reads from SAM file "<<samfile
+	   <<" using "<<params.nthreads<<" threads";
   COMMON_NS::message( mymessage.str() );
+  if ( readsets ) {
+    mymessage.str("");
+    mymessage<<"...Saved the read sets to "<<params.save_readsets;
+    COMMON_NS::message( mymessage.str() );
+  }
   
 }
 
+
+void CAPCMAIN_NS::reclassify_read_sets(genome& gnm,
+				       const std::string& fname_out,
+				       const parameters &params) {
+  // Classify the read sets saved by --save-readsets, in place of parsing a
+  // SAM file. These are the sets which were mapped and not duplicates, so
+  // the counts of the others are taken from the file.
+
+  readset_reader inf(params.from_readsets,gnm);
+  set_outcome outcome;
+  classify_workspace work;
+  std::uint64_t set_hash;
+  unsigned long int nsets = 0;
+
+  if ( inf.shard != params.shard || inf.nshards != params.nshards ) {
+    std::stringstream s;
+    s<<"read set file "<<params.from_readsets<<" was written by a run with "
+     <<"--shard "<<inf.shard<<"/"<<inf.nshards<<"; use the same --shard";
+    throw std::runtime_error(s.str());
+  }
+
+  std::unique_ptr<pairs_output> ouf;
+  pileup_counts pileup;
+  check_pileup_files(gnm,fname_out,params);
+  if ( params.pileup ) {
+    pileup.setup(gnm,params.save_inter,params.combine);
+  }
+  if ( params.pairs_files ) {
+    ouf.reset( new pairs_output(gnm,fname_out,params) );
+  }
+  std::unique_ptr<readset_writer> multiway( open_multiway(gnm,fname_out,
+							  params) );
+
+  while ( inf.next(work.frags,set_hash) ) {
+    classify_fragments(gnm,params,gnm.count,set_hash,work,outcome);
+    if ( params.pileup ) {
+      pileup.add(outcome);
+    }
+    if ( ouf ) {
+      ouf->write(outcome);
+    }
+    if ( multiway && is_multiway(outcome) ) {
+      multiway->add(work.all,set_hash);
+    }
+    nsets++;
+  }
+
+  gnm.count.total_read_frags = inf.total_read_frags;
+  gnm.count.total_read_sets = inf.total_read_sets;
+  gnm.count.none_mapped = inf.none_mapped;
+  gnm.count.duplicates_removed = inf.duplicates_removed;
+  if ( gnm.count.total_read_sets == 0 ) {
+    throw std::runtime_error("samfile does not contain any entries");
+  }
+
+  if ( multiway ) {
+    multiway->close(gnm);
+  }
+  if ( ouf ) {
+    ouf->close();
+  }
+  if ( params.pileup ) {
+    pileup.output(gnm,fname_out);
+  }
+
+  // Output a message
+  std::stringstream mymessage;
+  mymessage<<"...Classified "<<nsets<<" read sets from "
+	   <<params.from_readsets<<" ("<<gnm.count.total_read_sets
+	   <<" reads in all)";
+  COMMON_NS::message( mymessage.str() );
+
+}
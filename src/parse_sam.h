@@ -22,20 +22,72 @@
 #ifndef PARSESAME_H
 #define PARSESAME_H
 
+#include "bedfiles.h"
+#include "genome.h"
+
 #include <string>
 #include <fstream>
+#include <vector>
+#include <map>
 
 namespace CAPCMAIN_NS {
 
   // Forward Declarations
-  struct genome;
   struct parameters;
+  struct samfrag;
+  struct external_dedup;
+  struct bam_reader;
+  struct sam_reader;
+
+  // Structures
+  struct set_outcome {
+    // what became of a read set, for the caller to write out; sets with
+    // several targets or reporters are told apart for --multiway
+    enum kinds { discarded, interchrom, intrachrom, multiple_targets,
+		 multiple_reporters } kind;
+    int target_id;
+    const rest_fragment *reporter;     // points into the genome
+  };
+
+  struct classify_workspace {
+    // lists of fragments used by classify_fragments, kept between read sets
+    // so that their storage is reused; with --multiway, all holds the
+    // fragments of the set before any are taken out
+    static const std::size_t reserved = 64;
+    std::vector<const rest_fragment*> frags,
+      inter,
+      all;
+    classify_workspace() {
+      frags.reserve(reserved);
+      inter.reserve(reserved);
+      all.reserve(reserved);
+    }
+  };
 
   // Functions
   void parse_sam_file(genome&, const std::string&, const std::string&,
 		      const parameters&);
-  bool peakheader(std::ifstream&);
-  bool peaksamline(std::ifstream&, const std::string&);
+  void parse_sam_file_threaded(genome&, const std::string&,
+			       const std::string&, const parameters&);
+  void reclassify_read_sets(genome&, const std::string&, const parameters&);
+  void expand_read_set(const genome&, const std::vector<samfrag>&,
+		       classify_workspace&);
+  void classify_fragments(const genome&, const parameters&, genome::counters&,
+			  const unsigned long int&, classify_workspace&,
+			  set_outcome&);
+  int count_mapped(const std::vector<samfrag>&);
+  unsigned long int string_hash(const std::string&);
+  std::size_t pick_interchrom(const unsigned long int&, const std::size_t&);
+  std::string shard_key(const std::vector<samfrag>&);
+  bool in_shard(const std::string&, const parameters&);
+  void check_pileup_files(const genome&, const std::string&,
+			  const parameters&);
+  std::string scratch_prefix(const std::string&, const parameters&);
+  bam_reader* open_sam_input(const std::string&, sam_reader&,
+			     const unsigned int&);
+  bool next_read_set(sam_reader&, bam_reader*, std::vector<samfrag>&);
+  void scan_for_duplicates(const std::string&, external_dedup&,
+			   const parameters&);
   
 }
 
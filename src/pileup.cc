@@ -0,0 +1,227 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "pileup.h"
+#include "genome.h"
+#include "parse_sam.h"
+#include "messages.h"
+
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdexcept>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  struct pileup_group {
+    // targets whose pairs go into one bedGraph : a single target, or those
+    // combined as in the pipeline (names containing _C are combined into
+    // the part before the first _C, followed by _combined)
+    std::string name;
+    std::vector<int> target_ids;              // in order of the targets file
+  };
+
+  std::vector<pileup_group> pileup_groups(const genome &gnm,
+					  const bool &combine) {
+
+    std::vector<pileup_group> groups;
+    std::vector<pileup_group> combined;
+    std::size_t c;
+
+    for (std::size_t t=0; t<gnm.targets_by_id.size(); t++) {
+      const std::string &name = gnm.targets_by_id[t]->name;
+      groups.push_back( pileup_group() );
+      groups.back().name = name;
+      groups.back().target_ids.push_back(t);
+
+      if ( combine && name.find("_C") != std::string::npos ) {
+	std::string front = name.substr(0,name.find("_C")) + "_combined";
+	for (c=0; c<combined.size() && combined[c].name!=front; c++) {}
+	if ( c == combined.size() ) {
+	  combined.push_back( pileup_group() );
+	  combined.back().name = front;
+	}
+	combined[c].target_ids.push_back(t);
+      }
+    }
+
+    groups.insert(groups.end(), combined.begin(), combined.end());
+    return groups;
+
+  }
+
+  std::string bedgraph_name(const std::string &fname_out, const bool &inter,
+			    const std::string &name) {
+    return fname_out + ( inter ? "_rawpileup_interchom_" : "_rawpileup_" )
+      + name + ".bdg";
+  }
+
+}
+
+
+void pileup_counts::setup(const genome &gnm, const bool &save,
+			  const bool &comb) {
+  // one set of counts for each target
+  save_inter = save;
+  combine = comb;
+  intra.assign( gnm.targets_by_id.size(), fragment_counts() );
+  if ( save_inter ) {
+    inter.assign( gnm.targets_by_id.size(), fragment_counts() );
+  }
+}
+
+
+void pileup_counts::add(const set_outcome &outcome) {
+  // count the reporter of a valid pair
+
+  if ( outcome.kind == set_outcome::intrachrom ) {
+    intra[outcome.target_id][outcome.reporter->fragment_id]++;
+  } else if ( outcome.kind == set_outcome::interchrom && save_inter ) {
+    inter[outcome.target_id][outcome.reporter->fragment_id]++;
+  }
+
+}
+
+
+void pileup_counts::add(const pileup_counts &other) {
+  // add counts from another thread
+
+  for (std::size_t t=0; t<other.intra.size(); t++) {
+    for (fragment_counts::const_iterator it=other.intra[t].begin();
+	 it!=other.intra[t].end(); ++it) {
+      intra[t][it->first] += it->second;
+    }
+  }
+  for (std::size_t t=0; t<other.inter.size(); t++) {
+    for (fragment_counts::const_iterator it=other.inter[t].begin();
+	 it!=other.inter[t].end(); ++it) {
+      inter[t][it->first] += it->second;
+    }
+  }
+
+}
+
+
+std::vector<std::string> pileup_counts::output_files(const genome &gnm,
+						     const std::string &fname_out,
+						     const bool &save,
+						     const bool &comb) {
+  // names of all the bedGraphs which will be written
+
+  std::vector<pileup_group> groups = pileup_groups(gnm,comb);
+  std::vector<std::string> names;
+
+  for (std::size_t g=0; g<groups.size(); g++) {
+    names.push_back( bedgraph_name(fname_out,0,groups[g].name) );
+    if ( save ) {
+      names.push_back( bedgraph_name(fname_out,1,groups[g].name) );
+    }
+  }
+  return names;
+
+}
+
+
+void pileup_counts::output(const genome &gnm,
+			   const std::string &fname_out) const {
+  // Write the raw pile-up bedGraphs, the same as capCpair2bg would from
+  // the pairs files. Fragment IDs are in order of chromosome name then
+  // start, which is the order capCpair2bg writes in.
+
+  std::vector<pileup_group> groups = pileup_groups(gnm,combine);
+  std::vector<const rest_fragment*> fragments( gnm.Nfragments, NULL );
+  std::vector< std::pair<unsigned int, unsigned long int> > sorted;
+  fragment_counts sum;
+  std::ofstream ouf;
+  std::string fname;
+  const std::vector<fragment_counts> *counts;
+
+  for ( genome::const_it_rest_map C=gnm.restriction_fragments.begin();
+	C != gnm.restriction_fragments.end(); ++C ) {
+    for ( genome::const_it_rest_set F=C->second.begin();
+	  F != C->second.end(); ++F ) {
+      fragments[ F->fragment_id ] = &*F;
+    }
+  }
+
+  for (int k=0; k <= ( save_inter ? 1 : 0 ); k++) {
+    counts = k == 0 ? &intra : &inter;
+
+    for (std::size_t g=0; g<groups.size(); g++) {
+      const pileup_group &G = groups[g];
+
+      // add up the targets in the group, and sort by fragment
+      const fragment_counts *these = &(*counts)[ G.target_ids[0] ];
+      if ( G.target_ids.size() > 1 ) {
+	sum.clear();
+	for (std::size_t i=0; i<G.target_ids.size(); i++) {
+	  const fragment_counts &c = (*counts)[ G.target_ids[i] ];
+	  for (fragment_counts::const_iterator it=c.begin(); it!=c.end(); ++it) {
+	    sum[it->first] += it->second;
+	  }
+	}
+	these = &sum;
+      }
+      sorted.assign( these->begin(), these->end() );
+      std::sort( sorted.begin(), sorted.end() );
+
+      fname = bedgraph_name(fname_out,k==1,G.name);
+      ouf.open( fname.c_str() );
+      if ( !ouf.good() ) {
+	throw std::runtime_error("cannot open file "+fname);
+      }
+
+      // output a header line
+      ouf<<"track type=bedGraph name=\""<<G.name<<"\" description=\""
+	 <<"Target: "<<G.name;
+      if ( G.target_ids.size() > 1 ) {
+	ouf<<" at locations";
+      } else {
+	ouf<<" at location";
+      }
+      for (std::size_t i=0; i<G.target_ids.size(); i++) {
+	const target &T = *gnm.targets_by_id[ G.target_ids[i] ];
+	ouf<<" "<<T.chrom<<":"<<T.start<<"-"<<T.end;
+      }
+      ouf<<"\"\n";
+
+      // now output pilups
+      for (std::size_t i=0; i<sorted.size(); i++) {
+	const rest_fragment &F = *fragments[ sorted[i].first ];
+	ouf<<F.chrom<<"\t"<<F.start<<"\t"<<F.end<<"\t"<<sorted[i].second<<"\n";
+      }
+
+      ouf.close();
+      if ( ouf.fail() ) {
+	throw std::runtime_error("error writing to file "+fname);
+      }
+    }
+  }
+
+  std::stringstream mymessage;
+  mymessage<<"...Wrote pile-up bedGraphs for "<<groups.size()<<" targets";
+  COMMON_NS::message( mymessage.str() );
+
+}
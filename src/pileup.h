@@ -0,0 +1,62 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef PILEUP_H
+#define PILEUP_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace CAPCMAIN_NS {
+
+  // Forward Declarations
+  struct genome;
+  struct set_outcome;
+
+  struct pileup_counts {
+    // Number of valid pairs at each reporter fragment, for each target,
+    // kept so that capCmain can write the raw pile-up bedGraphs itself
+    // instead of capCpair2bg reading back the pairs files. Each thread
+    // keeps its own counts, which are added together at the end.
+
+    typedef std::unordered_map<unsigned int, unsigned long int>
+      fragment_counts;                          // by fragment_id
+
+    std::vector<fragment_counts> intra,         // by target_id
+      inter;
+    bool save_inter,
+      combine;                                  // also combined targets
+
+    void setup(const genome&, const bool&, const bool&);
+    void add(const set_outcome&);
+    void add(const pileup_counts&);
+
+    static std::vector<std::string> output_files(const genome&,
+						 const std::string&,
+						 const bool&, const bool&);
+    void output(const genome&, const std::string&) const;
+  };
+
+}
+
+#endif
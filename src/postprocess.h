@@ -32,6 +32,7 @@ namespace POSTPROCESS_NS {
     unsigned int Ninfiles;
     std::string targetname;
     std::string chromsizesname;
+    std::string fragfile;
 
     std::vector<std::string> infile,
       location;
@@ -0,0 +1,229 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "progress.h"
+#include "main_process.h"
+
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdio>
+#include <stdexcept>
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace CAPCMAIN_NS;
+
+
+progress_meter::totals::totals(const genome::counters &count) :
+  read_sets(count.total_read_sets), duplicates(count.duplicates_removed),
+  valid(count.total_validPairs), interchrom(count.total_interchrom),
+  excluded(count.exclusion) {}
+
+
+progress_meter::progress_meter(const std::string& samfile,
+			       const parameters& params) :
+  read_sets(0), duplicates(0), valid(0), interchrom(0), excluded(0),
+  bytes(0), dedup_keys(0), input_size(0),
+  interval(params.progress_interval), status_file(params.status_file),
+  stopping(0), started(clock::now()) {
+  // find the size of the input if it is a file, and start the monitor
+
+  struct stat sb;
+  if ( samfile != "-" && stat( samfile.c_str(), &sb ) == 0 &&
+       S_ISREG(sb.st_mode) ) {
+    input_size = sb.st_size;
+  }
+
+  monitor = std::thread(&progress_meter::monitor_loop, this);
+
+}
+
+
+progress_meter::~progress_meter() {
+  stop();
+}
+
+
+void progress_meter::set(const totals& now) {
+  // running totals from a serial parse
+  read_sets.store(now.read_sets,std::memory_order_relaxed);
+  duplicates.store(now.duplicates,std::memory_order_relaxed);
+  valid.store(now.valid,std::memory_order_relaxed);
+  interchrom.store(now.interchrom,std::memory_order_relaxed);
+  excluded.store(now.excluded,std::memory_order_relaxed);
+}
+
+
+void progress_meter::add(const totals& before, const totals& after) {
+  // what one thread has done since before
+  read_sets.fetch_add(after.read_sets-before.read_sets,
+		      std::memory_order_relaxed);
+  duplicates.fetch_add(after.duplicates-before.duplicates,
+		       std::memory_order_relaxed);
+  valid.fetch_add(after.valid-before.valid,std::memory_order_relaxed);
+  interchrom.fetch_add(after.interchrom-before.interchrom,
+		       std::memory_order_relaxed);
+  excluded.fetch_add(after.excluded-before.excluded,
+		     std::memory_order_relaxed);
+}
+
+
+void progress_meter::stop() {
+  // stop the monitor; a status file is left with the final totals
+
+  {
+    std::unique_lock<std::mutex> guard(lock);
+    if ( stopping ) {
+      return;
+    }
+    stopping = 1;
+    cond.notify_all();
+  }
+  if ( monitor.joinable() ) {
+    monitor.join();
+  }
+
+  if ( status_file != "" ) {
+    double elapsed = std::chrono::duration<double>(clock::now()-started).count();
+    try {
+      report( elapsed, elapsed > 0 ? read_sets/elapsed : 0 );
+    } catch (const std::exception& e) {
+    }
+  }
+
+}
+
+
+void progress_meter::monitor_loop() {
+  // report every interval until stopped; the rate is over the last
+  // interval
+
+  clock::time_point next = started + std::chrono::seconds(interval),
+    last = started;
+  unsigned long int last_sets = 0,
+    sets;
+
+  std::unique_lock<std::mutex> guard(lock);
+  while ( true ) {
+    cond.wait_until(guard,next);
+    if ( stopping ) {
+      break;
+    }
+    if ( clock::now() < next ) {
+      continue;
+    }
+
+    clock::time_point now = clock::now();
+    sets = read_sets.load(std::memory_order_relaxed);
+    try {
+      report( std::chrono::duration<double>(now-started).count(),
+	      (sets-last_sets) /
+	      std::chrono::duration<double>(now-last).count() );
+    } catch (const std::exception& e) {
+      // a heartbeat which cannot be written is not worth stopping for
+    }
+    last = now;
+    last_sets = sets;
+    next += std::chrono::seconds(interval);
+  }
+
+}
+
+
+void progress_meter::report(const double& elapsed,
+			    const double& rate) const {
+  // write one heartbeat : a line on stderr, or the status file (written
+  // under a temporary name and renamed, so it is always complete)
+
+  const double MB = 1024.*1024.;
+  unsigned long int done = bytes.load(std::memory_order_relaxed);
+  std::stringstream eta;
+  std::ostringstream out;
+
+  if ( input_size > 0 && done > 0 && done <= input_size ) {
+    long int s = (long int)( elapsed * (input_size-done) / done );
+    eta<<s/3600<<"h"<<std::setfill('0')<<std::setw(2)<<(s/60)%60<<"m"
+       <<std::setw(2)<<s%60<<"s";
+  } else {
+    eta<<"unknown";
+  }
+
+  out<<std::fixed<<std::setprecision(1);
+  if ( status_file == "" ) {
+    out<<"...Progress : "<<read_sets.load(std::memory_order_relaxed)
+       <<" reads ("<<(unsigned long int)rate<<" reads/s), "
+       <<done/MB<<" MB";
+    if ( input_size > 0 ) {
+      out<<" of "<<input_size/MB<<" MB ("<<100.*done/input_size<<"%)";
+    }
+    out<<", ETA "<<eta.str()<<"; "
+       <<duplicates.load(std::memory_order_relaxed)<<" duplicates, "
+       <<valid.load(std::memory_order_relaxed)<<" valid, "
+       <<interchrom.load(std::memory_order_relaxed)<<" interchromosomal, "
+       <<excluded.load(std::memory_order_relaxed)<<" excluded; "
+       <<dedup_keys.load(std::memory_order_relaxed)<<" duplicate keys; "
+       <<"RSS "<<resident_memory()/MB<<" MB";
+    std::cerr<<out.str()<<std::endl;
+    return;
+  }
+
+  out<<"elapsed_seconds\t"<<elapsed<<"\n"
+     <<"read_sets\t"<<read_sets.load(std::memory_order_relaxed)<<"\n"
+     <<"read_sets_per_second\t"<<rate<<"\n"
+     <<"bytes_read\t"<<done<<"\n"
+     <<"input_bytes\t"<<input_size<<"\n"
+     <<"eta\t"<<eta.str()<<"\n"
+     <<"duplicates\t"<<duplicates.load(std::memory_order_relaxed)<<"\n"
+     <<"valid\t"<<valid.load(std::memory_order_relaxed)<<"\n"
+     <<"interchromosomal\t"<<interchrom.load(std::memory_order_relaxed)<<"\n"
+     <<"excluded\t"<<excluded.load(std::memory_order_relaxed)<<"\n"
+     <<"duplicate_keys\t"<<dedup_keys.load(std::memory_order_relaxed)<<"\n"
+     <<"rss_bytes\t"<<resident_memory()<<"\n";
+
+  std::string tmpname = status_file + ".tmp";
+  std::ofstream ouf( tmpname.c_str() );
+  ouf<<out.str();
+  ouf.close();
+  if ( ouf.fail() || std::rename(tmpname.c_str(),status_file.c_str()) != 0 ) {
+    throw std::runtime_error("cannot write status file "+status_file);
+  }
+
+}
+
+
+unsigned long int CAPCMAIN_NS::resident_memory() {
+  // resident set size in bytes, from /proc; 0 if it cannot be read
+
+  std::ifstream inf("/proc/self/statm");
+  unsigned long int total = 0,
+    resident = 0;
+
+  if ( !(inf>>total>>resident) ) {
+    return 0;
+  }
+  return resident * sysconf(_SC_PAGESIZE);
+
+}
@@ -0,0 +1,92 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef PROGRESS_H
+#define PROGRESS_H
+
+#include "genome.h"
+
+#include <string>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+
+namespace CAPCMAIN_NS {
+
+  // Forward Declarations
+  struct parameters;
+
+  struct progress_meter {
+    // Heartbeat for a long run : every so many seconds a thread writes
+    // the progress so far to stderr, or to a status file. The parse only
+    // hands over its totals now and then (every few thousand read sets, or
+    // once per chunk), so keeping the meter up to date costs next to
+    // nothing; the meter never reads the parser's own counters.
+
+    typedef std::chrono::steady_clock clock;
+
+    struct totals {
+      // the counters which are shown
+      unsigned long int read_sets,
+	duplicates,
+	valid,
+	interchrom,
+	excluded;
+      totals(const genome::counters &);
+    };
+
+    std::atomic<unsigned long int> read_sets,
+      duplicates,
+      valid,
+      interchrom,
+      excluded,
+      bytes,                               // input read so far
+      dedup_keys;                          // size of the duplicate table
+    unsigned long int input_size;          // 0 if not known (e.g. a pipe)
+
+    unsigned int interval;                 // seconds
+    std::string status_file;               // "" for stderr
+
+    std::mutex lock;
+    std::condition_variable cond;
+    bool stopping;
+    clock::time_point started;
+    std::thread monitor;
+
+    progress_meter(const std::string&, const parameters&);
+    ~progress_meter();
+
+    void set(const totals&);
+    void add(const totals&, const totals&);
+    void stop();
+
+    void monitor_loop();
+    void report(const double&, const double&) const;
+  };
+
+  unsigned long int resident_memory();
+
+}
+
+#endif
@@ -0,0 +1,368 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "readsets.h"
+#include "cpairs.h"
+#include "genome.h"
+#include "bedfiles.h"
+#include "main_process.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstring>
+#include <stdexcept>
+#include <zlib.h>
+
+using namespace CAPCMAIN_NS;
+
+
+namespace {
+
+  const char file_magic[8] = {'C','A','P','C','R','S','T','1'};
+
+  void put_u32(std::string &buf, const std::uint32_t &x) {
+    for (int i=0; i<4; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  void put_u64(std::string &buf, const std::uint64_t &x) {
+    for (int i=0; i<8; i++) {
+      buf.push_back( char( (x>>(8*i)) & 0xff ) );
+    }
+  }
+
+  void put_varint(std::string &buf, std::uint64_t z) {
+    while ( z >= 0x80 ) {
+      buf.push_back( char( (z & 0x7f) | 0x80 ) );
+      z >>= 7;
+    }
+    buf.push_back( char(z) );
+  }
+
+  std::uint64_t get_uint(const char *p, const int &nbytes) {
+    std::uint64_t x = 0;
+    for (int i=0; i<nbytes; i++) {
+      x |= std::uint64_t( (unsigned char)p[i] ) << (8*i);
+    }
+    return x;
+  }
+
+  void read_bytes(std::ifstream &inf, char *p, const std::size_t &n,
+		  const std::string &fname) {
+    inf.read(p,n);
+    if ( inf.gcount() != std::streamsize(n) ) {
+      throw std::runtime_error("read set file "+fname+" is truncated");
+    }
+  }
+
+}
+
+
+std::uint64_t CAPCMAIN_NS::fragments_checksum(const genome &gnm) {
+  // checksum of all the fragments in genome order, as for a .cpairs file
+
+  std::uint64_t sum = checksum_start;
+
+  for ( genome::const_it_rest_map C=gnm.restriction_fragments.begin();
+	C != gnm.restriction_fragments.end(); ++C ) {
+    for ( genome::const_it_rest_set F=C->second.begin();
+	  F != C->second.end(); ++F ) {
+      checksum_fragment(sum, F->chrom, F->start, F->end);
+    }
+  }
+  return sum;
+
+}
+
+
+readset_writer::readset_writer(const std::string &fname, const genome &gnm,
+			       const parameters &params) :
+  filename(fname), nsets(0) {
+  // open a new file and write its header
+
+  std::ifstream inf;
+  std::string head(file_magic,8);
+
+  inf.open( fname.c_str() );
+  if ( inf.good() ) {
+    throw std::runtime_error("file "+fname+" already exists (will not "
+			     "overwrite).");
+  }
+  inf.close();
+
+  ouf.open( fname.c_str(), std::ios::binary );
+  if ( !ouf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+
+  put_u64(head,fragments_checksum(gnm));
+  put_u32(head,gnm.Nfragments);
+  put_u32(head,params.shard);
+  put_u32(head,params.nshards);
+  ouf.write(head.data(),head.size());
+
+}
+
+
+void readset_writer::encode(std::string &buf,
+			    const std::vector<const rest_fragment*> &frags,
+			    const std::uint64_t &set_hash) {
+  // add one read set to buf
+
+  std::int64_t previous = 0,
+    d;
+
+  put_varint(buf,frags.size());
+  for (std::size_t i=0; i<frags.size(); i++) {
+    d = std::int64_t(frags[i]->fragment_id) - previous;
+    put_varint(buf, i==0 ? std::uint64_t(d) :
+	       ( std::uint64_t(d) << 1 ) ^ std::uint64_t(d >> 63) );
+    previous = frags[i]->fragment_id;
+  }
+  put_u64(buf,set_hash);
+
+}
+
+
+void readset_writer::add(const std::vector<const rest_fragment*> &frags,
+			 const std::uint64_t &set_hash) {
+  // add one read set; write the block when it is full
+
+  encode(block,frags,set_hash);
+  nsets++;
+  if ( block.size() >= block_bytes ) {
+    write_block();
+  }
+
+}
+
+
+void readset_writer::add_encoded(const std::string &sets,
+				 const std::uint32_t &n) {
+  // add n read sets which have already been encoded
+
+  block += sets;
+  nsets += n;
+  if ( block.size() >= block_bytes ) {
+    write_block();
+  }
+
+}
+
+
+void readset_writer::write_block() {
+  // write the current block, compressed if that makes it smaller
+
+  std::string head,
+    packed;
+  uLongf packed_len;
+  const std::string *out = &block;
+
+  if ( nsets == 0 ) {
+    return;
+  }
+
+  packed_len = compressBound( block.size() );
+  packed.resize( packed_len );
+  if ( compress2( (Bytef*)&packed[0], &packed_len,
+		  (const Bytef*)block.data(), block.size(),
+		  Z_DEFAULT_COMPRESSION ) == Z_OK &&
+       packed_len < block.size() ) {
+    packed.resize( packed_len );
+    out = &packed;
+  }
+
+  put_u32(head,nsets);
+  put_u32(head,block.size());
+  put_u32(head,out->size());
+  ouf.write(head.data(),head.size());
+  ouf.write(out->data(),out->size());
+  if ( !ouf.good() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+  block.clear();
+  nsets = 0;
+
+}
+
+
+void readset_writer::close(const genome &gnm) {
+  // write the last block, the end block, and the counts of the sets which
+  // are not in the file
+
+  std::string tail;
+
+  write_block();
+  put_u32(tail,0);
+  put_u32(tail,0);
+  put_u32(tail,0);
+  put_u64(tail,gnm.count.total_read_frags);
+  put_u64(tail,gnm.count.total_read_sets);
+  put_u64(tail,gnm.count.none_mapped);
+  put_u64(tail,gnm.count.duplicates_removed);
+  tail.append(file_magic,8);
+  ouf.write(tail.data(),tail.size());
+  ouf.close();
+  if ( ouf.fail() ) {
+    throw std::runtime_error("error writing to file "+filename);
+  }
+
+}
+
+
+readset_reader::readset_reader(const std::string &fname, const genome &gnm) :
+  filename(fname), total_read_frags(0), total_read_sets(0), none_mapped(0),
+  duplicates_removed(0), pos(0), nleft(0), at_end(0) {
+  // open a file, check that it was written with the same fragments, and
+  // number the genome's fragments so that IDs can be looked up
+
+  char buf[20];
+
+  inf.open( fname.c_str(), std::ios::binary );
+  if ( !inf.good() ) {
+    throw std::runtime_error("cannot open file "+fname);
+  }
+  read_bytes(inf,buf,8,fname);
+  if ( std::memcmp(buf,file_magic,8) != 0 ) {
+    throw std::runtime_error(fname+" is not a read set file");
+  }
+
+  read_bytes(inf,buf,20,fname);
+  if ( get_uint(buf,8) != fragments_checksum(gnm) ||
+       get_uint(buf+8,4) != gnm.Nfragments ) {
+    throw std::runtime_error("read set file "+fname+" was written with a "
+			     "different restriction fragments file");
+  }
+  shard = get_uint(buf+12,4);
+  nshards = get_uint(buf+16,4);
+
+  by_id.resize( gnm.Nfragments );
+  for ( genome::const_it_rest_map C=gnm.restriction_fragments.begin();
+	C != gnm.restriction_fragments.end(); ++C ) {
+    for ( genome::const_it_rest_set F=C->second.begin();
+	  F != C->second.end(); ++F ) {
+      by_id[ F->fragment_id ] = &*F;
+    }
+  }
+
+}
+
+
+std::uint64_t readset_reader::get_varint() {
+  // next varint of the current block
+
+  std::uint64_t z = 0;
+  int shift = 0;
+
+  do {
+    if ( pos >= block.size() || shift > 63 ) {
+      throw std::runtime_error("corrupt block in read set file "+filename);
+    }
+    z |= std::uint64_t( (unsigned char)block[pos] & 0x7f ) << shift;
+    shift += 7;
+  } while ( (unsigned char)block[pos++] & 0x80 );
+  return z;
+
+}
+
+
+bool readset_reader::read_block() {
+  // read the next block; at the end, read the trailer and give false
+
+  char buf[40];
+  std::uint32_t length,
+    stored;
+  std::string data;
+  uLongf unpacked_len;
+
+  read_bytes(inf,buf,12,filename);
+  nleft = get_uint(buf,4);
+  length = get_uint(buf+4,4);
+  stored = get_uint(buf+8,4);
+
+  if ( nleft == 0 ) {
+    read_bytes(inf,buf,40,filename);
+    total_read_frags = get_uint(buf,8);
+    total_read_sets = get_uint(buf+8,8);
+    none_mapped = get_uint(buf+16,8);
+    duplicates_removed = get_uint(buf+24,8);
+    if ( std::memcmp(buf+32,file_magic,8) != 0 ) {
+      throw std::runtime_error("read set file "+filename+" is damaged");
+    }
+    at_end = 1;
+    return false;
+  }
+
+  data.resize(stored);
+  read_bytes(inf,&data[0],stored,filename);
+  if ( stored < length ) {
+    block.resize(length);
+    unpacked_len = length;
+    if ( uncompress( (Bytef*)&block[0], &unpacked_len,
+		     (const Bytef*)data.data(), stored ) != Z_OK ||
+	 unpacked_len != length ) {
+      throw std::runtime_error("corrupt block in read set file "+filename);
+    }
+  } else {
+    block.swap(data);
+  }
+  pos = 0;
+  return true;
+
+}
+
+
+bool readset_reader::next(std::vector<const rest_fragment*> &frags,
+			  std::uint64_t &set_hash) {
+  // the fragments and set name hash of the next read set; false at the end
+
+  std::uint64_t n,
+    z;
+  std::int64_t id = 0;
+
+  frags.clear();
+  if ( at_end || ( nleft == 0 && !read_block() ) ) {
+    return false;
+  }
+
+  n = get_varint();
+  for (std::uint64_t i=0; i<n; i++) {
+    z = get_varint();
+    id += i==0 ? std::int64_t(z) :
+      std::int64_t( z >> 1 ) ^ -std::int64_t( z & 1 );
+    if ( id < 0 || std::uint64_t(id) >= by_id.size() ) {
+      throw std::runtime_error("corrupt block in read set file "+filename);
+    }
+    frags.push_back( by_id[id] );
+  }
+  if ( pos + 8 > block.size() ) {
+    throw std::runtime_error("corrupt block in read set file "+filename);
+  }
+  set_hash = get_uint(block.data()+pos,8);
+  pos += 8;
+  nleft--;
+  return true;
+
+}
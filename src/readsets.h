@@ -0,0 +1,112 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef READSETS_H
+#define READSETS_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+namespace CAPCMAIN_NS {
+
+  // Forward Declarations
+  struct genome;
+  struct rest_fragment;
+  struct parameters;
+
+  // A read set file (--save-readsets) holds every read set which is mapped
+  // and not a duplicate, as the restriction fragments it expands to, so
+  // that it can be classified again with other targets, exclusion zone or
+  // options (--from-readsets) without reading the SAM file. Layout :
+  //
+  //   "CAPCRST1"
+  //   header  : checksum of the fragments as in a .cpairs file (u64),
+  //             number of fragments (u32), shard and number of shards (u32)
+  //   blocks  : number of read sets (u32), encoded length (u32), stored
+  //             length (u32), then the stored bytes; zlib compressed if
+  //             the stored length is less than the encoded length. Each
+  //             read set is its number of fragments and the fragment IDs,
+  //             the first as it is and the rest as zigzag differences from
+  //             the one before, all varint encoded, then the hash of the
+  //             set name (u64), which picks the interchromosomal reporter.
+  //   end     : a block with no read sets
+  //   trailer : read fragments, read sets, sets with none mapped and
+  //             duplicates removed (u64 each), then "CAPCRST1" again
+  //
+  // All integers outside the records are little-endian.
+
+  std::uint64_t fragments_checksum(const genome &);
+
+
+  struct readset_writer {
+
+    static const std::size_t block_bytes = 1<<20;
+
+    std::ofstream ouf;
+    std::string filename;
+    std::string block;              // encoded read sets of the current block
+    std::uint32_t nsets;
+
+    readset_writer(const std::string &, const genome &, const parameters &);
+
+    static void encode(std::string &, const std::vector<const rest_fragment*> &,
+		       const std::uint64_t &);
+    void add(const std::vector<const rest_fragment*> &, const std::uint64_t &);
+    void add_encoded(const std::string &, const std::uint32_t &);
+    void write_block();
+    void close(const genome &);
+
+  };
+
+
+  struct readset_reader {
+
+    std::ifstream inf;
+    std::string filename;
+    unsigned int shard,
+      nshards;
+    std::vector<const rest_fragment*> by_id;   // the genome's fragments
+
+    // counts of the run which wrote the file, set at the end
+    std::uint64_t total_read_frags,
+      total_read_sets,
+      none_mapped,
+      duplicates_removed;
+
+    std::string block;              // encoded read sets of the current block
+    std::size_t pos;
+    std::uint32_t nleft;            // read sets left in the block
+    bool at_end;
+
+    readset_reader(const std::string &, const genome &);
+
+    bool next(std::vector<const rest_fragment*> &, std::uint64_t &);
+    bool read_block();
+    std::uint64_t get_varint();
+
+  };
+
+}
+
+#endif
@@ -27,65 +27,154 @@
 #include <string>
 #include <sstream>
 #include <stdexcept>
+#include <string_view>
+#include <charconv>
 
 
 using namespace CAPCMAIN_NS;
 
 
-samfrag samfrag::samline2samfrag(const std::string &line) {
+namespace {
 
-  samfrag thefragment;
-  std::stringstream sline;
-  std::string junk,
-    cigar;
-  int flag,
-    mapq;
-  
-  sline.clear(); sline.str(line);
-  sline>>thefragment.name;
-  thefragment.setname = name2setname(thefragment.name);
+  std::string_view next_field(std::string_view &rest) {
+    // split off the next tab separated field
+    std::size_t tab = rest.find('\t');
+    std::string_view field = rest.substr(0,tab);
+    rest.remove_prefix( tab==std::string_view::npos ? rest.size() : tab+1 );
+    return field;
+  }
+
+}
+
+
+void sam_references::add(const std::string &name) {
+  // add the next reference sequence
+
+  if ( ids.count(name) ) {
+    throw std::runtime_error("reference sequence "+name+" appears more than "
+			     "once in the header");
+  }
+  names.push_back(name);
+  ids[ names.back() ] = names.size()-1;
+
+}
+
+
+bool sam_references::add_header_line(const std::string_view &line) {
+  // if this is an @SQ line, add the reference sequence it names
+
+  std::string_view rest = line,
+    field;
+
+  if ( next_field(rest) != "@SQ" ) {
+    return false;
+  }
+  while ( ! rest.empty() ) {
+    field = next_field(rest);
+    if ( field.substr(0,3) == "SN:" ) {
+      add( std::string(field.substr(3)) );
+      return true;
+    }
+  }
+  throw std::runtime_error("an @SQ header line has no SN field");
+
+}
 
-  sline>>flag>>thefragment.chrom>>thefragment.start>>mapq>>
-    cigar>>junk>>junk>>junk>>junk;
 
-  thefragment.length=junk.size();
+int sam_references::find(const std::string_view &name) const {
+  // ID of a reference sequence; -1 for unmapped ("*")
+
+  if ( name == "*" ) {
+    return -1;
+  }
+  std::unordered_map<std::string_view,int>::const_iterator it = ids.find(name);
+  if ( it == ids.end() ) {
+    throw std::runtime_error("a sam line was mapped to chromosome "
+			     +std::string(name)+" which is not in the @SQ "
+			     "header lines");
+  }
+  return it->second;
+
+}
+
+
+void samfrag::samline2samfrag(const std::string_view &line,
+			      const sam_references &refs,
+			      samfrag &thefragment) {
+  // Decode the columns we need from a SAM line : QNAME, RNAME, POS and
+  // SEQ. The line is split on tabs in place, the other columns are skipped,
+  // and the strings in thefragment are reused.
+
+  std::string_view rest = line,
+    qname, rname, pos, seq;
+  std::from_chars_result res;
+
+  qname = next_field(rest);
+  next_field(rest);                            // FLAG
+  rname = next_field(rest);
+  pos = next_field(rest);
+  for (int i=0; i<5; i++) {
+    next_field(rest);                          // MAPQ CIGAR RNEXT PNEXT TLEN
+  }
+  seq = next_field(rest);
+
+  if ( seq.empty() ) {
+    throw std::runtime_error("a sam line has fewer than 10 columns");
+  }
+
+  std::size_t digest = qname.find("DIGEST");
+  thefragment.setname.assign( qname.substr(0,digest) );
+  thefragment.fragnumber = 0;
+  if ( digest != std::string_view::npos ) {
+    std::from_chars( qname.data()+digest+6, qname.data()+qname.size(),
+		     thefragment.fragnumber );
+  }
+  thefragment.refid = refs.find(rname);
+  res = std::from_chars( pos.data(), pos.data()+pos.size(),
+			 thefragment.start );
+  if ( res.ec != std::errc() ) {
+    throw std::runtime_error("a sam line has an invalid position");
+  }
+  thefragment.length = seq.size();
 
   // if it didn't align, store the sequence for checking duplicates
-  if (thefragment.chrom=="*") {
-    thefragment.sequence=junk;
+  if ( thefragment.refid < 0 ) {
+    thefragment.sequence.assign(seq);
+  } else {
+    thefragment.sequence.clear();
   }
 
   // sam files store coordinates in a 1-based coordinate system
   // so subtract 1 to get 0 based
   thefragment.start--;
-  
-  return thefragment;
-  
+
 }
 
 
 
 
-rest_fragment samfrag::expand_to_restfrag(const genome& gnm) const {
+const rest_fragment& samfrag::expand_to_restfrag(const genome& gnm) const {
   // get the restriction enzyme fragment which this samfrag belongs to
 
   rest_fragment originalfragment;
-  genome::const_it_rest_map achromosome;
+  const std::set<rest_fragment> *achromosome;
   genome::const_it_rest_set afragment;
 
-  originalfragment = *this;
+  // fragments are ordered by start alone
+  originalfragment.start = start;
   
   // get a pointer to the list for this chromosome
-  achromosome = gnm.restriction_fragments.find(chrom);
-  if ( achromosome == gnm.restriction_fragments.end() ) {
+  if ( refid < 0 || refid >= static_cast<int>(gnm.ref_chroms.size()) ||
+       gnm.ref_chroms[refid] == NULL ) {
       throw std::runtime_error("a sam line was mapped to a chromosome"
 			       " not present in the fragments list");
   }
+  achromosome = gnm.ref_chroms[refid];
 
   // find the fragment
-  afragment = achromosome->second.upper_bound(originalfragment);
+  afragment = achromosome->upper_bound(originalfragment);
 
-  if ( afragment == achromosome->second.begin() ) {
+  if ( afragment == achromosome->begin() ) {
     // it is at the start -- double check
     if ( !(originalfragment.start >= afragment->start &&
 	   originalfragment.start < afragment->end ) ) {
@@ -97,7 +186,7 @@ rest_fragment samfrag::expand_to_restfrag(const genome& gnm) const {
     }
   }
 
-  if ( afragment == achromosome->second.end() ) {
+  if ( afragment == achromosome->end() ) {
     --afragment; // go back one
     // it is at the end -- double check
     if ( !(originalfragment.start >= afragment->start &&
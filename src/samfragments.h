@@ -24,6 +24,9 @@
 
 #include "bedfiles.h"
 #include <string>
+#include <string_view>
+#include <deque>
+#include <unordered_map>
 
 namespace CAPCMAIN_NS {
 
@@ -34,15 +37,34 @@ namespace CAPCMAIN_NS {
 
   
   // Structures
+  struct sam_references {
+    // Reference sequence names from the @SQ header lines. A name's position
+    // in the list is its ID, the same as the refID used in BAM records.
+
+    std::deque<std::string> names;       // deque, so ids can point into it
+    std::unordered_map<std::string_view,int> ids;
+
+    void add(const std::string &);
+    bool add_header_line(const std::string_view &);
+    int find(const std::string_view &) const;
+
+  };
+
+
   struct samfrag : bed_feature {
 
     std::string setname,
       sequence;
     unsigned int length;
+    int refid;            // reference ID from the header, -1 if unmapped
+    unsigned int fragnumber;   // N from the "DIGESTN" suffix, 0 if none
+
+    samfrag() : length(0), refid(-1), fragnumber(0) {};
 
-    static samfrag samline2samfrag(const std::string &);
+    static void samline2samfrag(const std::string_view &,
+				const sam_references &, samfrag &);
     
-    rest_fragment  expand_to_restfrag(const genome&) const;
+    const rest_fragment& expand_to_restfrag(const genome&) const;
     
   };
     
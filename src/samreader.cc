@@ -0,0 +1,195 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#include "samreader.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <stdexcept>
+#include <utility>
+
+using namespace CAPCMAIN_NS;
+
+
+sam_reader::sam_reader() {
+  have_lookahead = 0;
+  aligner_order = 0;
+  next_recent = 0;
+  consumed = 0;
+  lookahead_offset = 0;
+  set_offset = 0;
+}
+
+
+void sam_reader::open(const std::string &fname) {
+  // open the file, skip the header, and read the first alignment
+
+  filename = fname;
+  have_lookahead = 0;
+  aligner_order = ( filename == "-" );
+  recent_sets.clear();
+  recent_lookup.clear();
+  next_recent = 0;
+  consumed = 0;
+
+  inf.open( aligner_order ? "/dev/stdin" : filename.c_str() );
+  if ( ! inf.good() ) {
+    throw std::runtime_error("cannot open file "+filename+".");
+  }
+
+  // read the reference names from the header
+  while ( getline(inf,line) ) {
+    lookahead_offset = consumed;
+    consumed += line.size() + 1;
+    if ( line.size() > 0 && line[0] == '@' ) {
+      refs.add_header_line(line);
+    } else if ( line.size() > 0 ) {
+      samfrag::samline2samfrag(line,refs,lookahead);
+      have_lookahead = 1;
+      return;
+    }
+  }
+
+  throw std::runtime_error("samfile does not contain any entries");
+
+}
+
+
+void sam_reader::close() {
+  inf.close();
+  have_lookahead = 0;
+}
+
+
+void sam_reader::seek(const unsigned long int &offset) {
+  // carry on reading from a byte offset, which must be the start of a
+  // read set (as given by set_offset); the header has already been read
+
+  inf.clear();
+  inf.seekg(offset);
+  if ( ! inf.good() ) {
+    throw std::runtime_error("cannot seek in file "+filename+".");
+  }
+  consumed = offset;
+  have_lookahead = next_line();
+
+}
+
+
+bool sam_reader::next_line() {
+  // read the next alignment into the look-ahead; false at end of file
+
+  while ( getline(inf,line) ) {
+    lookahead_offset = consumed;
+    consumed += line.size() + 1;
+    if ( line.size() > 0 ) {
+      samfrag::samline2samfrag(line,refs,lookahead);
+      return true;
+    }
+  }
+  return false;
+
+}
+
+
+bool sam_reader::get_read_set(std::vector<samfrag> &current_sams) {
+  // get the next group of lines which share a set name. Fragments are
+  // swapped in and out of the look-ahead, so their strings are reused.
+
+  std::size_t n = 0;
+
+  if ( ! have_lookahead ) {
+    current_sams.clear();
+    return false;
+  }
+  set_offset = lookahead_offset;
+
+  do {
+    if ( aligner_order ) {
+      check_order( lookahead, n>0 ? &current_sams[n-1] : NULL );
+    }
+    if ( n == current_sams.size() ) {
+      current_sams.push_back( samfrag() );
+    }
+    std::swap( current_sams[n], lookahead );
+    n++;
+    have_lookahead = next_line();
+  } while ( have_lookahead &&
+	    lookahead.setname == current_sams[n-1].setname );
+
+  current_sams.resize(n);
+  if ( aligner_order ) {
+    remember_set( current_sams[0].setname );
+  }
+  return true;
+
+}
+
+
+void sam_reader::check_order(const samfrag &frag,
+			     const samfrag *previous) {
+  // in aligner order, fragments of a set must arrive together and in the
+  // order digestfastq wrote them, numbered from 1, and a set must not
+  // appear again later
+
+  unsigned int expected = previous==NULL ? 1 : previous->fragnumber+1;
+
+  if ( frag.fragnumber == 0 ) {
+    throw std::runtime_error("read "+frag.setname+" in "+filename+" has no "
+			     "DIGEST number; aligner order needs the read "
+			     "names written by capCdigestfastq");
+  }
+  if ( frag.fragnumber == expected ) {
+    if ( previous == NULL && recent_lookup.count(frag.setname) ) {
+      throw std::runtime_error("read set "+frag.setname+" appears again "
+			       "later in "+filename+"; in aligner order each "
+			       "read set must appear only once");
+    }
+    return;
+  }
+  if ( previous == NULL ) {
+    throw std::runtime_error("read set "+frag.setname+" appears more than "
+			     "once in "+filename+"; in aligner order the "
+			     "fragments of each read set must be consecutive "
+			     "(run the aligner with --reorder, or sort by "
+			     "name)");
+  }
+  throw std::runtime_error("fragments of read set "+frag.setname+" are "
+			   "out of order in "+filename);
+
+}
+
+
+void sam_reader::remember_set(const std::string &setname) {
+  // add a set name to the ring of recent ones, dropping the oldest
+
+  if ( recent_sets.size() < recent_window ) {
+    recent_sets.push_back(setname);
+  } else {
+    recent_lookup.erase( recent_sets[next_recent] );
+    recent_sets[next_recent] = setname;
+    next_recent = ( next_recent + 1 ) % recent_window;
+  }
+  recent_lookup.insert(setname);
+
+}
@@ -0,0 +1,82 @@
+/* capC-MAP - a software package for analysis of Capture-C data
+ * Copyright (C) 2018, University of Edinburgh
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ *
+ * Written by Chris Brackley <C.Brackley@ed.ac.uk>
+ *
+ */
+
+
+
+#ifndef SAMREADER_H
+#define SAMREADER_H
+
+#include "samfragments.h"
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <unordered_set>
+
+namespace CAPCMAIN_NS {
+
+  struct sam_reader {
+    // Reads a SAM file one read set at a time. Each line is read once: the
+    // first line of the next set is kept as a look-ahead rather than going
+    // back to it, so the file is never seeked and can be a pipe. (The one
+    // exception is seek(), used when resuming a run from a checkpoint.)
+    //
+    // The file name "-" reads stdin in aligner order : rather than being
+    // sorted by name, the fragments of each read set are only required to
+    // be consecutive, which is checked from their DIGEST numbers. A set
+    // whose name reappears is caught if it is within the last
+    // recent_window sets.
+
+    std::ifstream inf;
+    std::string filename;
+    sam_references refs;                 // from the @SQ header lines
+    bool aligner_order;
+
+    // names of the last sets read in aligner order
+    static const std::size_t recent_window = 1<<16;
+    std::vector<std::string> recent_sets;      // ring, oldest at next_recent
+    std::unordered_set<std::string> recent_lookup;
+    std::size_t next_recent;
+
+    std::string line;
+    samfrag lookahead;                   // first line of the next set
+    bool have_lookahead;
+
+    // byte offsets in the file, counted as lines are read
+    unsigned long int consumed,          // bytes read so far
+      lookahead_offset,                  // start of the look-ahead line
+      set_offset;                        // start of the last set returned
+
+    sam_reader();
+
+    void open(const std::string &);
+    void close();
+    void seek(const unsigned long int &);
+
+    bool get_read_set(std::vector<samfrag> &);
+    bool next_line();
+    void check_order(const samfrag &, const samfrag *);
+    void remember_set(const std::string &);
+
+  };
+
+}
+
+#endif
@@ -28,7 +28,6 @@ using namespace CAPCMAIN_NS;
 target& target::operator= (const bed_feature& feature) {
   chrom = feature.chrom;
   name = feature.name;
-  strand = feature.strand;
   start = feature.start;
   end = feature.end;
   istrand = feature.istrand;
@@ -31,7 +31,7 @@ namespace CAPCMAIN_NS {
   
   struct target : bed_feature {
     
-    int target_id;
+    int target_id;      // dense ID, in order of the targets file
 
     target() {};
     target(const std::string &n)  {name=n;};